@@ -0,0 +1,48 @@
+#ifndef _ACTUATOR_H_
+#define _ACTUATOR_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define ACTUATOR_FULL (1L << 30)	//!< Full control in control units (100% duty cycle).
+#define ACTUATOR_POINTS 17		//!< Breakpoints of the linearization, every 1/16 of the full control.
+
+/**
+ * @brief Set the inverse of the half-bridge nonlinearity.
+ *
+ * The half-bridge and the motor produce no torque below a deadband of
+ * small duty cycles and a torque that isn't quite proportional above it.
+ * The table gives the duty cycle producing each of ACTUATOR_POINTS equally
+ * spaced torques, from just above zero to the full control, in control
+ * units: the first entry is the edge of the deadband, the last one the
+ * duty cycle of the full torque. It is measured with an open-loop
+ * staircase and Tools/pwm_linearize.py. Both directions use the same table.
+ *
+ * Called before the motor is driven, the table is copied.
+ *
+ * @param table Pointer to the ACTUATOR_POINTS duty cycles, NULL for the linear mapping.
+ * @return 0 on success, -1 if the table isn't increasing within 0 and the
+ *         full control (the mapping is left unchanged).
+ */
+int32_t Actuator_SetLinearization(const int32_t *table);
+
+/**
+ * @brief Map a torque command to the duty cycle producing it.
+ *
+ * The duty cycle is interpolated linearly between the breakpoints, with the
+ * sign of the control. Zero stays zero, so a motor at rest isn't driven;
+ * any other control starts at the edge of the deadband, where the torque
+ * is still zero, so a small control produces a proportional torque.
+ *
+ * @param control The torque command in control units, within the full control.
+ * @return The duty cycle in control units, the control itself without a table.
+ */
+int32_t Actuator_Linearize(int32_t control);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif   // _ACTUATOR_H_
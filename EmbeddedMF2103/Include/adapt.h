@@ -0,0 +1,98 @@
+#ifndef _ADAPT_H_
+#define _ADAPT_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "motor_model.h"
+
+#define ADAPT_QUEUE 64		//!< Samples buffered between the control loop and the estimator (power of two).
+
+/**
+ * @brief Parameters of the online model adaptation.
+ */
+typedef struct {
+  uint8_t order;           //!< Order of the ARX model, 1 or 2.
+  uint32_t decimation;     //!< Regular samples per estimator update.
+  int32_t lambda;          //!< Forgetting factor in Q30 (rls.h), memory of 1 / (1 - lambda) updates.
+  uint32_t filter_alpha;   //!< Coefficient of the velocity low-pass at the start in 1/1000, 1000 if unfiltered.
+  uint32_t warmup;         //!< Estimator updates before the first model.
+  uint32_t publish;        //!< Estimator updates between two models.
+  MotorModel_t nominal;    //!< Nominal model, bounding the accepted ones.
+} Adapt_Config_t;
+
+/**
+ * @brief Reset the online model adaptation.
+ *
+ * The adaptation fits the ARX model of the identification experiment
+ * (sysid.h) on the closed-loop samples with a forgetting factor, so the
+ * model follows the drift of the friction and of the time constant. The
+ * friction regressor is the direction of motion, which the square wave
+ * reverses. The control and the friction regressor go through the same
+ * low-pass as the velocity before the fit, so the fit returns the motor
+ * without the filter.
+ *
+ * @param config Pointer to the parameters.
+ * @return 0 on success, -1 if the parameters are invalid.
+ */
+int32_t Adapt_Init(const Adapt_Config_t *config);
+
+/**
+ * @brief Queue one control step for the estimator.
+ *
+ * Called from the control loop after the control is computed. It only
+ * copies the sample and never blocks: when the queue is full the sample is
+ * dropped, counted, and the estimator restarts its regressor history.
+ *
+ * The filter is the one the velocity actually went through. When it
+ * changes, the estimator filters the inputs with the new coefficient from
+ * a restarted history; the fit itself is kept, it doesn't include the
+ * filter. Without a first-order low-pass (0) the adaptation pauses.
+ *
+ * @param velocity The measured velocity in RPM, as filtered by the encoder.
+ * @param control The control computed from it, applied until the next step.
+ * @param millisec The time of the measurement in milliseconds.
+ * @param filter_alpha Coefficient of the velocity low-pass in 1/1000, 0 if
+ *        the velocity went through another filter.
+ */
+void Adapt_Push(int32_t velocity, int32_t control, uint32_t millisec, uint32_t filter_alpha);
+
+/**
+ * @brief Run the estimator on the queued samples.
+ *
+ * Called from a context that can't delay the control loop: after the
+ * control step, or from a thread of lower priority. Each sample costs at
+ * most one estimator update (Rls_Update()) and each published model one
+ * Sysid_ToModel(), so the budget bounds the time spent per call.
+ *
+ * @param budget The maximum number of samples to process.
+ * @return The number of samples processed.
+ */
+uint32_t Adapt_Run(uint32_t budget);
+
+/**
+ * @brief Take the latest adapted model.
+ *
+ * Called from the control loop, which applies the model between two steps.
+ * Models outside half to twice the nominal gain and time constant, or with
+ * a friction outside 0 to 25% of the full control, are discarded.
+ *
+ * @param model Pointer to the model receiving the result.
+ * @return 0 if a new model was taken, -1 if none is pending.
+ */
+int32_t Adapt_TakeModel(MotorModel_t *model);
+
+/**
+ * @brief Get the number of samples dropped on a full queue.
+ *
+ * @return The number of dropped samples since the start.
+ */
+uint32_t Adapt_GetDropped(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif   // _ADAPT_H_
@@ -6,6 +6,102 @@ extern "C" {
 
 #define PERIOD_CTRL 50		//!< Period of the control loop in milliseconds.
 #define PERIOD_REF 4000		//!< Period of the reference switch in milliseconds.
+#define COMPENSATE_SKIPPED 1	//!< Replay reference switches that fall into skipped cycles.
+
+#define RECORDER_POST 256		//!< Samples recorded after a trigger before the flight recorder freezes.
+#define RECORDER_ERROR 0	//!< Tracking error freezing the flight recorder in RPM, 0 leaves only the deadline triggers; above the error of a flip (3400 RPM with the S-curve).
+#define RECORDER_DUMP_LINES 4	//!< Lines of a frozen trace printed per control period.
+
+#define TRAJ_PROFILE TRAJECTORY_SCURVE	//!< Reference profile between two targets (trajectory.h).
+#define TRAJ_ACCEL 20000		//!< Maximum reference acceleration in RPM/s.
+#define TRAJ_JERK 100000		//!< Maximum reference jerk in RPM/s^2.
+
+#define MOTOR_GAIN 3000		//!< Nominal motor velocity at 100% duty cycle in RPM.
+#define MOTOR_TAU 80		//!< Nominal mechanical time constant in milliseconds.
+#define MOTOR_FRICTION 53687091	//!< Nominal Coulomb friction in control units (5% duty cycle).
+#define FEEDFORWARD 0		//!< Feedforward terms (CONTROLLER_FF_x), 0 until the model is identified.
+#define VELOCITY_OBSERVER 0	//!< Bandwidth of the velocity observer in rad/s, 0 keeps the low-pass filter.
+#define DISTURBANCE_OBSERVER 0	//!< Bandwidth of the load compensation in rad/s, 0 disables it; needs VELOCITY_OBSERVER.
+
+/* With the linearization the control is a torque, the deadband no longer
+   adds to the friction: identify the motor model again with it enabled. */
+#define PWM_LINEARIZE 0		//!< Map the control through the inverse of the half-bridge deadband, PWM_LINEARIZATION (peripherals.h).
+#define PWM_DITHER 0		//!< Fractional duty cycle bits dithered over the DMA pattern of the PWM, up to PWM_DITHER_MAX; 0 disables it.
+#define FILTER_BENCH 0		//!< Print the DWT cycles of Biquad_Process for the velocity filter presets before the setup, for Tools/filter_bench.c.
+#define FILTER_BENCH_SAMPLES 1000	//!< Samples timed per filter, one per call.
+#define PWM_STAIRCASE 0		//!< Print the velocity of an open-loop duty staircase for Tools/pwm_linearize.py before the setup.
+#define PWM_STAIRCASE_STEP 10737418	//!< Duty cycle step of the staircase in control units (1% duty cycle).
+#define PWM_STAIRCASE_STEPS 30	//!< Steps of the staircase in each direction.
+#define PWM_STAIRCASE_HOLD 2000	//!< Time per step in milliseconds, the velocity is averaged over the second half.
+
+#define GAIN_SCHEDULE 0		//!< Scale KP/KI with the speed schedule below.
+#define GAIN_SCHEDULE_SHIFT 8	//!< Schedule breakpoints every 256 RPM.
+/** Q12 KP/KI factors at 0, 256, ... 2048 RPM, the same in both directions:
+    twice the integral gain at standstill to break the Coulomb friction. */
+#define GAIN_SCHEDULE_ROW {{4096, 8192}, {4096, 6144}, {4096, 4096}, {4096, 4096}, {4096, 4096}, \
+                           {4096, 4096}, {4096, 4096}, {4096, 4096}, {4096, 4096}}
+
+/* Position loop on every velocity sample: it settles every move both at the
+   50 ms PERIOD_CTRL and at the 10 ms samples of the networked loop
+   (Tools/plant_sim.c position), a divider of 2 overshoots by 3500 counts
+   at 50 ms. */
+#define POSITION_CONTROL 0	//!< Cascade a position loop around the velocity PI, the target steps in position.
+#define POSITION_MOVE 20480	//!< Position target in counts, alternating with 0 every PERIOD_REF (10 revolutions).
+#define POSITION_KP 600		//!< Velocity reference per position error in RPM per revolution.
+#define POSITION_KI 3000		//!< Position integral gain in RPM per revolution and second.
+#define POSITION_MAX_SPEED 2000	//!< Limit of the velocity reference of the position loop in RPM.
+#define POSITION_DIVIDER 1		//!< Velocity loop periods per position loop period.
+
+#define SYSID 0			//!< Identify the motor model with an excitation experiment before the first target.
+#define SYSID_SIGNAL SYSID_PRBS	//!< Excitation signal (sysid.h).
+#define SYSID_ORDER 2		//!< Order of the fitted ARX model, 1 or 2.
+#define SYSID_BIAS 536870912	//!< Control offset of the experiment in control units (50% duty cycle).
+#define SYSID_AMPLITUDE 268435456	//!< Excitation amplitude in control units (25% duty cycle).
+#define SYSID_BIT 50		//!< PRBS bit duration in milliseconds.
+#define SYSID_F_START 200	//!< Chirp start frequency in mHz.
+#define SYSID_F_STOP 10000	//!< Chirp stop frequency in mHz.
+#define SYSID_SETTLE 1000	//!< Time at the bias before the excitation in milliseconds.
+#define SYSID_DURATION 20000	//!< Duration of the excitation in milliseconds.
+
+/* The table replaces the friction feedforward, leave CONTROLLER_FF_FRICTION
+   out of FEEDFORWARD. The sweep runs before the control loop at its own
+   period, short enough for a position loop stiff against the cogging: at
+   3 RPM a cogging of 6 periods per revolution is at 2 rad/s. */
+#define COGGING 0		//!< Compensate the friction and cogging with a table over the angle, learned once and kept in flash.
+#define COGGING_RECALIBRATE 0	//!< Learn the table again instead of aligning the one in flash.
+#define COGGING_PERIOD 5		//!< Period of the calibration sweep in milliseconds.
+#define COGGING_SPEED 3		//!< Velocity of the calibration sweep in RPM, below one bin (32 counts) per period.
+#define COGGING_REVOLUTIONS 2	//!< Revolutions averaged per direction by the calibration.
+#define COGGING_SETTLE 5000	//!< Time at speed before sampling, after each reversal, in milliseconds.
+#define COGGING_BANDWIDTH 30	//!< Bandwidth of the position loop of the sweep in rad/s.
+#define COGGING_TIMEOUT 180000	//!< Maximum duration of a calibration or alignment sweep in milliseconds.
+#define COGGING_BLEND 50		//!< Reference speed below which the compensation fades out in RPM.
+
+#define ADAPT 0			//!< Adapt the motor model online to the closed-loop samples; needs the low-pass filter.
+#define ADAPT_ORDER 2		//!< Order of the fitted ARX model, 1 or 2.
+#define ADAPT_DECIMATION 1	//!< Control periods per estimator update.
+#define ADAPT_LAMBDA 1071594340	//!< Forgetting factor 0.998 in Q30, a memory of 500 updates.
+#define ADAPT_WARMUP 200		//!< Estimator updates before the first adapted model.
+#define ADAPT_PUBLISH 50		//!< Estimator updates between two adapted models.
+#define ADAPT_BUDGET 2		//!< Queued samples processed after each control step at most.
+
+#define FRA 0			//!< Measure the loop gain with a swept sine on the reference before the first target (server: PARAM_MODE_FRA).
+#define FRA_SETPOINT 1000		//!< Velocity around which the reference oscillates in RPM.
+#define FRA_AMPLITUDE 100		//!< Amplitude of the sine on the reference in RPM.
+/** Frequencies of the sweep in mHz, those above a quarter of the sampling
+    rate (5 Hz at PERIOD_CTRL) are skipped. */
+#define FRA_FREQUENCIES {200, 250, 300, 400, 500, 700, 1000, 1500, 2000, 3000, \
+                         4000, 5000, 7000, 10000, 15000, 20000}
+#define FRA_SETTLE 2000		//!< Time at the setpoint before the sweep in milliseconds.
+#define FRA_SETTLE_CYCLES 1	//!< Periods discarded after each frequency change.
+#define FRA_CYCLES 3		//!< Periods integrated per frequency.
+
+#define AUTOTUNE 0			//!< Tune KP/KI with a relay experiment before the first target.
+#define AUTOTUNE_SETPOINT 1000	//!< Velocity of the relay experiment in RPM.
+#define AUTOTUNE_AMPLITUDE 268435456	//!< Relay amplitude in control units (25% duty cycle).
+#define AUTOTUNE_HYSTERESIS 20	//!< Relay hysteresis in RPM.
+#define AUTOTUNE_LEAD 5000		//!< Time to settle at the setpoint before the relay starts in milliseconds.
+#define AUTOTUNE_TIMEOUT 30000	//!< Maximum duration of the relay experiment in milliseconds.
 
 /**
  * @brief Initializes the application.
@@ -0,0 +1,93 @@
+#ifndef _AUTOTUNE_H_
+#define _AUTOTUNE_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "controller.h"
+
+#define AUTOTUNE_SETTLE 2		//!< Limit-cycle periods discarded before measuring.
+#define AUTOTUNE_PERIODS 4		//!< Limit-cycle periods averaged for the result.
+
+/**
+ * @brief State of the relay experiment.
+ */
+typedef enum {
+  AUTOTUNE_IDLE = 0,       //!< No experiment started.
+  AUTOTUNE_RUNNING,        //!< Relay in control of the motor.
+  AUTOTUNE_DONE,           //!< Result available.
+  AUTOTUNE_FAILED          //!< Aborted on timeout or velocity limit.
+} Autotune_State_t;
+
+/**
+ * @brief Parameters of the relay experiment.
+ */
+typedef struct {
+  int32_t setpoint;        //!< Velocity around which the motor oscillates in RPM.
+  int32_t amplitude;       //!< Relay amplitude d in control units.
+  int32_t hysteresis;      //!< Relay hysteresis in RPM, larger than the velocity noise.
+  int32_t bias;            //!< Initial control offset in control units.
+  int32_t limit;           //!< Velocity error aborting the experiment in RPM.
+  uint32_t timeout_ms;     //!< Maximum duration of the experiment in milliseconds.
+} Autotune_Config_t;
+
+/**
+ * @brief Outcome of the relay experiment.
+ */
+typedef struct {
+  uint32_t period_ms;      //!< Ultimate period Tu in milliseconds.
+  int32_t amplitude;       //!< Limit-cycle amplitude a (half peak-to-peak) in RPM.
+  int32_t ku;              //!< Ultimate gain Ku in control units per RPM.
+  int32_t bias;            //!< Control offset the relay converged to.
+  Controller_Gains_t gains; //!< PI gains derived from Ku and Tu.
+} Autotune_Result_t;
+
+/**
+ * @brief Start a relay-feedback (Astrom-Hagglund) experiment.
+ *
+ * While the experiment runs, Autotune_Step() replaces the controller: the
+ * control switches between bias + d and bias - d each time the velocity
+ * crosses the setpoint, which drives the loop into a limit cycle at its
+ * ultimate frequency. The bias is adjusted every period so the relay is
+ * on for as long as it is off, which centres the cycle despite friction.
+ *
+ * @param config Pointer to the experiment parameters.
+ * @param millisec The start time in milliseconds.
+ */
+void Autotune_Start(const Autotune_Config_t *config, uint32_t millisec);
+
+/**
+ * @brief Run one step of the relay experiment.
+ *
+ * @param velocity The measured velocity in RPM.
+ * @param millisec The current time in milliseconds.
+ * @return The control signal to apply, 0 once the experiment is over.
+ */
+int32_t Autotune_Step(int32_t velocity, uint32_t millisec);
+
+/**
+ * @brief Get the state of the relay experiment.
+ *
+ * @return The current state.
+ */
+Autotune_State_t Autotune_GetState(void);
+
+/**
+ * @brief Read the result of a finished experiment.
+ *
+ * The ultimate gain is Ku = 4d / (pi * sqrt(a^2 - h^2)) with the hysteresis h.
+ * The PI gains follow the Tyreus-Luyben rule, Kp = Ku / 3.2 and
+ * Ti = 2.2 Tu, which keeps more phase margin than Ziegler-Nichols.
+ *
+ * @param result Pointer to the structure receiving the result.
+ * @return 0 on success, -1 if no result is available.
+ */
+int32_t Autotune_GetResult(Autotune_Result_t *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif   // _AUTOTUNE_H_
@@ -0,0 +1,88 @@
+#ifndef _BIQUAD_H_
+#define _BIQUAD_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#if defined (_RTE_)
+#include "RTE_Components.h"
+#endif
+
+/* The cascade runs on CMSIS-DSP when its component is selected in the
+   project, on the reference implementation of biquad.c otherwise (and on
+   the host). Both give bit-identical results. */
+#if defined (RTE_CMSIS_DSP)
+#include "arm_math.h"
+#define BIQUAD_CMSIS 1
+#else
+#define BIQUAD_CMSIS 0
+#endif
+
+#define BIQUAD_MAX_STAGES 4		//!< Maximum number of second-order stages of a cascade.
+
+/**
+ * @brief Coefficients of a biquad cascade, designed with Tools/biquad_design.py.
+ *
+ * Each stage holds {b0, b1, b2, a1, a2} in Q31 scaled down by 2^post_shift,
+ * with the feedback coefficients negated as in CMSIS-DSP:
+ * y[n] = b0*x[n] + b1*x[n-1] + b2*x[n-2] + a1*y[n-1] + a2*y[n-2].
+ */
+typedef struct {
+  uint8_t stages;        //!< Number of stages, 1 to BIQUAD_MAX_STAGES.
+  int8_t post_shift;     //!< Left shift restoring the coefficient scale, 0 to 31.
+  int32_t coeffs[5 * BIQUAD_MAX_STAGES]; //!< Stage coefficients.
+} Biquad_Coeffs_t;
+
+/**
+ * @brief State of a Q31 direct form I biquad cascade.
+ */
+typedef struct {
+  const Biquad_Coeffs_t *coeffs;          //!< Coefficients, not copied.
+  int32_t state[4 * BIQUAD_MAX_STAGES];   //!< {x[n-1], x[n-2], y[n-1], y[n-2]} per stage.
+#if BIQUAD_CMSIS
+  arm_biquad_casd_df1_inst_q31 inst;      //!< CMSIS-DSP instance on the same state.
+#endif
+} Biquad_t;
+
+/**
+ * @brief Attach a cascade to its coefficients and clear its state.
+ *
+ * @param filter Pointer to the cascade.
+ * @param coeffs Pointer to the coefficients, which must outlive the cascade.
+ * @return 0 on success, -1 if the number of stages or the post-shift is out of range.
+ */
+int32_t Biquad_Init(Biquad_t *filter, const Biquad_Coeffs_t *coeffs);
+
+/**
+ * @brief Set the cascade to the steady state of a constant input.
+ *
+ * Every delayed input and output is set to the value, which is exact for
+ * stages with unity gain at DC (low-pass, notch) and lets the input switch
+ * to this filter without a transient.
+ *
+ * @param filter Pointer to the cascade.
+ * @param value The constant input, in Q31.
+ */
+void Biquad_Reset(Biquad_t *filter, int32_t value);
+
+/**
+ * @brief Filter a block of samples.
+ *
+ * The products are accumulated in 64-bit, the output of each stage is
+ * truncated to Q31 after the post-shift and wraps on overflow, so the input
+ * needs the headroom of the largest gain of the cascade.
+ *
+ * @param filter Pointer to the cascade.
+ * @param in Pointer to the input samples in Q31.
+ * @param out Pointer to the output samples in Q31, may be the input.
+ * @param count Number of samples.
+ */
+void Biquad_Process(Biquad_t *filter, const int32_t *in, int32_t *out, uint32_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif   // _BIQUAD_H_
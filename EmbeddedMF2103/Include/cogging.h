@@ -0,0 +1,164 @@
+#ifndef _COGGING_H_
+#define _COGGING_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "motor_model.h"
+
+#define COGGING_BINS 64			//!< Table entries per revolution and direction (power of two).
+#define COGGING_MAGIC 0x47434346u	//!< "FCCG" in little-endian byte order, marks a stored table.
+
+/**
+ * @brief State of the calibration sweep.
+ */
+typedef enum {
+  COGGING_IDLE = 0,        //!< No sweep started.
+  COGGING_RUNNING,         //!< Sweep in control of the motor.
+  COGGING_DONE,            //!< Table learned or aligned, compensation available.
+  COGGING_FAILED           //!< Stalled, timed out, or a bin was never sampled.
+} Cogging_State_t;
+
+/**
+ * @brief Kind of sweep.
+ */
+typedef enum {
+  COGGING_CALIBRATE = 0,   //!< Learn the table in both directions.
+  COGGING_ALIGN            //!< Find the angle of the loaded table, forward only.
+} Cogging_Mode_t;
+
+/**
+ * @brief Parameters of the sweep.
+ */
+typedef struct {
+  Cogging_Mode_t mode;     //!< Calibration or alignment.
+  int32_t speed;           //!< Velocity of the sweep in RPM, below one bin per sample.
+  uint32_t revolutions;    //!< Revolutions averaged per direction.
+  uint32_t settle_ms;      //!< Time at speed before sampling, after each reversal, in milliseconds.
+  uint32_t bandwidth;      //!< Bandwidth of the position loop of the sweep in rad/s.
+  uint32_t timeout_ms;     //!< Maximum duration of the sweep in milliseconds.
+  MotorModel_t model;      //!< Motor model, for the loop gains and the viscous part of the control.
+} Cogging_Config_t;
+
+/**
+ * @brief Compensation table as stored in flash.
+ */
+typedef struct {
+  uint32_t magic;          //!< COGGING_MAGIC.
+  uint32_t bins;           //!< COGGING_BINS of the firmware that stored it.
+  int32_t table[2][COGGING_BINS]; //!< Control per angle, forward then reverse, in control units.
+  uint32_t checksum;       //!< FNV-1a of the words above.
+} Cogging_Table_t;
+
+/**
+ * @brief Summary of a finished sweep.
+ */
+typedef struct {
+  uint32_t samples;        //!< Samples accumulated into the bins.
+  int32_t friction[2];     //!< Mean of the table forward and reverse in control units.
+  int32_t ripple;          //!< Largest peak-to-peak over the angle in control units.
+  uint32_t shift;          //!< Angle of the table in counts, 0 after a calibration.
+} Cogging_Result_t;
+
+/**
+ * @brief Start a calibration or alignment sweep.
+ *
+ * While the sweep runs, the module drives the motor: a PI position loop
+ * follows a position ramping at a constant low speed forward, then reverse.
+ * The velocity PI would stick and slip at such speeds, the position loop
+ * integrates the friction away instead. The control of each step is
+ * averaged into the bin of the angle it was applied at, so after the
+ * viscous part is removed each bin holds the Coulomb friction and the
+ * cogging torque of its angle and direction. The encoder has no index, so
+ * the angle is counted from the start of the firmware: an alignment sweep
+ * measures one forward revolution and finds the shift of the loaded table
+ * (Cogging_Load()) by cross-correlation.
+ *
+ * @param config Pointer to the sweep parameters.
+ * @param position The encoder position in counts.
+ * @param millisec The start time in milliseconds.
+ * @return 0 on success, -1 if the parameters are invalid or no table is loaded to align.
+ */
+int32_t Cogging_Start(const Cogging_Config_t *config, int64_t position, uint32_t millisec);
+
+/**
+ * @brief Run one step of the sweep.
+ *
+ * The sweep fails when the position falls a revolution behind the ramp.
+ *
+ * @param position The encoder position in counts.
+ * @param millisec The current time in milliseconds.
+ * @return The control to apply until the next step, 0 once the sweep is over.
+ */
+int32_t Cogging_Step(int64_t position, uint32_t millisec);
+
+/**
+ * @brief Get the state of the sweep.
+ *
+ * @return The current state.
+ */
+Cogging_State_t Cogging_GetState(void);
+
+/**
+ * @brief Read the summary of a finished sweep.
+ *
+ * @param result Pointer to the structure receiving the result.
+ * @return 0 on success, -1 if no result is available.
+ */
+int32_t Cogging_GetResult(Cogging_Result_t *result);
+
+/**
+ * @brief Load a table stored by Cogging_Save().
+ *
+ * The table replaces the current one but isn't applied before an alignment
+ * sweep has found its angle.
+ *
+ * @param table Pointer to the stored table.
+ * @return 0 on success, -1 if the table is missing, corrupt or of another size.
+ */
+int32_t Cogging_Load(const Cogging_Table_t *table);
+
+/**
+ * @brief Copy the calibrated table for storage, in the angle of the calibration.
+ *
+ * @param table Pointer to the structure receiving the table and its checksum.
+ * @return 0 on success, -1 if no table is calibrated or aligned.
+ */
+int32_t Cogging_Save(Cogging_Table_t *table);
+
+/**
+ * @brief Apply the compensation.
+ *
+ * @param blend Reference speed in RPM below which the compensation fades
+ *              linearly to 0, so a motor at rest isn't pushed; 0 disables it.
+ * @return 0 on success, -1 if no table is calibrated or aligned.
+ */
+int32_t Cogging_Enable(int32_t blend);
+
+/**
+ * @brief Compensation of the friction and cogging at an angle.
+ *
+ * Passed to the controller as its feedforward input
+ * (Controller_SetFeedforwardInput()), so the saturation and the disturbance
+ * observer include it, in place of the friction feedforward
+ * (CONTROLLER_FF_FRICTION), in the direction of the reference
+ * like the feedforward, so it breaks the static friction when the reference
+ * reverses. The control is held for a period, so the table is averaged
+ * over the angle the reference covers in it: interpolated between the bin
+ * centres at low speed, the mean friction once a period covers a
+ * revolution and the cogging is far above the loop bandwidth.
+ *
+ * @param position The encoder position in counts.
+ * @param reference The velocity reference in RPM.
+ * @param period The control period in milliseconds.
+ * @return The control to add in control units, 0 while disabled.
+ */
+int32_t Cogging_Compensate(int64_t position, int32_t reference, uint32_t period);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif   // _COGGING_H_
@@ -6,10 +6,78 @@ extern "C" {
 
 #include <stdint.h>
 
+#include "motor_model.h"
+
 #if defined (__ARMCC_VERSION) && (__ARMCC_VERSION >= 6100100)
 #include <arm_acle.h>
 #endif
 
+#define CONTROLLER_FF_VELOCITY 0x01	//!< Feedforward of the reference velocity.
+#define CONTROLLER_FF_FRICTION 0x02	//!< Feedforward of the Coulomb friction.
+#define CONTROLLER_FF_ACCEL    0x04	//!< Feedforward of the reference acceleration.
+
+#define CONTROLLER_SCHEDULE_POINTS 9	//!< Speed breakpoints of a gain schedule, per direction.
+#define CONTROLLER_SCHEDULE_ONE 4096	//!< Gain factor of 1.0 in a schedule (Q12).
+
+/**
+ * @brief Gains of the PI law.
+ */
+typedef struct {
+  int32_t kp;    //!< Proportional gain in control units per RPM.
+  int32_t ki;    //!< Integral gain in control units per RPM and second.
+} Controller_Gains_t;
+
+/**
+ * @brief Gain factors of one breakpoint of a gain schedule, in Q12.
+ */
+typedef struct {
+  uint16_t kp;   //!< Factor applied to the proportional gain.
+  uint16_t ki;   //!< Factor applied to the integral gain.
+} Controller_ScheduleFactor_t;
+
+/**
+ * @brief Gain schedule over the measured speed and the reference direction.
+ *
+ * Breakpoint i of a row sits at a measured speed of i << shift RPM, speeds
+ * beyond the last breakpoint use its factors. Row 0 applies while the
+ * reference is zero or positive, row 1 while it is negative.
+ */
+typedef struct {
+  Controller_ScheduleFactor_t factor[2][CONTROLLER_SCHEDULE_POINTS]; //!< Factors by direction and speed.
+  uint8_t shift;   //!< Breakpoint spacing as a power of two in RPM, 1 to 14.
+} Controller_Schedule_t;
+
+/**
+ * @brief Runtime parameters of the controller.
+ */
+typedef struct {
+  Controller_Gains_t gains;  //!< Gains of the PI law.
+  int32_t control_max;       //!< Upper saturation limit in control units.
+  int32_t control_min;       //!< Lower saturation limit in control units.
+} Controller_Params_t;
+
+/**
+ * @brief Complete configuration of the controller, as applied to its steps.
+ *
+ * The feedforward and observer gains are kept as derived from the motor
+ * model and the schedule is copied, so a replay applying the configuration
+ * reproduces the steps bit for bit (Tools/replay.c). The layout is the same
+ * on the target and on the host.
+ */
+typedef struct {
+  uint32_t generation;          //!< Counts the configuration changes and resets since start.
+  Controller_Params_t params;   //!< Parameters in use.
+  int32_t ff_kv;                //!< Velocity feedforward gain in control units per RPM.
+  int32_t ff_ka;                //!< Acceleration feedforward gain in control units per RPM/ms.
+  int32_t ff_kf;                //!< Friction feedforward in control units.
+  int32_t dob_kv;               //!< Observer model gain in control units per RPM.
+  int32_t dob_tau;              //!< Observer model time constant in milliseconds.
+  int32_t dob_kf;               //!< Observer model friction in control units.
+  uint32_t dob_bw;              //!< Observer bandwidth in rad/s, 0 when disabled.
+  uint32_t scheduled;           //!< 1 if the gains follow the schedule below.
+  Controller_Schedule_t schedule; //!< Gain schedule, valid when scheduled.
+} Controller_Config_t;
+
 /**
  * @brief Apply a PI-control law to calculate the control signal for the motor.
  *
@@ -33,6 +101,128 @@ int32_t Controller_PIController(const int32_t* reference, const int32_t* measure
  */
 void Controller_Reset(void);
 
+/**
+ * @brief Enable a model-based feedforward term alongside the PI law.
+ *
+ * This function derives the feedforward gains from the nominal motor model:
+ * u_ff = (r + tau * dr/dt) / gain + friction * sign(r).
+ * The term is added before saturation and the anti-windup keeps the integrator
+ * consistent with it. It must be called from the thread running the controller.
+ *
+ * @param model Pointer to the motor model, NULL disables the feedforward.
+ * @param terms Combination of CONTROLLER_FF_x flags selecting the terms.
+ */
+void Controller_SetFeedforward(const MotorModel_t *model, uint8_t terms);
+
+/**
+ * @brief Add a feedforward computed outside the controller to its steps.
+ * The term is added to the model feedforward before saturation, so the
+ * anti-windup and the disturbance observer account for it like for the
+ * controller's own terms (e.g. a preview of the reference or a cogging
+ * compensation). It applies until it is set again and is cleared by
+ * Controller_Reset(). It must be called from the thread running the
+ * controller, before the step it applies to.
+ * @param control The feedforward in control units.
+ */
+void Controller_SetFeedforwardInput(int32_t control);
+
+/**
+ * @brief Enable a disturbance observer compensating the load at the output.
+ *
+ * The observer runs the measured velocity back through the nominal model to
+ * the control that would produce it: u_eq = (v + tau * dv/dt) / gain +
+ * friction * sign(v). The difference to the control of the previous step
+ * is the control lost to the load. It is low-pass filtered at the given
+ * bandwidth and added to the output, so a load step is rejected at the
+ * observer bandwidth while the integrator only removes the model error.
+ * The anti-windup keeps the integrator consistent with the compensation.
+ * It must be called from the thread running the controller.
+ *
+ * @param model Pointer to the motor model, NULL disables the observer.
+ * @param bandwidth The bandwidth of the estimate in rad/s, 0 disables the observer.
+ */
+void Controller_SetDisturbanceObserver(const MotorModel_t *model, uint32_t bandwidth);
+
+/**
+ * @brief Get the load estimate of the disturbance observer.
+ *
+ * @return The control lost to the load, scaled to MOTOR_CONTROL_SCALE, 0 if disabled.
+ */
+int32_t Controller_GetDisturbance(void);
+
+/**
+ * @brief Scale the PI gains with a schedule interpolated at every step.
+ *
+ * The factors are interpolated linearly between the two breakpoints around
+ * the measured speed, in the row of the reference direction, and multiply
+ * the gains of the parameter set in use. The integrator accumulates the
+ * scaled increments, so a change of factor doesn't bump the output.
+ * The table is not copied. It must be called from the thread running the
+ * controller.
+ *
+ * @param schedule Pointer to the schedule, NULL uses the gains unscaled.
+ */
+void Controller_SetSchedule(const Controller_Schedule_t *schedule);
+
+/**
+ * @brief Stage a new parameter set for the running controller.
+ *
+ * The parameters are copied into a staging buffer and taken over by the
+ * controller at the start of its next step (or by Controller_Reset()), so a
+ * step never mixes two sets and the controller never waits for the caller.
+ * Only one thread may stage parameters.
+ *
+ * @param params Pointer to the new parameters, NULL restores the compile-time defaults.
+ * @return 0 on success, -1 if the previous set was not taken over yet or
+ *         the limits don't enclose zero.
+ */
+int32_t Controller_SetParams(const Controller_Params_t *params);
+
+/**
+ * @brief Stage new gains and keep the current saturation limits.
+ *
+ * @param gains Pointer to the new gains, NULL restores the compile-time defaults.
+ * @return 0 on success, -1 if the previous set was not taken over yet.
+ */
+int32_t Controller_SetGains(const Controller_Gains_t *gains);
+
+/**
+ * @brief Read the latest parameter set.
+ *
+ * This function returns the staged set while it is pending, the set in use
+ * otherwise. It must be called from the thread staging the parameters.
+ *
+ * @param params Pointer to the structure receiving the parameters.
+ */
+void Controller_GetParams(Controller_Params_t *params);
+
+/**
+ * @brief Get the generation of the configuration in use.
+ * The generation changes with every parameter set taken over, every call to
+ * a Controller_Set function and every reset, so a step can be replayed from
+ * the configuration of the same generation only.
+ * @return The generation of the last step.
+ */
+uint32_t Controller_GetGeneration(void);
+
+/**
+ * @brief Read the complete configuration in use.
+ * It must be called from the thread running the controller.
+ * @param config Pointer to the structure receiving the configuration.
+ */
+void Controller_GetConfig(Controller_Config_t *config);
+
+/**
+ * @brief Apply a complete configuration read by Controller_GetConfig().
+ * The parameters are taken over right away and a staged set is discarded,
+ * the state of the controller is left as it is. Meant for replays, after
+ * Controller_Reset(). It must be called from the thread running the
+ * controller.
+ * @param config Pointer to the configuration, the schedule is copied.
+ * @return 0 on success, -1 if the limits don't enclose zero.
+ */
+int32_t Controller_SetConfig(const Controller_Config_t *config);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,123 @@
+#ifndef _FRA_H_
+#define _FRA_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define FRA_MAX_POINTS 32		//!< Maximum number of frequencies of one sweep.
+
+/**
+ * @brief State of the frequency-response analyzer.
+ */
+typedef enum {
+  FRA_IDLE = 0,            //!< No sweep started.
+  FRA_RUNNING,             //!< Sweep in control of the reference.
+  FRA_DONE,                //!< All frequencies measured, result available.
+  FRA_FAILED               //!< Aborted on the velocity limit.
+} Fra_State_t;
+
+/**
+ * @brief Parameters of the sweep.
+ */
+typedef struct {
+  int32_t setpoint;        //!< Velocity around which the reference oscillates in RPM.
+  int32_t amplitude;       //!< Amplitude of the sine on the reference in RPM.
+  const uint32_t *freq_mhz; //!< Frequencies in mHz, increasing, not copied.
+  uint32_t points;         //!< Number of frequencies, up to FRA_MAX_POINTS.
+  uint32_t settle_ms;      //!< Time at the setpoint before the first frequency in milliseconds.
+  uint32_t settle_cycles;  //!< Periods discarded after each frequency change.
+  uint32_t cycles;         //!< Periods integrated per frequency.
+  int32_t limit;           //!< Velocity error aborting the sweep in RPM.
+} Fra_Config_t;
+
+/**
+ * @brief Loop gain L = C P at one frequency.
+ */
+typedef struct {
+  uint32_t freq_mhz;       //!< Frequency in mHz.
+  int32_t gain;            //!< |L| in 1/1000.
+  int32_t phase;           //!< arg L in 0.1 degree, unwrapped along the sweep.
+  int32_t amplitude;       //!< Velocity amplitude in RPM.
+} Fra_Point_t;
+
+/**
+ * @brief Stability margins of a finished sweep, 0 where no crossing was measured.
+ */
+typedef struct {
+  uint32_t points;         //!< Frequencies measured, those above a quarter of the sampling rate are skipped.
+  uint32_t crossover_mhz;  //!< Gain crossover frequency (loop bandwidth) in mHz.
+  int32_t phase_margin;    //!< 180 degrees plus the phase at the gain crossover, in 0.1 degree.
+  uint32_t phase_crossover_mhz; //!< Frequency of the -180 degree phase in mHz.
+  int32_t gain_margin;     //!< 1 / |L| at the phase crossover in 1/1000.
+} Fra_Result_t;
+
+/**
+ * @brief Start a swept-sine measurement of the closed velocity loop.
+ *
+ * While the sweep runs, the reference is the setpoint plus a sine at one
+ * frequency after the other and the controller keeps running. For each
+ * frequency the error e = r - y and the velocity y are demodulated over an
+ * integer number of periods (lock-in, the single-bin DFT of the Goertzel
+ * algorithm), which gives the loop gain L = Y / E including the filter and
+ * the network delays seen by the controller.
+ *
+ * @param config Pointer to the sweep parameters, the frequency list isn't copied.
+ * @param millisec The start time in milliseconds.
+ * @return 0 on success, -1 if the parameters are invalid.
+ */
+int32_t Fra_Start(const Fra_Config_t *config, uint32_t millisec);
+
+/**
+ * @brief Run one step of the sweep.
+ *
+ * @param velocity The measured velocity in RPM, as seen by the controller.
+ * @param millisec The current time in milliseconds.
+ * @return The reference to give to the controller in RPM, the setpoint once
+ *         the sweep is over.
+ */
+int32_t Fra_Step(int32_t velocity, uint32_t millisec);
+
+/**
+ * @brief Get the state of the sweep.
+ *
+ * @return The current state.
+ */
+Fra_State_t Fra_GetState(void);
+
+/**
+ * @brief Get the number of frequencies measured so far.
+ *
+ * Points are published in order and never change afterwards, so another
+ * thread may stream them while the sweep runs.
+ *
+ * @return The number of points available to Fra_GetPoint().
+ */
+uint32_t Fra_GetPointCount(void);
+
+/**
+ * @brief Read one measured point.
+ *
+ * @param index The index of the point, below Fra_GetPointCount().
+ * @param point Pointer to the structure receiving the point.
+ * @return 0 on success, -1 if the point isn't measured yet.
+ */
+int32_t Fra_GetPoint(uint32_t index, Fra_Point_t *point);
+
+/**
+ * @brief Read the margins of a finished sweep.
+ *
+ * The crossings are interpolated linearly between the two points around
+ * them, so the frequency list should be dense near the expected bandwidth.
+ *
+ * @param result Pointer to the structure receiving the result.
+ * @return 0 on success, -1 if no result is available.
+ */
+int32_t Fra_GetResult(Fra_Result_t *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif   // _FRA_H_
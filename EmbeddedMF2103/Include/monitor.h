@@ -0,0 +1,103 @@
+#ifndef _MONITOR_H_
+#define _MONITOR_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * @brief Periodic tasks supervised by the deadline monitor.
+ */
+typedef enum {
+  MONITOR_TASK_CTRL = 0,   //!< Control loop (app_ctrl / bare-metal loop).
+  MONITOR_TASK_REF,        //!< Reference generator (app_ref).
+  MONITOR_TASK_COUNT
+} Monitor_Task_t;
+
+/**
+ * @brief Deadline statistics of one periodic task.
+ */
+typedef struct {
+  uint32_t period_ms;      //!< Configured period in milliseconds.
+  uint32_t releases;       //!< Number of cycles started.
+  uint32_t overruns;       //!< Cycles whose response time exceeded the period.
+  uint32_t skipped;        //!< Periods lost to late or coalesced releases.
+  uint32_t last_rt_us;     //!< Response time of the last completed cycle in microseconds.
+  uint32_t wcrt_us;        //!< Worst-case response time in microseconds.
+} Monitor_Stats_t;
+
+/**
+ * @brief Initialize the deadline monitor.
+ *
+ * This function enables the DWT cycle counter used to time each cycle
+ * and clears the statistics of all tasks.
+ * It doesn't take any arguments and doesn't return any value.
+ */
+void Monitor_Init(void);
+
+/**
+ * @brief Set the nominal period of a task and clear its statistics.
+ *
+ * @param task The supervised task.
+ * @param period_ms The nominal period of the task in milliseconds.
+ */
+void Monitor_Configure(Monitor_Task_t task, uint32_t period_ms);
+
+/**
+ * @brief Mark the start of a new cycle of a task.
+ *
+ * This function must be called as soon as the task wakes up. It compares the
+ * release time with the previous one and counts the periods that were lost
+ * because the task started late or because its timer flag was coalesced
+ * with the previous one.
+ *
+ * @param task The supervised task.
+ * @param millisec The release timestamp in milliseconds.
+ * @return The number of periods elapsed since the previous release,
+ *         1 in the nominal case and on the first release.
+ */
+uint32_t Monitor_Release(Monitor_Task_t task, uint32_t millisec);
+
+/**
+ * @brief Mark the end of the current cycle of a task.
+ *
+ * This function measures the response time since the last release, updates
+ * the worst case and counts an overrun if the period was exceeded.
+ *
+ * @param task The supervised task.
+ * @return 1 if the cycle overran its period, 0 otherwise.
+ */
+uint8_t Monitor_Complete(Monitor_Task_t task);
+
+/**
+ * @brief Get the time spent in the current cycle of a task.
+ *
+ * @param task The supervised task.
+ * @return The number of CPU cycles elapsed since the last release.
+ */
+uint32_t Monitor_GetCycles(Monitor_Task_t task);
+
+/**
+ * @brief Read the deadline statistics of a task.
+ *
+ * @param task The supervised task.
+ * @param stats Pointer to the structure receiving a snapshot of the statistics.
+ */
+void Monitor_GetStats(Monitor_Task_t task, Monitor_Stats_t *stats);
+
+/**
+ * @brief Print the statistics of the tasks that missed a deadline.
+ *
+ * This function writes one line per task to the trace channel (STDOUT over
+ * ITM), but only for tasks whose overrun or skip counters changed since the
+ * previous report. It should be called from a low-priority context.
+ * It doesn't take any arguments and doesn't return any value.
+ */
+void Monitor_Report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif   // _MONITOR_H_
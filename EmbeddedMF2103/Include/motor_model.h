@@ -0,0 +1,27 @@
+#ifndef _MOTOR_MODEL_H_
+#define _MOTOR_MODEL_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define MOTOR_CONTROL_SCALE (1L << 30)	//!< Control signal corresponding to 100% duty cycle.
+
+/**
+ * @brief Nominal first-order model of the motor: tau * dv/dt + v = gain * u - friction
+ *
+ * The control signal u is normalized to MOTOR_CONTROL_SCALE, so `gain` is the
+ * steady-state velocity reached at 100% duty cycle without friction.
+ */
+typedef struct {
+  int32_t gain;        //!< Steady-state velocity at full control in RPM.
+  uint32_t tau_ms;     //!< Mechanical time constant in milliseconds.
+  int32_t friction;    //!< Coulomb friction expressed as control units.
+} MotorModel_t;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif   // _MOTOR_MODEL_H_
@@ -7,11 +7,15 @@ extern "C" {
 #include <stdint.h>
 
 /**
- * @brief Data structure for transmitting velocity and timestamp from client to server
+ * @brief Data structure for transmitting velocity, timestamp, position and velocity filter from client to server
  */
 typedef struct {
     int32_t velocity;      //!< Motor velocity in RPM
     uint32_t timestamp;    //!< Timestamp in milliseconds
+    uint32_t position;     //!< Low 32 bits of the encoder position in counts, wraps
+    uint16_t filter_alpha; //!< Coefficient of the active velocity low-pass in 1/1000
+    uint16_t filter_mode;  //!< Active velocity filter, PARAM_FILTER_x
+    uint32_t echo;         //!< sent of the last reply plus the time from its arrival to this sample, 0 before the first
 } ClientData_t;
 
 /**
@@ -19,11 +23,174 @@ typedef struct {
  */
 typedef struct {
     int32_t control;       //!< Control signal for motor
+    uint32_t sent;         //!< Server time of the reply in milliseconds, echoed by the client
 } ServerData_t;
 
 // Server TCP port
 #define SERVER_PORT 5000
 
+// Telemetry UDP port, on the client and on the collecting host
+#define TELEMETRY_PORT 5001
+
+#define TELEMETRY_MAGIC     0x4D54u  //!< "TM" in little-endian byte order
+#define TELEMETRY_BATCH     32       //!< Maximum number of samples per frame
+#define TELEMETRY_FORMAT_RAW 0       //!< Frame carries TelemetrySample_t records
+#define TELEMETRY_FORMAT_DELTA 1     //!< Frame carries delta/varint coded samples (telemetry_codec.h)
+
+/**
+ * @brief Header of a telemetry frame, followed by `count` sample records
+ */
+typedef struct {
+    uint16_t magic;        //!< TELEMETRY_MAGIC
+    uint8_t format;        //!< TELEMETRY_FORMAT_x of the payload
+    uint8_t count;         //!< Number of samples in the frame
+    uint32_t sequence;     //!< Frame counter, gaps reveal lost frames
+    uint32_t dropped;      //!< Samples dropped on the client since start
+} TelemetryHeader_t;
+
+/**
+ * @brief One control-loop sample in a telemetry frame
+ */
+typedef struct {
+    uint32_t timestamp;    //!< Timestamp in milliseconds
+    int32_t velocity;      //!< Motor velocity in RPM
+    int32_t control;       //!< Control signal applied to the motor
+    int16_t encoder;       //!< Raw encoder delta since the previous sample
+    uint16_t latency_us;   //!< Loop latency from release to actuation in microseconds
+} TelemetrySample_t;
+
+// Session log UDP port, on the server and on the collecting host
+#define SESSION_LOG_PORT 5002
+
+#define SESSION_LOG_MAGIC 0x4C53u    //!< "SL" in little-endian byte order
+#define SESSION_LOG_BATCH 32         //!< Maximum number of records per frame
+
+/**
+ * @brief Header of a session log frame, followed by `count` records
+ *
+ * Frame 0 of a session carries no record: it is followed by the controller
+ * configuration the session starts with (Controller_Config_t, controller.h).
+ */
+typedef struct {
+    uint16_t magic;        //!< SESSION_LOG_MAGIC
+    uint16_t count;        //!< Number of records in the frame
+    uint32_t sequence;     //!< Frame counter, restarts at 0 on every new connection
+    uint32_t dropped;      //!< Records dropped on the server since start
+} SessionLogHeader_t;
+
+/**
+ * @brief One controller step of the server: input packet, reference and output
+ */
+typedef struct {
+    ClientData_t rx;       //!< Packet received from the client
+    int32_t reference;     //!< Reference used for this step
+    int32_t feedforward;   //!< Feedforward input of this step (Controller_SetFeedforwardInput)
+    ServerData_t tx;       //!< Packet sent back to the client
+    uint32_t config;       //!< Generation of the controller configuration of the step
+} SessionRecord_t;
+
+// Frequency-response UDP port, on the collecting host
+#define FRA_PORT 5004
+
+#define FRA_MAGIC 0x5246u            //!< "FR" in little-endian byte order
+
+#define FRA_REPORT_POINT  0          //!< Report: loop gain at one frequency
+#define FRA_REPORT_RESULT 1          //!< Report: stability margins of the finished sweep
+#define FRA_REPORT_FAILED 2          //!< Report: sweep aborted on the velocity limit
+
+/**
+ * @brief One report of the frequency-response analyzer of the server
+ *
+ * The values follow the fields of Fra_Point_t (freq_mhz, gain, phase,
+ * amplitude) in point reports and of Fra_Result_t without the point count
+ * (crossover_mhz, phase_margin, phase_crossover_mhz, gain_margin) in result
+ * reports, see fra.h for the units.
+ */
+typedef struct {
+    uint16_t magic;        //!< FRA_MAGIC
+    uint8_t type;          //!< FRA_REPORT_x
+    uint8_t index;         //!< Index of the point, number of points in results
+    int32_t value[4];      //!< Values of the report
+} FraReport_t;
+
+// Flight recorder UDP port, on the collecting host
+#define RECORDER_PORT 5005
+
+#define RECORDER_MAGIC 0x4352u       //!< "RC" in little-endian byte order
+
+/**
+ * @brief Header of a flight recorder frame of the client
+ *
+ * It is followed by `count` Recorder_Sample_t records (recorder.h, 24 bytes
+ * each), samples index to index + count - 1 of a frozen capture, oldest
+ * first. The trigger sample carries RECORDER_FLAG_TRIGGER.
+ */
+typedef struct {
+    uint16_t magic;        //!< RECORDER_MAGIC
+    uint16_t count;        //!< Number of samples in the frame
+    uint16_t capture;      //!< Capture counter, a new value starts a new capture
+    uint16_t total;        //!< Number of samples in the capture
+    uint32_t index;        //!< Index of the first sample of the frame in the capture
+} RecorderHeader_t;
+
+// Parameter UDP port, on the client and on the server
+#define PARAM_PORT 5003
+
+#define PARAM_MAGIC 0x5250u          //!< "PR" in little-endian byte order
+
+#define PARAM_MSG_READ   0           //!< Request: read the parameters of the board
+#define PARAM_MSG_WRITE  1           //!< Request: write the parameters selected by the mask
+#define PARAM_MSG_REPLY  2           //!< Reply: status and the parameters of the board
+
+#define PARAM_STATUS_OK          0   //!< Request accepted
+#define PARAM_STATUS_UNSUPPORTED 1   //!< A parameter is not owned by this board
+#define PARAM_STATUS_RANGE       2   //!< A value is out of range, nothing was written
+#define PARAM_STATUS_BUSY        3   //!< The previous write is not applied yet, retry
+#define PARAM_STATUS_INVALID     4   //!< Unknown message type
+
+#define PARAM_FILTER_FIRST_ORDER 0   //!< Filter mode: first-order low-pass with PARAM_FILTER_ALPHA
+#define PARAM_FILTER_LOWPASS     1   //!< Filter mode: biquad low-pass (VELOCITY_LOWPASS_COEFFS)
+#define PARAM_FILTER_NOTCH       2   //!< Filter mode: biquad low-pass and notch (VELOCITY_NOTCH_COEFFS)
+#define PARAM_FILTER_OBSERVER    3   //!< Filter mode: tracking observer (VELOCITY_OBSERVER_BW)
+
+#define PARAM_MODE_VELOCITY      0   //!< Control mode: velocity square wave of the server
+#define PARAM_MODE_POSITION      1   //!< Control mode: position loop towards PARAM_POSITION_TARGET
+#define PARAM_MODE_SYSID         2   //!< Control mode: identification experiment, back to velocity when done
+#define PARAM_MODE_FRA           3   //!< Control mode: swept-sine loop measurement, back to velocity when done
+
+/**
+ * @brief Identifiers of the runtime parameters, bit positions of the mask
+ *
+ * The server owns the controller parameters, the client owns the sampling.
+ */
+typedef enum {
+    PARAM_KP = 0,          //!< Proportional gain in control units per RPM (server)
+    PARAM_KI,              //!< Integral gain in control units per RPM and second (server)
+    PARAM_CONTROL_MAX,     //!< Upper saturation limit in control units (server)
+    PARAM_CONTROL_MIN,     //!< Lower saturation limit in control units (server)
+    PARAM_FILTER_ALPHA,    //!< Velocity filter coefficient in 1/1000 (client)
+    PARAM_PERIOD,          //!< Sampling period in milliseconds (client)
+    PARAM_FILTER_MODE,     //!< Velocity filter, PARAM_FILTER_x (client)
+    PARAM_CONTROL_MODE,    //!< Control mode, PARAM_MODE_x (server)
+    PARAM_POSITION_TARGET, //!< Position target in counts, writing it starts a move (server)
+    PARAM_MODEL_GAIN,      //!< Motor model gain in RPM at full control, read only (server)
+    PARAM_MODEL_TAU,       //!< Motor model time constant in milliseconds, read only (server)
+    PARAM_MODEL_FRICTION,  //!< Motor model friction in control units, read only (server)
+    PARAM_COUNT
+} ParamId_t;
+
+/**
+ * @brief Parameter request and reply, applied at the next control cycle
+ */
+typedef struct {
+    uint16_t magic;        //!< PARAM_MAGIC
+    uint8_t type;          //!< PARAM_MSG_x
+    uint8_t status;        //!< PARAM_STATUS_x in replies, 0 in requests
+    uint32_t sequence;     //!< Chosen by the requester, echoed in the reply
+    uint32_t mask;         //!< Bit (1 << ParamId_t) set for each valid value
+    int32_t value[PARAM_COUNT]; //!< Parameter values indexed by ParamId_t
+} ParamMessage_t;
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,48 @@
+#ifndef _OBSERVER_H_
+#define _OBSERVER_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * @brief Reset the velocity observer.
+ *
+ * The observer tracks the encoder position with a position, velocity and
+ * acceleration model (steady-state Kalman filter of a constant-acceleration
+ * motion, alpha-beta-gamma form). Its gains put the three poles at the given
+ * bandwidth, so the velocity follows a constant acceleration without lag.
+ *
+ * @param bandwidth The observer bandwidth in rad/s, 1 to 1000.
+ * @param velocity The initial velocity in RPM.
+ */
+void Observer_Init(uint32_t bandwidth, int32_t velocity);
+
+/**
+ * @brief Correct the estimates with a new encoder reading.
+ *
+ * @param counts The encoder counts since the previous update.
+ * @param dt_ms The time since the previous update in milliseconds.
+ */
+void Observer_Update(int32_t counts, uint32_t dt_ms);
+
+/**
+ * @brief Get the velocity estimate.
+ *
+ * @return The velocity in RPM, rounded.
+ */
+int32_t Observer_GetVelocity(void);
+
+/**
+ * @brief Get the acceleration estimate.
+ *
+ * @return The acceleration in RPM/s, rounded.
+ */
+int32_t Observer_GetAcceleration(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif   // _OBSERVER_H_
@@ -11,6 +11,37 @@ extern "C" {
 #include "stm32l4xx.h"
 #endif
 
+#include "actuator.h"
+#include "biquad.h"
+#include "observer.h"
+
+#define RESOLUTION 2048	//!< Encoder counts per revolution.
+#define VELOCITY_ALPHA 100	//!< Default coefficient of the velocity low-pass filter in 1/1000.
+#define VELOCITY_Q 16		//!< Fractional bits of the velocity filtered by a biquad cascade.
+#define VELOCITY_OBSERVER_BW 300	//!< Default bandwidth of the velocity observer in rad/s.
+#define PWM_DITHER_MAX 8		//!< Most fractional duty cycle bits added by the dithering.
+#define CALIBRATION_ADDRESS 0x080FF800u	//!< Flash page of the calibration data, the last one, left out of the program (IROM of the project).
+#define CALIBRATION_SIZE 2048u		//!< Size of the calibration page in bytes.
+
+/* Biquad cascades of the velocity estimate for 100 Hz sampling (client
+   PERIOD_SAMPLE), from Tools/biquad_design.py. The frequencies scale with
+   the sampling rate. */
+#define VELOCITY_LOWPASS_COEFFS {1, 1, { \
+  14344311, 28688622, 14344311, 1768944148, -752579569}}	//!< Butterworth low-pass at 4 Hz.
+#define VELOCITY_NOTCH_COEFFS {2, 1, { \
+  14344311, 28688622, 14344311, 1768944148, -752579569, \
+  858993459, 0, 858993459, 0, -644245094}}	//!< Low-pass at 4 Hz and notch at 25 Hz (Q 2).
+
+/* Duty cycles of the half-bridge linearization (actuator.h) at every 1/16
+   of the torque, in control units. The inverse of a plain 4% deadband as
+   a starting point, to be replaced by the output of Tools/pwm_linearize.py
+   for the board. */
+#define PWM_LINEARIZATION {42949673, 110058537, 177167401, 244276265, 311385129, 378493993, \
+  445602857, 512711721, 579820585, 646929449, 714038313, 781147177, \
+  848256041, 915364905, 982473769, 1049582633, 1073741824}
+
+extern int16_t encoder;		//!< Raw encoder delta of the last velocity calculation.
+
 /**
  * @brief Enable both half-bridges to drive the motor.
  *
@@ -33,11 +64,65 @@ void Peripheral_GPIO_DisableMotor(void);
  * This function drives the motor in both directions using a PWM signal.
  * The input specifies the duty cycle [-1,073,741,824 to +1,073,741,823],
  * which corresponds to a percentage of the maximum duty cycle (-100% to +100%).
+ * With a linearization set (Actuator_SetLinearization()), the input is a
+ * torque instead and is mapped through the inverse of the half-bridge
+ * deadband first. Once Peripheral_PWM_SetDither() has started the DMA,
+ * the function posts the duty cycle as a single word, which the DMA
+ * pattern takes from its next half on (within 0.8 ms at 19.5 kHz); without
+ * dithering it writes the whole pattern, taken at the next period.
  *
  * @param control The control signal for driving the motor.
  */
 void Peripheral_PWM_ActuateMotor(int32_t control);
 
+/**
+ * @brief Start the compare updates by DMA, with dithering of the duty cycle.
+ *
+ * At each update event of TIM3, a DMA burst through DMAR writes CCR1 and
+ * CCR2 from a circular pattern of 16 periods. The compare registers are
+ * preloaded, so both channels change together at the following period.
+ * With dithering, the half and complete transfer interrupts of the DMA
+ * regenerate the half of the pattern just read from the duty cycle posted
+ * last, so the DMA never reads a pattern being rewritten, at one short
+ * interrupt every 8 PWM periods. Without, the interrupts stay disabled and
+ * every duty cycle is written to the whole pattern at once.
+ *
+ * TIM3 counts to 2047, so the duty cycle has 11 bits. With dithering, the
+ * pattern spreads the given number of fractional bits over the periods
+ * (first-order sigma-delta): each period gets the integer duty cycle, plus
+ * one count when the accumulated fraction overflows, carried from one half
+ * to the next. The mean over 2^bits periods (3.3 ms for 6 bits at
+ * 19.5 kHz) is the exact duty cycle and the motor filters the rest.
+ *
+ * Called before the motor is driven, it stops the motor.
+ *
+ * @param bits Fractional bits, 0 to PWM_DITHER_MAX; 0 disables the dithering.
+ * @return 0 on success, -1 if bits is out of range.
+ */
+int32_t Peripheral_PWM_SetDither(uint32_t bits);
+
+/**
+ * @brief Read the calibration data kept in flash.
+ *
+ * @param data Pointer to the buffer receiving the data.
+ * @param size Number of bytes to read, up to CALIBRATION_SIZE.
+ */
+void Peripheral_Flash_Read(void *data, uint32_t size);
+
+/**
+ * @brief Replace the calibration data kept in flash.
+ *
+ * This function erases the page at CALIBRATION_ADDRESS and programs the data
+ * in double words. The page is in the second bank, so the program keeps
+ * running from the first one, but the function blocks during the erase
+ * (about 25 ms) and must not be called from the control loop.
+ *
+ * @param data Pointer to the data.
+ * @param size Number of bytes to write, up to CALIBRATION_SIZE.
+ * @return 0 on success, -1 if the size is too large or the flash reports an error.
+ */
+int32_t Peripheral_Flash_Write(const void *data, uint32_t size);
+
 /**
  * @brief Read the encoder value and calculate the current velocity in RPM.
  *
@@ -67,6 +152,63 @@ void Peripheral_PWM_ActuateMotor(int32_t control);
  */
 int32_t Peripheral_Encoder_CalculateVelocity(uint32_t millisec);
 
+/**
+ * @brief Set the coefficient of the velocity low-pass filter.
+ *
+ * The filter is Y[n] = alpha*X[n] + (1-alpha)*Y[n-1]. It must be called from
+ * the thread calculating the velocity.
+ *
+ * @param alpha The filter coefficient in 1/1000, from 1 to 1000 (no filtering).
+ */
+void Peripheral_Encoder_SetFilter(uint32_t alpha);
+
+/**
+ * @brief Filter the velocity with a biquad cascade instead of the low-pass.
+ *
+ * The raw velocity is kept in RPM Q16 (VELOCITY_Q) through the cascade and
+ * rounded to RPM at the output. The cascade starts from the current
+ * estimate, so switching filters causes no transient. It must be called
+ * from the thread calculating the velocity.
+ *
+ * @param coeffs Pointer to the coefficients, not copied. NULL selects the
+ *               first-order low-pass of Peripheral_Encoder_SetFilter().
+ * @return 0 on success, -1 if the coefficients are invalid (the filter is unchanged).
+ */
+int32_t Peripheral_Encoder_SetBiquad(const Biquad_Coeffs_t *coeffs);
+
+/**
+ * @brief Estimate the velocity with the tracking observer instead of a filter.
+ *
+ * The observer runs on the encoder position rather than on differenced
+ * counts, so it has no filter lag on a constant acceleration and also
+ * estimates the acceleration. It starts from the current estimate. It must
+ * be called from the thread calculating the velocity.
+ *
+ * @param bandwidth The observer bandwidth in rad/s (see VELOCITY_OBSERVER_BW),
+ *                  0 returns to the filter selected before.
+ */
+void Peripheral_Encoder_SetObserver(uint32_t bandwidth);
+
+/**
+ * @brief Get the position accumulated by the velocity calculations.
+ *
+ * Every encoder delta read by Peripheral_Encoder_CalculateVelocity() is
+ * added to a 64-bit count, so the position is as recent as the last
+ * velocity and doesn't wrap. The counter is reset by every read, so the
+ * velocity must be calculated before the 16-bit counter overflows
+ * (about 300 ms at 3000 RPM).
+ *
+ * @return The position in encoder counts since the first velocity calculation.
+ */
+int64_t Peripheral_Encoder_GetPosition(void);
+
+/**
+ * @brief Get the acceleration estimated with the last velocity.
+ *
+ * @return The acceleration in RPM/s while the observer is selected, 0 otherwise.
+ */
+int32_t Peripheral_Encoder_GetAcceleration(void);
+
 #ifdef __cplusplus
 }
 #endif
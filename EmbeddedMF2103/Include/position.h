@@ -0,0 +1,76 @@
+#ifndef _POSITION_H_
+#define _POSITION_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * @brief Parameters of the outer position loop.
+ */
+typedef struct {
+  int32_t kp;          //!< Velocity reference per position error in RPM per revolution.
+  int32_t ki;          //!< Integral gain in RPM per revolution and second, 0 for a P loop.
+  int32_t max_speed;   //!< Limit of the velocity reference in RPM.
+  uint32_t divider;    //!< Velocity loop steps per position loop step, 1 or more.
+} Position_Params_t;
+
+/**
+ * @brief Start the position loop holding the given position.
+ *
+ * The position loop is the outer loop of a cascade: its output is the
+ * reference of the velocity PI (Controller_PIController()), which stays the
+ * inner loop. A move staged before the call is kept and taken by the next
+ * update.
+ *
+ * @param position The current position in counts.
+ * @param p Pointer to the parameters, copied.
+ */
+void Position_Init(int64_t position, const Position_Params_t *p);
+
+/**
+ * @brief Stage a move to an absolute position.
+ *
+ * The target is taken over at the next update, so it can be called from
+ * another thread than the one running the loop.
+ *
+ * @param target The target position in counts.
+ * @return 0 on success, -1 if the previous move is not taken over yet.
+ */
+int32_t Position_Move(int64_t target);
+
+/**
+ * @brief Get the target position, the staged one if a move is pending.
+ *
+ * @return The target position in counts.
+ */
+int64_t Position_GetTarget(void);
+
+/**
+ * @brief Run the position loop with a new position measurement.
+ *
+ * It is called once per velocity loop step; only every divider-th call
+ * runs the P/PI step, the others return the previous velocity reference,
+ * so the cost of the inner loop barely changes.
+ *
+ * @param position The measured position in counts.
+ * @param millisec The time of the measurement in milliseconds.
+ * @return The velocity reference in RPM.
+ */
+int32_t Position_Update(int64_t position, uint32_t millisec);
+
+/**
+ * @brief Extend a wrapping 32-bit position to 64 bits.
+ *
+ * @param previous The previous extended position in counts.
+ * @param low The low 32 bits of the new position, less than 2^31 counts away.
+ * @return The extended position in counts.
+ */
+int64_t Position_Unwrap(int64_t previous, uint32_t low);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif   // _POSITION_H_
@@ -0,0 +1,73 @@
+#ifndef _PREDICTOR_H_
+#define _PREDICTOR_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "motor_model.h"
+
+#define PREDICTOR_MAX_DELAY 1000	//!< Largest loop delay compensated in milliseconds, longer estimates are capped.
+#define PREDICTOR_HISTORY 128		//!< Model outputs kept for the delayed branch (power of two), spanning PREDICTOR_MAX_DELAY.
+
+/**
+ * @brief Reset the Smith predictor.
+ *
+ * The predictor runs the motor model on the control signals sent to the
+ * client and corrects each measured velocity by the model response over the
+ * loop delay, so the controller sees an estimate of the current velocity.
+ *
+ * @param model Pointer to the motor model, NULL passes the measurements through.
+ * @param base_ms Loop delay in milliseconds until the first round trip is measured.
+ */
+void Predictor_Init(const MotorModel_t *model, uint32_t base_ms);
+
+/**
+ * @brief Replace the motor model without resetting the predictor.
+ *
+ * The model history and the delay estimate are kept, so an adapted model
+ * takes effect without a transient. It has no effect while the predictor
+ * is disabled.
+ *
+ * @param model Pointer to the new motor model, ignored if NULL or invalid.
+ */
+void Predictor_SetModel(const MotorModel_t *model);
+
+/**
+ * @brief Predict the current velocity from a delayed measurement.
+ *
+ * The loop delay is the round trip of the link: the client echoes the send
+ * time of the last control (ServerData_t.sent) advanced by the time from its
+ * arrival to this measurement, so the server time at reception minus the
+ * echo is the downlink of that control plus the uplink of this measurement,
+ * without the client's sampling period. It is smoothed over a few packets.
+ *
+ * @param velocity The measured velocity in RPM.
+ * @param echo_ms The echoed send time (ClientData_t.echo) in milliseconds,
+ *        0 if the client hasn't received a control yet.
+ * @param millisec The server time at reception in milliseconds.
+ * @return The predicted velocity in RPM.
+ */
+int32_t Predictor_Update(int32_t velocity, uint32_t echo_ms, uint32_t millisec);
+
+/**
+ * @brief Feed the control signal sent to the client into the model.
+ *
+ * @param control The control signal, scaled to MOTOR_CONTROL_SCALE.
+ * @param millisec The server time at which it was sent in milliseconds.
+ */
+void Predictor_Apply(int32_t control, uint32_t millisec);
+
+/**
+ * @brief Get the current loop delay estimate.
+ *
+ * @return The estimated round-trip delay in milliseconds, at most PREDICTOR_MAX_DELAY.
+ */
+uint32_t Predictor_GetDelay(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif   // _PREDICTOR_H_
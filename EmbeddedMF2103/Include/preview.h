@@ -0,0 +1,83 @@
+#ifndef _PREVIEW_H_
+#define _PREVIEW_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "motor_model.h"
+
+#define PREVIEW_STEP_SHIFT 3		//!< Look-ahead sample spacing: 2^3 = 8 milliseconds.
+#define PREVIEW_SAMPLES 128		//!< Capacity of the look-ahead buffer (power of two).
+#define PREVIEW_HORIZON 512		//!< Look-ahead window kept filled, in milliseconds.
+
+/**
+ * @brief Empty the look-ahead buffer and cancel any scheduled target.
+ *
+ * @param millisec The time of the first sample to be buffered.
+ */
+void Preview_Reset(uint32_t millisec);
+
+/**
+ * @brief Announce a future target change.
+ *
+ * The transition towards the target is started in the trajectory generator
+ * when the look-ahead window reaches the given time, so it shows up in the
+ * buffer up to PREVIEW_HORIZON milliseconds before it happens. Only one
+ * change can be pending; a new call replaces it.
+ *
+ * @param target The new target reference in RPM.
+ * @param millisec The time at which the transition starts.
+ */
+void Preview_Schedule(int32_t target, uint32_t millisec);
+
+/**
+ * @brief Drop past samples and extend the window up to the horizon.
+ *
+ * This function must be called from the thread using Preview_Lookup(),
+ * before the lookups of each control step.
+ *
+ * @param millisec The current time in milliseconds.
+ */
+void Preview_Fill(uint32_t millisec);
+
+/**
+ * @brief Get the reference at a given time from the look-ahead buffer.
+ *
+ * The reference is linearly interpolated between the buffered samples and
+ * clamped to the first and last ones outside of the window.
+ *
+ * @param millisec The time in milliseconds, now or in the future.
+ * @return The reference in RPM.
+ */
+int32_t Preview_Lookup(uint32_t millisec);
+
+/**
+ * @brief Set the motor model inverted by the preview feedforward.
+ * The terms follow Controller_SetFeedforward() (CONTROLLER_FF_x flags); use
+ * one or the other for a term, not both. It must be called from the thread
+ * using Preview_Feedforward().
+ * @param model Pointer to the motor model, NULL disables the feedforward.
+ * @param terms Combination of CONTROLLER_FF_x flags selecting the terms.
+ */
+void Preview_SetModel(const MotorModel_t *model, uint8_t terms);
+
+/**
+ * @brief Get the control that makes the nominal motor follow the window.
+ * The model is inverted on the buffered reference at the given time:
+ * u = (r + tau * dr/dt) / gain + friction * sign(r). The acceleration is
+ * the slope of the window on both sides of the time, so unlike the
+ * controller's own feedforward it has no sample of lag, and a time ahead by
+ * the loop delay starts the transition early enough for the motor to be on
+ * the reference. Feed it to Controller_SetFeedforwardInput().
+ * @param millisec The time in milliseconds, now plus the loop delay.
+ * @return The feedforward in control units, within the full control; 0 without a model.
+ */
+int32_t Preview_Feedforward(uint32_t millisec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif   // _PREVIEW_H_
@@ -0,0 +1,135 @@
+#ifndef _RECORDER_H_
+#define _RECORDER_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "network_protocol.h"
+
+#define RECORDER_SAMPLES 1024		//!< Capacity of the trace buffer in samples (power of two).
+
+#define RECORDER_FLAG_TRIGGER 0x0001	//!< Sample on which the trigger fired.
+
+/**
+ * @brief One control-loop sample as stored in the trace buffer.
+ */
+typedef struct {
+  uint32_t timestamp;      //!< Timestamp in milliseconds.
+  int32_t reference;       //!< Reference velocity in RPM.
+  int32_t velocity;        //!< Measured velocity in RPM.
+  int32_t control;         //!< Control signal applied to the motor.
+  uint32_t latency;        //!< Loop latency from release to actuation in CPU cycles.
+  int16_t encoder;         //!< Raw encoder delta since the previous sample.
+  uint16_t flags;          //!< RECORDER_FLAG_x markers.
+} Recorder_Sample_t;
+
+/**
+ * @brief Initialize the flight recorder and arm it.
+ *
+ * This function clears the trace buffer, disables the error trigger and
+ * starts recording with no post-trigger samples.
+ * It doesn't take any arguments and doesn't return any value.
+ */
+void Recorder_Init(void);
+
+/**
+ * @brief Restart recording after a freeze.
+ *
+ * The request is staged: the recording context takes it on its next sample,
+ * so this function can be called from another thread while recording.
+ *
+ * @param post_samples Number of samples to keep recording after the trigger
+ *                     fires before the buffer freezes.
+ */
+void Recorder_Arm(uint32_t post_samples);
+
+/**
+ * @brief Enable the tracking-error trigger.
+ *
+ * @param threshold The trigger fires when |reference - velocity| exceeds this
+ *                  value in RPM. Zero disables the error trigger.
+ */
+void Recorder_SetErrorTrigger(int32_t threshold);
+
+/**
+ * @brief Fire the trigger manually.
+ *
+ * It doesn't take any arguments and doesn't return any value.
+ */
+void Recorder_Trigger(void);
+
+/**
+ * @brief Store one sample in the trace buffer.
+ *
+ * This function is meant to be called once per control cycle. Each field is
+ * written with a single store; nothing is recorded once the buffer is frozen.
+ *
+ * @param timestamp Timestamp in milliseconds.
+ * @param reference Reference velocity in RPM.
+ * @param velocity Measured velocity in RPM.
+ * @param control Control signal applied to the motor.
+ * @param encoder Raw encoder delta since the previous sample.
+ * @param latency Loop latency in CPU cycles.
+ */
+void Recorder_Record(uint32_t timestamp, int32_t reference, int32_t velocity,
+                     int32_t control, int16_t encoder, uint32_t latency);
+
+/**
+ * @brief Check whether the recorder has frozen after a trigger.
+ *
+ * @return 1 if the buffer is frozen and ready to be dumped, 0 otherwise.
+ */
+uint8_t Recorder_IsFrozen(void);
+
+/**
+ * @brief Get the number of valid samples in the trace buffer.
+ *
+ * @return The number of samples, at most RECORDER_SAMPLES.
+ */
+uint32_t Recorder_Count(void);
+
+/**
+ * @brief Read a sample from the trace buffer, oldest first.
+ *
+ * @param index Index of the sample, 0 being the oldest one.
+ * @param sample Pointer to the structure receiving the sample.
+ * @return 1 if the sample exists, 0 otherwise.
+ */
+uint8_t Recorder_Read(uint32_t index, Recorder_Sample_t *sample);
+
+/**
+ * @brief Build the next frame of the frozen trace for the link.
+ *
+ * The frame is a RecorderHeader_t followed by as many samples as fit, oldest
+ * first; each call continues where the previous one stopped. Call it until
+ * it returns 0, then re-arm the recorder with Recorder_Arm().
+ *
+ * @param frame Buffer receiving the frame.
+ * @param size Size of the buffer in bytes.
+ * @return The length of the frame in bytes, 0 once the trace is sent or if
+ *         the recorder isn't frozen.
+ */
+uint16_t Recorder_BuildFrame(uint8_t *frame, uint16_t size);
+
+/**
+ * @brief Print the next lines of the frozen trace as CSV to the trace channel
+ * (STDOUT over ITM).
+ *
+ * The first call after a freeze prints the CSV header; each call continues
+ * where the previous one stopped, like Recorder_BuildFrame(), so the dump
+ * can be spread over the slack of several control periods. Re-arm the
+ * recorder with Recorder_Arm() once it returns 0.
+ *
+ * @param lines Maximum number of samples to print.
+ * @return The number of samples left to print, 0 once the trace is printed
+ *         or if the recorder isn't frozen.
+ */
+uint32_t Recorder_Dump(uint32_t lines);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif   // _RECORDER_H_
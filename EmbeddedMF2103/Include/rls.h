@@ -0,0 +1,58 @@
+#ifndef _RLS_H_
+#define _RLS_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define RLS_MAX_PARAMS 5	//!< Largest number of estimated parameters.
+#define RLS_Q 15			//!< Fractional bits of the regressors and the output (|x| < 1).
+#define RLS_THETA_Q 24		//!< Fractional bits of the parameter estimates.
+#define RLS_P_Q 24			//!< Fractional bits of the covariance matrix.
+#define RLS_LAMBDA_ONE (1L << 30)	//!< Forgetting factor of 1 (no forgetting).
+
+/**
+ * @brief State of a recursive least-squares estimator of y = theta' * phi.
+ */
+typedef struct {
+  uint8_t n;                                   //!< Number of parameters.
+  int32_t lambda;                              //!< Forgetting factor, Q30.
+  int64_t p0;                                  //!< Initial covariance diagonal, Q24.
+  int32_t theta[RLS_MAX_PARAMS];               //!< Parameter estimates, Q24.
+  int64_t P[RLS_MAX_PARAMS][RLS_MAX_PARAMS];   //!< Covariance matrix, Q24.
+} Rls_t;
+
+/**
+ * @brief Reset an estimator.
+ *
+ * The parameters start at zero with the covariance p0 * I. A forgetting
+ * factor below one discounts old samples with a memory of about
+ * 1 / (1 - lambda) samples; the forgetting stops while the covariance
+ * diagonal is back at p0, so it can't blow up without excitation.
+ *
+ * @param rls Pointer to the estimator.
+ * @param n Number of parameters, 1 to RLS_MAX_PARAMS.
+ * @param lambda Forgetting factor in Q30, from RLS_LAMBDA_ONE / 2 to RLS_LAMBDA_ONE.
+ * @param p0 Initial covariance in Q24, 1 to 1000 in real units.
+ * @return 0 on success, -1 if an argument is out of range.
+ */
+int32_t Rls_Init(Rls_t *rls, uint8_t n, int32_t lambda, int64_t p0);
+
+/**
+ * @brief Update the estimates with one sample.
+ *
+ * Costs about 2 n^2 64-bit multiplies and n + 1 divisions.
+ *
+ * @param rls Pointer to the estimator.
+ * @param phi The regressors in Q15, n values.
+ * @param y The output in Q15.
+ * @return The a priori prediction error y - theta' * phi in Q15.
+ */
+int32_t Rls_Update(Rls_t *rls, const int32_t *phi, int32_t y);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif   // _RLS_H_
@@ -0,0 +1,54 @@
+#ifndef _SESSIONLOG_H_
+#define _SESSIONLOG_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "controller.h"
+#include "network_protocol.h"
+
+#define SESSIONLOG_QUEUE 256		//!< Records buffered between two frames (power of two).
+
+/**
+ * @brief Start a new recorded session.
+ *
+ * This function must be called from the thread appending records. Once the
+ * records of the previous session are sent, frame 0 of the new session
+ * carries the configuration, which tells the host to open a new log file.
+ *
+ * @param config Pointer to the controller configuration the session starts with, copied.
+ */
+void SessionLog_Start(const Controller_Config_t *config);
+
+/**
+ * @brief Append one controller step to the session log.
+ *
+ * This function is called from the communication thread. It never blocks:
+ * when the queue is full the record is dropped and counted.
+ *
+ * @param rx Pointer to the packet received from the client.
+ * @param reference The reference used for this step.
+ * @param feedforward The feedforward input of this step.
+ * @param tx Pointer to the packet sent back to the client.
+ * @param config Generation of the controller configuration of the step.
+ */
+void SessionLog_Append(const ClientData_t *rx, int32_t reference, int32_t feedforward,
+                       const ServerData_t *tx, uint32_t config);
+
+/**
+ * @brief Build one session log frame from the queued records.
+ *
+ * @param frame Buffer receiving a SessionLogHeader_t followed by the records
+ *              or, in frame 0 of a session, by the configuration.
+ * @param size Size of the buffer in bytes.
+ * @return The length of the frame in bytes, 0 if nothing was queued.
+ */
+uint16_t SessionLog_BuildFrame(uint8_t *frame, uint16_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif   // _SESSIONLOG_H_
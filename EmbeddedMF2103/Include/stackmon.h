@@ -0,0 +1,46 @@
+#ifndef _STACKMON_H_
+#define _STACKMON_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define STACKMON_MAX_THREADS 4		//!< Maximum number of monitored thread stacks.
+
+/**
+ * @brief Register a thread stack and paint it with a known pattern.
+ *
+ * This function fills the stack memory with a fill pattern so that the peak
+ * usage can later be found by scanning for the first overwritten word.
+ * It must be called BEFORE the thread using this stack is created.
+ *
+ * @param name Name of the thread, used in the report.
+ * @param stack_mem Pointer to the statically allocated stack memory.
+ * @param stack_size Size of the stack in bytes.
+ * @return Index of the registered stack, or -1 if the table is full.
+ */
+int32_t StackMon_Register(const char *name, void *stack_mem, uint32_t stack_size);
+
+/**
+ * @brief Get the peak usage of a registered stack.
+ *
+ * @param index Index returned by StackMon_Register().
+ * @return The maximum number of bytes used so far, or 0 for an invalid index.
+ */
+uint32_t StackMon_GetPeak(int32_t index);
+
+/**
+ * @brief Print the peak usage of every registered stack.
+ *
+ * This function writes one line per stack to the trace channel (STDOUT over
+ * ITM), but only for stacks whose peak grew since the previous report.
+ * It doesn't take any arguments and doesn't return any value.
+ */
+void StackMon_Report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif   // _STACKMON_H_
@@ -0,0 +1,132 @@
+#ifndef _SYSID_H_
+#define _SYSID_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "motor_model.h"
+
+#define SYSID_VELOCITY_SCALE 4096	//!< Velocity at the full scale of the estimator in RPM.
+
+/**
+ * @brief Excitation signals of the identification experiment.
+ */
+typedef enum {
+  SYSID_PRBS = 0,          //!< Maximum-length binary sequence (9-bit LFSR).
+  SYSID_CHIRP              //!< Sine with a linear frequency sweep.
+} Sysid_Signal_t;
+
+/**
+ * @brief State of the identification experiment.
+ */
+typedef enum {
+  SYSID_IDLE = 0,          //!< No experiment started.
+  SYSID_RUNNING,           //!< Excitation in control of the motor.
+  SYSID_DONE,              //!< Result available.
+  SYSID_FAILED             //!< Aborted on the velocity limit, or no valid model.
+} Sysid_State_t;
+
+/**
+ * @brief Parameters of the identification experiment.
+ */
+typedef struct {
+  Sysid_Signal_t signal;   //!< Excitation signal.
+  uint8_t order;           //!< Order of the ARX model, 1 or 2.
+  int32_t bias;            //!< Control offset in control units.
+  int32_t amplitude;       //!< Excitation amplitude in control units, below the bias.
+  uint32_t bit_ms;         //!< PRBS: duration of one bit in milliseconds, about tau / 2.
+  uint32_t f_start_mhz;    //!< Chirp: start frequency in mHz.
+  uint32_t f_stop_mhz;     //!< Chirp: stop frequency in mHz.
+  uint32_t settle_ms;      //!< Time at the bias before the excitation in milliseconds.
+  uint32_t duration_ms;    //!< Duration of the excitation in milliseconds.
+  int32_t limit;           //!< Velocity aborting the experiment in RPM, below SYSID_VELOCITY_SCALE.
+} Sysid_Config_t;
+
+/**
+ * @brief Outcome of the identification experiment.
+ *
+ * The ARX model is y[k] + a1 y[k-1] + a2 y[k-2] = b1 u[k-1] + b2 u[k-2] + c
+ * with u the control / 2^15 and y the velocity * 2^15 / SYSID_VELOCITY_SCALE;
+ * u[k-1] is the control applied from step k-1 to step k, and a2 and b2 are 0
+ * for a first-order model.
+ */
+typedef struct {
+  uint8_t order;           //!< Order of the ARX model.
+  int32_t a[2];            //!< a1, a2 in Q24.
+  int32_t b[2];            //!< b1, b2 in Q24.
+  int32_t c;               //!< Constant term in Q24.
+  uint32_t period_ms;      //!< Sampling period of the fit in milliseconds.
+  uint32_t samples;        //!< Samples used by the fit.
+  int32_t residual;        //!< RMS one-step prediction error in RPM.
+  MotorModel_t model;      //!< First-order model: dominant pole, static gain and friction.
+} Sysid_Result_t;
+
+/**
+ * @brief Start an identification experiment.
+ *
+ * While the experiment runs, Sysid_Step() replaces the controller: it holds
+ * the bias for settle_ms, then adds the excitation and fits the ARX model
+ * with a recursive least-squares estimator at every regular sample. The
+ * bias keeps the motor turning one way, so the Coulomb friction is a
+ * constant that the fit returns in the c term. The velocity must be
+ * unfiltered (filter coefficient 1000), the fit would include the filter.
+ * A limit of zero or at or above SYSID_VELOCITY_SCALE is replaced by the
+ * largest one the Q15 regressors hold.
+ *
+ * @param config Pointer to the experiment parameters.
+ * @param millisec The start time in milliseconds.
+ * @return 0 on success, -1 if the parameters are invalid.
+ */
+int32_t Sysid_Start(const Sysid_Config_t *config, uint32_t millisec);
+
+/**
+ * @brief Run one step of the identification experiment.
+ *
+ * @param velocity The measured velocity in RPM.
+ * @param millisec The current time in milliseconds.
+ * @return The control signal to apply, 0 once the experiment is over.
+ */
+int32_t Sysid_Step(int32_t velocity, uint32_t millisec);
+
+/**
+ * @brief Get the state of the identification experiment.
+ *
+ * @return The current state.
+ */
+Sysid_State_t Sysid_GetState(void);
+
+/**
+ * @brief Read the result of a finished experiment.
+ *
+ * The model follows from the dominant real pole p of the fit,
+ * tau = -T / ln(p), the static gain B(1) / A(1) and the friction
+ * -c / B(1). It can be read from another thread once the state is
+ * SYSID_DONE.
+ *
+ * @param result Pointer to the structure receiving the result.
+ * @return 0 on success, -1 if no result is available.
+ */
+int32_t Sysid_GetResult(Sysid_Result_t *result);
+
+/**
+ * @brief Convert the estimates of an ARX fit into a motor model.
+ *
+ * The estimates are ordered as in the regressor of the experiment:
+ * a1, (a2), b1, (b2), c, in Q24 and with the scaling of Sysid_Result_t.
+ * The model follows as described for Sysid_GetResult().
+ *
+ * @param theta The 2 * order + 1 estimates.
+ * @param order Order of the ARX model, 1 or 2.
+ * @param period_ms Sampling period of the fit in milliseconds.
+ * @param model Pointer to the model receiving the result, unchanged on failure.
+ * @return 0 on success, -1 if the fit has no stable real pole or no positive gain.
+ */
+int32_t Sysid_ToModel(const int32_t *theta, uint8_t order, uint32_t period_ms, MotorModel_t *model);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif   // _SYSID_H_
@@ -0,0 +1,68 @@
+#ifndef _TELEMETRY_H_
+#define _TELEMETRY_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "network_protocol.h"
+
+#define TELEMETRY_QUEUE 128		//!< Samples buffered between two frames (power of two).
+
+/**
+ * @brief Initialize the telemetry sample queue.
+ *
+ * This function empties the queue and resets the frame and drop counters.
+ * It doesn't take any arguments and doesn't return any value.
+ */
+void Telemetry_Init(void);
+
+/**
+ * @brief Queue one control-loop sample for transmission.
+ *
+ * This function is called from the control thread. It never blocks: when the
+ * queue is full the sample is dropped and counted.
+ *
+ * @param timestamp Timestamp in milliseconds.
+ * @param velocity Measured velocity in RPM.
+ * @param control Control signal applied to the motor.
+ * @param encoder Raw encoder delta since the previous sample.
+ * @param latency Loop latency in CPU cycles.
+ */
+void Telemetry_Push(uint32_t timestamp, int32_t velocity, int32_t control,
+                    int16_t encoder, uint32_t latency);
+
+/**
+ * @brief Select the payload encoding of the next frames.
+ *
+ * @param fmt TELEMETRY_FORMAT_RAW or TELEMETRY_FORMAT_DELTA (default).
+ */
+void Telemetry_SetFormat(uint8_t fmt);
+
+/**
+ * @brief Get the number of queued samples.
+ *
+ * @return The number of samples waiting to be sent.
+ */
+uint32_t Telemetry_Pending(void);
+
+/**
+ * @brief Build one telemetry frame from the queued samples.
+ *
+ * This function moves up to TELEMETRY_BATCH samples from the queue into a
+ * frame made of a TelemetryHeader_t followed by the payload in the selected
+ * format. Samples that do not fit stay queued for the next frame.
+ *
+ * @param frame Buffer receiving the frame.
+ * @param size Size of the buffer in bytes.
+ * @return The length of the frame in bytes, 0 if nothing was queued or the
+ *         buffer can't hold a single sample.
+ */
+uint16_t Telemetry_BuildFrame(uint8_t *frame, uint16_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif   // _TELEMETRY_H_
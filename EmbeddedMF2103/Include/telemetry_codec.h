@@ -0,0 +1,47 @@
+#ifndef _TELEMETRY_CODEC_H_
+#define _TELEMETRY_CODEC_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "network_protocol.h"
+
+#define TELEMETRY_CODEC_MAX_SAMPLE 25	//!< Worst-case encoded size of one sample in bytes.
+
+/**
+ * @brief Delta/varint encode a block of telemetry samples.
+ *
+ * Every field is stored as a zig-zag varint: the timestamp, velocity and
+ * control as deltas to the previous sample, the encoder delta and the latency
+ * as they are. The first sample of the block is a keyframe holding absolute
+ * values, so every block can be decoded on its own.
+ *
+ * @param in Samples to encode.
+ * @param count Number of samples in `in`.
+ * @param out Buffer receiving the encoded bytes.
+ * @param size Size of the buffer in bytes.
+ * @param encoded Receives the number of samples that fitted in the buffer.
+ * @return The number of bytes written.
+ */
+uint32_t TelemetryCodec_Encode(const TelemetrySample_t *in, uint32_t count,
+                               uint8_t *out, uint32_t size, uint32_t *encoded);
+
+/**
+ * @brief Decode a block produced by TelemetryCodec_Encode().
+ *
+ * @param in Encoded bytes.
+ * @param len Number of encoded bytes.
+ * @param count Number of samples in the block.
+ * @param out Buffer receiving `count` samples.
+ * @return The number of bytes consumed, 0 if the block is truncated or corrupt.
+ */
+uint32_t TelemetryCodec_Decode(const uint8_t *in, uint32_t len, uint32_t count,
+                               TelemetrySample_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif   // _TELEMETRY_CODEC_H_
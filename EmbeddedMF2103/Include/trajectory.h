@@ -0,0 +1,69 @@
+#ifndef _TRAJECTORY_H_
+#define _TRAJECTORY_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * @brief Velocity profiles used to move the reference to a new target.
+ */
+typedef enum {
+  TRAJECTORY_STEP = 0,     //!< Jump to the target immediately (square wave).
+  TRAJECTORY_TRAPEZOID,    //!< Constant acceleration ramp.
+  TRAJECTORY_SCURVE        //!< Jerk-limited ramp.
+} Trajectory_Profile_t;
+
+/**
+ * @brief Initialize the trajectory generator.
+ *
+ * This function selects the step profile and holds the reference at the
+ * initial value until the first call to Trajectory_Start().
+ *
+ * @param initial The initial reference in RPM.
+ */
+void Trajectory_Init(int32_t initial);
+
+/**
+ * @brief Select the profile used by the next transitions.
+ *
+ * This function can be called at runtime; the transition in progress is not
+ * affected. A zero acceleration selects the step profile, a zero jerk turns
+ * the S-curve into a trapezoid.
+ *
+ * @param profile The velocity profile.
+ * @param accel Maximum acceleration of the reference in RPM/s.
+ * @param jerk Maximum jerk of the reference in RPM/s^2 (S-curve only).
+ */
+void Trajectory_Configure(Trajectory_Profile_t profile, uint32_t accel, uint32_t jerk);
+
+/**
+ * @brief Start a transition towards a new target.
+ *
+ * This function precomputes the polynomial coefficients of every segment of
+ * the profile, starting from the current reference, so that evaluating the
+ * trajectory needs no division. It may run concurrently with
+ * Trajectory_Evaluate(): the new plan is published with a single store.
+ *
+ * @param target The new target reference in RPM.
+ * @param millisec The start time of the transition in milliseconds.
+ */
+void Trajectory_Start(int32_t target, uint32_t millisec);
+
+/**
+ * @brief Evaluate the reference at a given time.
+ *
+ * Before the start time of the transition the reference it started from is
+ * returned, so a transition may be started ahead of time.
+ *
+ * @param millisec The time in milliseconds.
+ * @return The reference in RPM.
+ */
+int32_t Trajectory_Evaluate(uint32_t millisec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif   // _TRAJECTORY_H_
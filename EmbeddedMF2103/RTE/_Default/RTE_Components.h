@@ -15,6 +15,8 @@
  */
 #define CMSIS_device_header "stm32l4xx.h"
 
+/* ARM::CMSIS:DSP&Source@1.16.2 */
+#define RTE_CMSIS_DSP                   /* CMSIS-DSP */
 /* Keil::Compiler&ARM Compiler:I/O:STDOUT&ITM@1.2.0 */
 #define RTE_Compiler_IO_STDOUT          /* Compiler I/O: STDOUT */
 #define RTE_Compiler_IO_STDOUT_ITM      /* Compiler I/O: STDOUT ITM */
@@ -0,0 +1,72 @@
+/***
+ * Group: 8
+ *
+ * Members: Alice Ahlberg
+ *          Daniel Fjelkner
+ *          David Georgian Iosifescu
+ *
+ * Course code: MF2103
+ *
+ * Task description: Actuator Linearization
+ *                   Piecewise-linear inverse of the half-bridge deadband
+ *                   and nonlinearity, between the control and the PWM.
+ *
+ * Compiler: ARM GCC
+ *
+ * Other information: The breakpoints are 2^26 control units apart, so the
+ * segment and the position in it are the upper and lower bits of the
+ * magnitude. Peripheral_PWM_ActuateMotor() maps every control through it
+ * before the duty cycle conversion; the deadband mode of Tools/plant_sim.c
+ * runs it against a simulated half-bridge.
+ *
+ * References: Course material MF2103
+ *
+ ***/
+
+#include "actuator.h"
+
+#define SEGMENT_SHIFT 26 // log2(ACTUATOR_FULL / (ACTUATOR_POINTS - 1))
+#define SEGMENT_MASK ((1L << SEGMENT_SHIFT) - 1)
+
+#if (ACTUATOR_FULL >> SEGMENT_SHIFT) != ACTUATOR_POINTS - 1
+#error "ACTUATOR_POINTS must match SEGMENT_SHIFT"
+#endif
+
+static int32_t duty[ACTUATOR_POINTS];
+static uint8_t enabled = 0;
+
+int32_t Actuator_SetLinearization(const int32_t *table) {
+  if (!table) {
+    enabled = 0;
+    return 0;
+  }
+
+  if (table[0] < 0 || table[ACTUATOR_POINTS - 1] > ACTUATOR_FULL)
+    return -1;
+  for (uint32_t i = 1; i < ACTUATOR_POINTS; i++) {
+    if (table[i] < table[i - 1])
+      return -1;
+  }
+
+  for (uint32_t i = 0; i < ACTUATOR_POINTS; i++)
+    duty[i] = table[i];
+  enabled = 1;
+  return 0;
+}
+
+int32_t Actuator_Linearize(int32_t control) {
+  if (!enabled || control == 0)
+    return control;
+
+  uint32_t mag = control > 0 ? (uint32_t)control : (uint32_t)(-(int64_t)control);
+  uint32_t i = mag >> SEGMENT_SHIFT;
+  int32_t out;
+
+  if (i >= ACTUATOR_POINTS - 1) {
+    out = duty[ACTUATOR_POINTS - 1];
+  } else {
+    int64_t frac = (int64_t)(mag & SEGMENT_MASK);
+    out = duty[i] + (int32_t)(((int64_t)(duty[i + 1] - duty[i]) * frac) >> SEGMENT_SHIFT);
+  }
+  return control > 0 ? out : -out;
+}
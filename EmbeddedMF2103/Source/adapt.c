@@ -0,0 +1,240 @@
+/***
+ * Group: 8
+ *
+ * Members: Alice Ahlberg
+ *          Daniel Fjelkner
+ *          David Georgian Iosifescu
+ *
+ * Course code: MF2103
+ *
+ * Task description: Model Adaptation
+ *                   Online least-squares fit of the motor model on the
+ *                   closed-loop samples, with forgetting.
+ *
+ * Compiler: ARM GCC
+ *
+ * Other information: Single-producer (control loop) and single-consumer
+ * (estimator) queue, no lock needed; the model goes back through a staging
+ * buffer taken by the control loop. The fit runs on Source/rls.c and the
+ * conversion to a motor model on Sysid_ToModel(), with the same regressors
+ * as the identification experiment.
+ *
+ * References: Course material MF2103, K. J. Astrom, B. Wittenmark,
+ * Adaptive Control, 2nd ed., ch. 2 and 3 (indirect adaptive control)
+ *
+ ***/
+
+#include "adapt.h"
+#include "rls.h"
+#include "sysid.h"
+
+#if defined(__arm__)
+#include "cmsis_compiler.h"
+#define BARRIER() __DMB()
+#else
+#define BARRIER() __sync_synchronize()
+#endif
+
+#define QUEUE_MASK (ADAPT_QUEUE - 1U)
+#define P0 ((int64_t)100 << RLS_P_Q)  // Initial covariance, little trust in the zero start
+#define PERIOD_CHANGE 8               // Samples at a new period before the fit restarts
+
+#if (ADAPT_QUEUE & QUEUE_MASK) != 0
+#error "ADAPT_QUEUE must be a power of two"
+#endif
+
+typedef struct {
+  int32_t velocity;
+  int32_t control;
+  uint32_t t;
+  uint16_t alpha;  // Coefficient of the velocity low-pass
+  uint8_t gap;     // Samples were dropped before this one
+} Adapt_Sample_t;
+
+static Adapt_Config_t cfg;
+static Rls_t rls;
+
+// Queue from the control loop
+static Adapt_Sample_t queue[ADAPT_QUEUE];
+static volatile uint32_t q_head = 0; // Written by the producer only
+static volatile uint32_t q_tail = 0; // Written by the consumer only
+static volatile uint32_t dropped = 0;
+static uint8_t gap = 0;
+
+// Model staged for the control loop
+static MotorModel_t staged;
+static volatile uint8_t staged_ready = 0;
+
+// Estimator state
+static uint32_t t_prev = 0;
+static uint32_t period = 0;
+static uint32_t mismatch = 0;    // Consecutive samples at another period
+static uint8_t history = 0;      // Regular samples since the last restart
+static int32_t u_prev = 0;       // Control applied since the previous sample
+static int32_t y1, y2;           // Past outputs, Q15
+static int32_t uf, uf1;          // Filtered control, now and one sample ago, Q15
+static int32_t sf;               // Filtered direction of motion, Q15
+static uint32_t skip = 0;        // Samples until the next estimator update
+static uint32_t updates = 0;
+static uint32_t next_model = 0;  // Update count of the next published model
+
+static int32_t Adapt_Filter(int32_t x, int32_t y) {
+  return (int32_t)(((int64_t)cfg.filter_alpha * x + (int64_t)(1000 - cfg.filter_alpha) * y) / 1000);
+}
+
+static void Adapt_Restart(void) {
+  Rls_Init(&rls, (uint8_t)(2 * cfg.order + 1), cfg.lambda, P0);
+  history = 0;
+  skip = 0;
+  updates = 0;
+  next_model = cfg.warmup;
+}
+
+/* Stage the current fit for the control loop if it is a plausible motor */
+static void Adapt_Publish(void) {
+  MotorModel_t m;
+
+  if (staged_ready || Sysid_ToModel(rls.theta, cfg.order, period, &m) != 0)
+    return;
+
+  if (m.gain < cfg.nominal.gain / 2 || m.gain > 2 * cfg.nominal.gain ||
+      m.tau_ms < cfg.nominal.tau_ms / 2 || m.tau_ms > 2 * cfg.nominal.tau_ms ||
+      m.friction < 0 || m.friction > MOTOR_CONTROL_SCALE / 4)
+    return;
+
+  staged = m;
+  BARRIER();
+  staged_ready = 1;
+}
+
+static void Adapt_Sample(const Adapt_Sample_t *s) {
+  uint32_t dt = s->t - t_prev;
+  uint8_t refilter = s->alpha != cfg.filter_alpha;
+  t_prev = s->t;
+  cfg.filter_alpha = s->alpha;
+
+  // The new output, and the control and direction that produced it, Q15
+  int32_t y = s->velocity * 32768 / SYSID_VELOCITY_SCALE;
+  int32_t u = u_prev >> 15;
+  // Direction over the last period, from the velocity before the low-pass
+  int64_t raw = (int64_t)1000 * y - (int64_t)(1000 - cfg.filter_alpha) * y1;
+  int32_t dir = raw > 0 ? (1 << RLS_Q) : (raw < 0 ? -(1 << RLS_Q) : 0);
+  u_prev = s->control;
+
+  if (s->gap || dt == 0 || refilter) {
+    history = 0;
+  } else if (dt != period) {
+    // Irregular sample, or a new sampling period once it lasts
+    history = 0;
+    if (++mismatch >= PERIOD_CHANGE || period == 0) {
+      period = dt;
+      mismatch = 0;
+      Adapt_Restart();
+    }
+  } else {
+    mismatch = 0;
+  }
+
+  // The same low-pass as the velocity on the inputs, restarted with the history
+  uf1 = history ? uf : u;
+  uf = history ? Adapt_Filter(u, uf) : u;
+  sf = history ? Adapt_Filter(dir, sf) : dir;
+
+  if (history < 2) {
+    history++;
+  } else if (++skip >= cfg.decimation) {
+    int32_t phi[RLS_MAX_PARAMS];
+    uint32_t n = 0;
+
+    skip = 0;
+    phi[n++] = -y1;
+    if (cfg.order == 2)
+      phi[n++] = -y2;
+    phi[n++] = uf;
+    if (cfg.order == 2)
+      phi[n++] = uf1;
+    phi[n++] = sf;
+    Rls_Update(&rls, phi, y);
+
+    if (++updates >= next_model) {
+      next_model = updates + cfg.publish;
+      Adapt_Publish();
+    }
+  }
+  y2 = y1;
+  y1 = y;
+}
+
+int32_t Adapt_Init(const Adapt_Config_t *config) {
+  if (!config || (config->order != 1 && config->order != 2) || config->decimation == 0 ||
+      config->filter_alpha == 0 || config->filter_alpha > 1000 || config->publish == 0 ||
+      config->nominal.gain <= 0 || config->nominal.tau_ms == 0)
+    return -1;
+
+  cfg = *config;
+  if (Rls_Init(&rls, (uint8_t)(2 * cfg.order + 1), cfg.lambda, P0) != 0)
+    return -1;
+
+  q_tail = q_head;
+  gap = 1;
+  staged_ready = 0;
+  period = 0;
+  mismatch = 0;
+  u_prev = 0;
+  y1 = y2 = 0;
+  Adapt_Restart();
+  return 0;
+}
+
+void Adapt_Push(int32_t velocity, int32_t control, uint32_t millisec, uint32_t filter_alpha) {
+  uint32_t head = q_head;
+
+  // Paused until the velocity is low-passed again
+  if (filter_alpha == 0 || filter_alpha > 1000) {
+    gap = 1;
+    return;
+  }
+  if (head - q_tail >= ADAPT_QUEUE) {
+    dropped++;
+    gap = 1;
+    return;
+  }
+
+  Adapt_Sample_t *s = &queue[head & QUEUE_MASK];
+  s->velocity = velocity;
+  s->control = control;
+  s->t = millisec;
+  s->alpha = (uint16_t)filter_alpha;
+  s->gap = gap;
+  gap = 0;
+
+  // Publish the sample only once it is complete
+  BARRIER();
+  q_head = head + 1U;
+}
+
+uint32_t Adapt_Run(uint32_t budget) {
+  uint32_t n = 0;
+
+  while (n < budget && q_tail != q_head) {
+    BARRIER();
+    Adapt_Sample(&queue[q_tail & QUEUE_MASK]);
+    q_tail = q_tail + 1U;
+    n++;
+  }
+  return n;
+}
+
+int32_t Adapt_TakeModel(MotorModel_t *model) {
+  if (!model || !staged_ready)
+    return -1;
+
+  BARRIER();
+  *model = staged;
+  staged_ready = 0;
+  return 0;
+}
+
+uint32_t Adapt_GetDropped(void) {
+  return dropped;
+}
@@ -1,8 +1,13 @@
 #include "main.h"
 #include "application.h"
+#include "monitor.h"
 #include "network_protocol.h"
 #include "peripherals.h" 
+#include "recorder.h"
+#include "stackmon.h"
+#include "telemetry.h"
 #include "cmsis_os2.h"
+#include "rtx_os.h"
 
 #ifdef _ETHERNET_ENABLED
 #include "socket.h"
@@ -14,34 +19,121 @@
 #define FLAG_CONN_UP   0x02
 #define FLAG_DATA_RX   0x04
 
-osThreadId_t tid_app_main, tid_app_ctrl, tid_app_comm;
+#define PERIOD_SAMPLE  10   // Client sampling period in milliseconds
+#define PERIOD_TELEMETRY 100 // Telemetry frame period in milliseconds
+#define PERIOD_PARAM   100  // Parameter poll period in milliseconds
+#define PERIOD_MIN     2    // Bounds of a runtime sampling period in milliseconds
+#define PERIOD_MAX     1000
+
+#define PARAM_SOCKET   2
+#define PARAM_CLIENT_MASK ((1u << PARAM_FILTER_ALPHA) | (1u << PARAM_PERIOD) | (1u << PARAM_FILTER_MODE))
+
+osThreadId_t tid_app_main, tid_app_ctrl, tid_app_comm, tid_app_tlm;
 osTimerId_t timer_ctrl;
+osMutexId_t mutex_spi;
+
+/* Static RTOS objects: no heap is used at startup. Stack sizes in bytes,
+   from the deepest call path of each thread as for the server threads
+   (app-server.c). */
+#define STACK_SIZE_MAIN 960   // 608: Monitor_Report > printf
+#define STACK_SIZE_CTRL 640   // 336: Peripheral_Encoder_CalculateVelocity > Observer_Update
+#define STACK_SIZE_COMM 576   // 320: recv
+#define STACK_SIZE_TLM  640   // 352: sendto
+
+static osRtxThread_t tcb_main __attribute__((section(".bss.os.thread.cb")));
+static osRtxThread_t tcb_ctrl __attribute__((section(".bss.os.thread.cb")));
+static osRtxThread_t tcb_comm __attribute__((section(".bss.os.thread.cb")));
+static osRtxThread_t tcb_tlm __attribute__((section(".bss.os.thread.cb")));
+static osRtxTimer_t tcb_timer_ctrl __attribute__((section(".bss.os.timer.cb")));
+static osRtxMutex_t tcb_mutex_spi __attribute__((section(".bss.os.mutex.cb")));
+
+static uint64_t stack_main[STACK_SIZE_MAIN / 8] __attribute__((section(".bss.os.thread.stack")));
+static uint64_t stack_ctrl[STACK_SIZE_CTRL / 8] __attribute__((section(".bss.os.thread.stack")));
+static uint64_t stack_comm[STACK_SIZE_COMM / 8] __attribute__((section(".bss.os.thread.stack")));
+static uint64_t stack_tlm[STACK_SIZE_TLM / 8] __attribute__((section(".bss.os.thread.stack")));
+
+static uint8_t tlm_frame[sizeof(TelemetryHeader_t) + TELEMETRY_BATCH * sizeof(TelemetrySample_t)];
 
 static volatile uint8_t connected = 0;
 static int32_t global_velocity = 0;
 static int32_t global_control = 0;
 static uint32_t global_timestamp = 0;
+static uint32_t global_position = 0;
+
+/* Runtime parameters: staged by app_main, taken by app_ctrl between cycles */
+static uint32_t filter_alpha = VELOCITY_ALPHA;
+static uint32_t filter_mode = PARAM_FILTER_FIRST_ORDER;
+static uint32_t period = PERIOD_SAMPLE;
+static volatile uint32_t staged_alpha, staged_period, staged_mode;
+
+/* Velocity filters selected by PARAM_FILTER_MODE, designed for PERIOD_SAMPLE */
+static const Biquad_Coeffs_t velocity_filters[] = {VELOCITY_LOWPASS_COEFFS, VELOCITY_NOTCH_COEFFS};
+static volatile uint8_t staged_ready = 0;
 
 /* Prototypes */
 void app_main(void *argument);
 void app_ctrl(void *argument);
 void app_comm(void *argument);
+void app_tlm(void *argument);
 static void Timer_Callback(void *argument);
+static void Wizchip_Enter(void);
+static void Wizchip_Exit(void);
+static void Param_Serve(uint8_t sn);
 
 void Application_Setup() {
     osKernelInitialize();
-    const osThreadAttr_t main_attr = {.priority = osPriorityNormal, .name = "Manager"};
+    const osThreadAttr_t main_attr = {.priority = osPriorityNormal, .name = "Manager",
+                                      .cb_mem = &tcb_main, .cb_size = sizeof(tcb_main),
+                                      .stack_mem = stack_main, .stack_size = sizeof(stack_main)};
+    StackMon_Register(main_attr.name, stack_main, sizeof(stack_main));
     tid_app_main = osThreadNew(app_main, NULL, &main_attr);
     osKernelStart();
 }
 
 void app_main(void *argument) {
-    tid_app_ctrl = osThreadNew(app_ctrl, NULL, NULL);
-    tid_app_comm = osThreadNew(app_comm, NULL, NULL);
-    timer_ctrl = osTimerNew(Timer_Callback, osTimerPeriodic, NULL, NULL);
+    const osThreadAttr_t ctrl_attr = {.priority = osPriorityNormal, .name = "Control",
+                                      .cb_mem = &tcb_ctrl, .cb_size = sizeof(tcb_ctrl),
+                                      .stack_mem = stack_ctrl, .stack_size = sizeof(stack_ctrl)};
+    const osThreadAttr_t comm_attr = {.priority = osPriorityNormal, .name = "Comm",
+                                      .cb_mem = &tcb_comm, .cb_size = sizeof(tcb_comm),
+                                      .stack_mem = stack_comm, .stack_size = sizeof(stack_comm)};
+    const osThreadAttr_t tlm_attr = {.priority = osPriorityBelowNormal, .name = "Telemetry",
+                                     .cb_mem = &tcb_tlm, .cb_size = sizeof(tcb_tlm),
+                                     .stack_mem = stack_tlm, .stack_size = sizeof(stack_tlm)};
+    const osTimerAttr_t timer_attr = {.name = "Sample",
+                                      .cb_mem = &tcb_timer_ctrl, .cb_size = sizeof(tcb_timer_ctrl)};
+    const osMutexAttr_t mutex_attr = {.name = "SPI", .attr_bits = osMutexPrioInherit,
+                                      .cb_mem = &tcb_mutex_spi, .cb_size = sizeof(tcb_mutex_spi)};
+
+    // Two threads now share the W5500: serialize every SPI access
+    mutex_spi = osMutexNew(&mutex_attr);
+    reg_wizchip_cris_cbfunc(Wizchip_Enter, Wizchip_Exit);
+
+    StackMon_Register(ctrl_attr.name, stack_ctrl, sizeof(stack_ctrl));
+    StackMon_Register(comm_attr.name, stack_comm, sizeof(stack_comm));
+    StackMon_Register(tlm_attr.name, stack_tlm, sizeof(stack_tlm));
+
+    tid_app_ctrl = osThreadNew(app_ctrl, NULL, &ctrl_attr);
+    tid_app_comm = osThreadNew(app_comm, NULL, &comm_attr);
+    tid_app_tlm = osThreadNew(app_tlm, NULL, &tlm_attr);
+    timer_ctrl = osTimerNew(Timer_Callback, osTimerPeriodic, NULL, &timer_attr);
+
+#if PWM_LINEARIZE
+    static const int32_t pwm_table[ACTUATOR_POINTS] = PWM_LINEARIZATION;
+    Actuator_SetLinearization(pwm_table);
+#endif
+    Peripheral_PWM_SetDither(PWM_DITHER);
+
+    Monitor_Init();
+    Monitor_Configure(MONITOR_TASK_CTRL, PERIOD_SAMPLE);
+    // The reference is only known by the server: freeze on the deadlines
+    Recorder_Init();
+    Recorder_Arm(RECORDER_POST);
+    Telemetry_Init();
+    socket(PARAM_SOCKET, Sn_MR_UDP, PARAM_PORT, 0);
 
     // START TIMER IMMEDIATELY for testing
-    osTimerStart(timer_ctrl, 10); 
+    osTimerStart(timer_ctrl, PERIOD_SAMPLE); 
 
     uint8_t server_ip[4] = {192, 168, 0, 10};
     uint8_t sn = 0;
@@ -64,16 +156,49 @@ void app_main(void *argument) {
                 }
             }
         }
-        osDelay(1000); 
+        Monitor_Report();
+        StackMon_Report();
+
+        for (uint32_t i = 0; i < 1000 / PERIOD_PARAM; i++) {
+            Param_Serve(PARAM_SOCKET);
+            osDelay(PERIOD_PARAM);
+        }
     }
 }
 
 void app_ctrl(void *argument) {
     for (;;) {
         osThreadFlagsWait(FLAG_TICK, osFlagsWaitAny, osWaitForever);
+
+        // Apply staged parameters on the cycle boundary
+        if (staged_ready) {
+            filter_alpha = staged_alpha;
+            Peripheral_Encoder_SetFilter(filter_alpha);
+            if (staged_mode != filter_mode) {
+                filter_mode = staged_mode;
+                if (filter_mode == PARAM_FILTER_OBSERVER) {
+                    Peripheral_Encoder_SetObserver(VELOCITY_OBSERVER_BW);
+                } else {
+                    Peripheral_Encoder_SetObserver(0);
+                    Peripheral_Encoder_SetBiquad(filter_mode == PARAM_FILTER_FIRST_ORDER ? NULL
+                                                 : &velocity_filters[filter_mode - PARAM_FILTER_LOWPASS]);
+                }
+            }
+            if (staged_period != period) {
+                period = staged_period;
+                osTimerStart(timer_ctrl, period);
+                Monitor_Configure(MONITOR_TASK_CTRL, period);
+            }
+            staged_ready = 0;
+        }
         
         global_timestamp = Main_GetTickMillisec();
+        if (Monitor_Release(MONITOR_TASK_CTRL, global_timestamp) > 1) {
+            Recorder_Trigger(); // Keep the samples around the skipped cycles
+        }
         global_velocity = Peripheral_Encoder_CalculateVelocity(global_timestamp);
+        global_position = (uint32_t)Peripheral_Encoder_GetPosition();
+        int32_t applied = 0;
         
         if (connected) {
             osThreadFlagsSet(tid_app_comm, FLAG_TICK); 
@@ -81,13 +206,25 @@ void app_ctrl(void *argument) {
             uint32_t flags = osThreadFlagsWait(FLAG_DATA_RX, osFlagsWaitAny, 50);
             
             if (flags & FLAG_DATA_RX) {
-                Peripheral_PWM_ActuateMotor(global_control);
+                applied = global_control;
+                Peripheral_PWM_ActuateMotor(applied);
             } else {
                 Peripheral_PWM_ActuateMotor(0); // Safety timeout
+                Recorder_Trigger();
             }
         } else {
             Peripheral_PWM_ActuateMotor(0);
         }
+
+        // The reference is only known by the server
+        Recorder_Record(global_timestamp, 0, global_velocity, applied, encoder,
+                        Monitor_GetCycles(MONITOR_TASK_CTRL));
+        Telemetry_Push(global_timestamp, global_velocity, applied, encoder,
+                       Monitor_GetCycles(MONITOR_TASK_CTRL));
+
+        if (Monitor_Complete(MONITOR_TASK_CTRL)) {
+            Recorder_Trigger();
+        }
     }
 }
 
@@ -98,12 +235,20 @@ void app_comm(void *argument) {
 
     for (;;) {
         osThreadFlagsWait(FLAG_CONN_UP, osFlagsWaitAny, osWaitForever);
+        rx_pkt.sent = 0;
+        uint32_t received = 0;
         
         while (connected) {
             osThreadFlagsWait(FLAG_TICK, osFlagsWaitAny, osWaitForever);
             
             tx_pkt.velocity = global_velocity;
             tx_pkt.timestamp = global_timestamp;
+            tx_pkt.position = global_position;
+            tx_pkt.filter_alpha = (uint16_t)filter_alpha;
+            tx_pkt.filter_mode = (uint16_t)filter_mode;
+            // The server measures the round trip without the time the reply
+            // waited here for this sample
+            tx_pkt.echo = rx_pkt.sent ? rx_pkt.sent + (global_timestamp - received) : 0;
             
             if (send(sn, (uint8_t*)&tx_pkt, sizeof(tx_pkt)) != sizeof(tx_pkt)) {
                 connected = 0; break;
@@ -112,6 +257,7 @@ void app_comm(void *argument) {
             if (recv(sn, (uint8_t*)&rx_pkt, sizeof(rx_pkt)) != sizeof(rx_pkt)) {
                 connected = 0; break;
             }
+            received = Main_GetTickMillisec();
             
             global_control = rx_pkt.control;
             osThreadFlagsSet(tid_app_ctrl, FLAG_DATA_RX);
@@ -123,6 +269,38 @@ void app_comm(void *argument) {
     }
 }
 
+void app_tlm(void *argument) {
+    uint8_t telemetry_ip[4] = {192, 168, 0, 100};
+    uint8_t sn = 1;
+    uint32_t tick;
+
+    // UDP: a lost frame is never retransmitted at the expense of socket 0
+    while (socket(sn, Sn_MR_UDP, TELEMETRY_PORT, 0) != sn) {
+        osDelay(1000);
+    }
+
+    tick = osKernelGetTickCount();
+    for (;;) {
+        tick += PERIOD_TELEMETRY;
+        osDelayUntil(tick);
+
+        uint16_t len;
+        while ((len = Telemetry_BuildFrame(tlm_frame, sizeof(tlm_frame))) > 0) {
+            if (sendto(sn, tlm_frame, len, telemetry_ip, TELEMETRY_PORT) != len) {
+                break;
+            }
+        }
+
+        // Send a frozen trace to the host in one burst, then re-arm
+        if (Recorder_IsFrozen()) {
+            while ((len = Recorder_BuildFrame(tlm_frame, sizeof(tlm_frame))) > 0) {
+                sendto(sn, tlm_frame, len, telemetry_ip, RECORDER_PORT);
+            }
+            Recorder_Arm(RECORDER_POST);
+        }
+    }
+}
+
 void Application_Loop(void) {
     osThreadYield(); 
 }
@@ -130,3 +308,70 @@ void Application_Loop(void) {
 static void Timer_Callback(void *argument) {
     osThreadFlagsSet(tid_app_ctrl, FLAG_TICK);
 }
+
+static void Param_Serve(uint8_t sn) {
+    ParamMessage_t msg;
+    uint8_t ip[4];
+    uint16_t port;
+    uint16_t pending = 0;
+
+    getsockopt(sn, SO_RECVBUF, &pending);
+    if (pending == 0) {
+        return;
+    }
+    if (recvfrom(sn, (uint8_t*)&msg, sizeof(msg), ip, &port) != sizeof(msg) || msg.magic != PARAM_MAGIC) {
+        return;
+    }
+
+    // A set still waiting for app_ctrl is reported instead of the one in use
+    int32_t alpha = (int32_t)(staged_ready ? staged_alpha : filter_alpha);
+    int32_t sample = (int32_t)(staged_ready ? staged_period : period);
+    int32_t mode = (int32_t)(staged_ready ? staged_mode : filter_mode);
+    msg.status = PARAM_STATUS_OK;
+
+    if (msg.type == PARAM_MSG_WRITE) {
+        if (msg.mask & ~PARAM_CLIENT_MASK) {
+            msg.status = PARAM_STATUS_UNSUPPORTED;
+        } else if (staged_ready) {
+            msg.status = PARAM_STATUS_BUSY;
+        } else {
+            int32_t new_alpha = (msg.mask & (1u << PARAM_FILTER_ALPHA)) ? msg.value[PARAM_FILTER_ALPHA] : alpha;
+            int32_t new_period = (msg.mask & (1u << PARAM_PERIOD)) ? msg.value[PARAM_PERIOD] : sample;
+            int32_t new_mode = (msg.mask & (1u << PARAM_FILTER_MODE)) ? msg.value[PARAM_FILTER_MODE] : mode;
+
+            if (new_alpha < 1 || new_alpha > 1000 || new_period < PERIOD_MIN || new_period > PERIOD_MAX ||
+                new_mode < PARAM_FILTER_FIRST_ORDER || new_mode > PARAM_FILTER_OBSERVER) {
+                msg.status = PARAM_STATUS_RANGE;
+            } else {
+                staged_alpha = (uint32_t)new_alpha;
+                staged_period = (uint32_t)new_period;
+                staged_mode = (uint32_t)new_mode;
+                staged_ready = 1;
+                alpha = new_alpha;
+                sample = new_period;
+                mode = new_mode;
+            }
+        }
+    } else if (msg.type != PARAM_MSG_READ) {
+        msg.status = PARAM_STATUS_INVALID;
+    }
+
+    msg.type = PARAM_MSG_REPLY;
+    msg.mask = PARAM_CLIENT_MASK;
+    for (uint32_t i = 0; i < PARAM_COUNT; i++) {
+        msg.value[i] = 0;
+    }
+    msg.value[PARAM_FILTER_ALPHA] = alpha;
+    msg.value[PARAM_PERIOD] = sample;
+    msg.value[PARAM_FILTER_MODE] = mode;
+
+    sendto(sn, (uint8_t*)&msg, sizeof(msg), ip, port);
+}
+
+static void Wizchip_Enter(void) {
+    osMutexAcquire(mutex_spi, osWaitForever);
+}
+
+static void Wizchip_Exit(void) {
+    osMutexRelease(mutex_spi);
+}
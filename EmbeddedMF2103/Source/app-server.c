@@ -1,35 +1,163 @@
 #include "main.h"
+#include "adapt.h"
 #include "application.h"
 #include "controller.h"
+#include "fra.h"
+#include "monitor.h"
 #include "network_protocol.h"
+#include "position.h"
+#include "predictor.h"
+#include "preview.h"
+#include "sessionlog.h"
+#include "stackmon.h"
+#include "sysid.h"
+#include "trajectory.h"
 #include "cmsis_os2.h"
+#include "rtx_os.h"
 
 #ifdef _ETHERNET_ENABLED
 #include "socket.h"
 #include "wizchip_conf.h"
 #endif
 
+/* Parameter requests from the host, polled by the Manager thread */
+#define PARAM_SOCKET     2
+#define PERIOD_PARAM     100   // Parameter poll period in milliseconds
+#define PARAM_CONTROLLER_MASK ((1u << PARAM_KP) | (1u << PARAM_KI) | \
+                               (1u << PARAM_CONTROL_MAX) | (1u << PARAM_CONTROL_MIN))
+#define PARAM_MODEL_MASK ((1u << PARAM_MODEL_GAIN) | (1u << PARAM_MODEL_TAU) | (1u << PARAM_MODEL_FRICTION))
+#define PARAM_SERVER_MASK (PARAM_CONTROLLER_MASK | (1u << PARAM_CONTROL_MODE) | (1u << PARAM_POSITION_TARGET) | \
+                           PARAM_MODEL_MASK)
+
+/* Poll period of app_comm for the next client packet in milliseconds. The
+   ioLibrary recv() spins on the W5500 until data arrives, which would keep
+   every thread below osPriorityNormal from running for the whole session */
+#define PERIOD_RECV      1
+
 /* Thread and Timer Flags */
 #define FLAG_TICK        0x01
 #define FLAG_CONN_UP     0x02
 
+/* Record every controller step and stream it to the host for replay */
+#define SESSION_LOG      1
+#define PERIOD_LOG       100   // Session log frame period in milliseconds
+
+/* The log thread streams the session log and the analyzer reports, it
+   isn't created without either of them */
+#define LOG_THREAD       (SESSION_LOG || FRA)
+
+/* Reference look-ahead of the controller in milliseconds, 0 disables */
+#define PREVIEW_LEAD     30
+
+/* Feedforward terms (CONTROLLER_FF_x) inverting the model on the look-ahead
+   window, PREVIEW_FF_LEAD ms ahead to cover the loop delay. Instead of the
+   controller's FEEDFORWARD, off until the motor model is identified */
+#define PREVIEW_FEEDFORWARD 0
+#define PREVIEW_FF_LEAD  20
+
+/* Smith predictor on the measured velocity, and the loop delay in
+   milliseconds until the first round trip echoed by the client. Off until
+   the motor model is identified */
+#define SMITH_PREDICTOR  0
+#define PREDICTOR_BASE_DELAY 2
+
+/* Motor model used by the feedforward and the Smith predictor, nominal
+   until an identification experiment replaces it or adapted online */
+static MotorModel_t motor_model = {MOTOR_GAIN, MOTOR_TAU, MOTOR_FRICTION};
+
+/* Copy of the model for Param_Serve, written by app_comm: the sequence is
+   odd while the copy is written */
+static MotorModel_t reported_model = {MOTOR_GAIN, MOTOR_TAU, MOTOR_FRICTION};
+static volatile uint32_t reported_sequence = 0;
+
+/* Identification experiment of PARAM_MODE_SYSID, on the unfiltered client velocity */
+static const Sysid_Config_t sysid_config = {SYSID_SIGNAL, SYSID_ORDER, SYSID_BIAS, SYSID_AMPLITUDE, SYSID_BIT,
+                                            SYSID_F_START, SYSID_F_STOP, SYSID_SETTLE, SYSID_DURATION,
+                                            SYSID_VELOCITY_SCALE - 1};
+
+#if FRA
+/* Swept sine of PARAM_MODE_FRA, on the velocity seen by the controller */
+static const uint32_t fra_freqs[] = FRA_FREQUENCIES;
+static const Fra_Config_t fra_config = {FRA_SETPOINT, FRA_AMPLITUDE, fra_freqs,
+                                        sizeof(fra_freqs) / sizeof(fra_freqs[0]), FRA_SETTLE,
+                                        FRA_SETTLE_CYCLES, FRA_CYCLES, 3 * FRA_SETPOINT};
+#endif
+
+/* Outer loop of the position mode, run every POSITION_DIVIDER samples */
+static const Position_Params_t position_params = {POSITION_KP, POSITION_KI, POSITION_MAX_SPEED, POSITION_DIVIDER};
+
+/* Gain schedule over the measured speed */
+static const Controller_Schedule_t gain_schedule = {{GAIN_SCHEDULE_ROW, GAIN_SCHEDULE_ROW}, GAIN_SCHEDULE_SHIFT};
+
 /* Thread IDs */
 osThreadId_t tid_app_main;
 osThreadId_t tid_app_ref;
 osThreadId_t tid_app_comm;
+#if LOG_THREAD
+osThreadId_t tid_app_log;
+#endif
+
+/* Mutex IDs */
+osMutexId_t mutex_spi;
 
 /* Timer IDs */
 osTimerId_t timer_ref;
 
+/* Static RTOS objects: no heap is used at startup. Stack sizes in bytes:
+   the deepest call path of the thread with every option of application.h
+   on (gcc -fstack-usage; the W5500 driver 256, printf 192 and the RTX
+   calls 80 estimated), plus 136 for an exception frame with the FPU and
+   the saved context, plus 25%, in steps of 64. StackMon_Report() prints
+   the peak reached on the target. */
+#define STACK_SIZE_MAIN 1088  // 704: Param_Serve > sendto
+#define STACK_SIZE_REF  320   // 112: osThreadFlagsWait
+#define STACK_SIZE_COMM 1024  // 672: Adapt_Run > Rls_Update
+#define STACK_SIZE_LOG  704   // 400: sendto
+
+static osRtxThread_t tcb_main __attribute__((section(".bss.os.thread.cb")));
+static osRtxThread_t tcb_ref __attribute__((section(".bss.os.thread.cb")));
+static osRtxThread_t tcb_comm __attribute__((section(".bss.os.thread.cb")));
+#if LOG_THREAD
+static osRtxThread_t tcb_log __attribute__((section(".bss.os.thread.cb")));
+#endif
+static osRtxTimer_t tcb_timer_ref __attribute__((section(".bss.os.timer.cb")));
+static osRtxMutex_t tcb_mutex_spi __attribute__((section(".bss.os.mutex.cb")));
+
+static uint64_t stack_main[STACK_SIZE_MAIN / 8] __attribute__((section(".bss.os.thread.stack")));
+static uint64_t stack_ref[STACK_SIZE_REF / 8] __attribute__((section(".bss.os.thread.stack")));
+static uint64_t stack_comm[STACK_SIZE_COMM / 8] __attribute__((section(".bss.os.thread.stack")));
+#if LOG_THREAD
+static uint64_t stack_log[STACK_SIZE_LOG / 8] __attribute__((section(".bss.os.thread.stack")));
+#endif
+
+#if SESSION_LOG
+static uint8_t log_frame[sizeof(SessionLogHeader_t) + SESSION_LOG_BATCH * sizeof(SessionRecord_t)];
+#endif
+
 /* Global State */
 static volatile uint8_t connected = 0;
-int32_t reference = 2000; // Starting reference value
+int32_t reference = 2000; // Starting target value, shaped by the trajectory
+
+/* Control mode written by Param_Serve, taken by app_comm at the next sample */
+static volatile int32_t control_mode = POSITION_CONTROL ? PARAM_MODE_POSITION : PARAM_MODE_VELOCITY;
 
 /* --- Function Prototypes --- */
 void app_main(void *argument);
 void app_ref(void *argument);
 void app_comm(void *argument);
+#if LOG_THREAD
+void app_log(void *argument);
+#endif
 static void Timer_Callback(void *argument);
+static void Wizchip_Enter(void);
+static void Wizchip_Exit(void);
+static int32_t Param_Serve(uint8_t sn);
+static int32_t Comm_Wait(uint8_t sn);
+static void Model_Publish(void);
+static void Model_Read(MotorModel_t *model);
+#if FRA
+static void Analyzer_Report(uint8_t sn, uint8_t *host_ip);
+#endif
 
 /**
  * @brief Setup RTOS kernel and create the Manager thread.
@@ -37,7 +165,10 @@ static void Timer_Callback(void *argument);
 void Application_Setup() {
     osKernelInitialize();
     
-    const osThreadAttr_t main_attr = { .priority = osPriorityBelowNormal, .name = "Manager" };
+    const osThreadAttr_t main_attr = { .priority = osPriorityBelowNormal, .name = "Manager",
+                                       .cb_mem = &tcb_main, .cb_size = sizeof(tcb_main),
+                                       .stack_mem = stack_main, .stack_size = sizeof(stack_main) };
+    StackMon_Register(main_attr.name, stack_main, sizeof(stack_main));
     tid_app_main = osThreadNew(app_main, NULL, &main_attr);
     
     osKernelStart();
@@ -47,14 +178,55 @@ void Application_Setup() {
  * @brief Main Thread: Handles TCP Listening and Thread synchronization.
  */
 void app_main(void *argument) {
+    const osThreadAttr_t ref_attr = { .priority = osPriorityNormal, .name = "Reference",
+                                      .cb_mem = &tcb_ref, .cb_size = sizeof(tcb_ref),
+                                      .stack_mem = stack_ref, .stack_size = sizeof(stack_ref) };
+    const osThreadAttr_t comm_attr = { .priority = osPriorityNormal, .name = "Comm",
+                                       .cb_mem = &tcb_comm, .cb_size = sizeof(tcb_comm),
+                                       .stack_mem = stack_comm, .stack_size = sizeof(stack_comm) };
+#if LOG_THREAD
+    const osThreadAttr_t log_attr = { .priority = osPriorityLow, .name = "SessionLog",
+                                      .cb_mem = &tcb_log, .cb_size = sizeof(tcb_log),
+                                      .stack_mem = stack_log, .stack_size = sizeof(stack_log) };
+#endif
+    const osTimerAttr_t timer_attr = { .name = "Reference",
+                                       .cb_mem = &tcb_timer_ref, .cb_size = sizeof(tcb_timer_ref) };
+    const osMutexAttr_t mutex_attr = { .name = "SPI", .attr_bits = osMutexPrioInherit,
+                                       .cb_mem = &tcb_mutex_spi, .cb_size = sizeof(tcb_mutex_spi) };
+
+    // Two threads share the W5500: serialize every SPI access
+    mutex_spi = osMutexNew(&mutex_attr);
+    reg_wizchip_cris_cbfunc(Wizchip_Enter, Wizchip_Exit);
+
+    StackMon_Register(ref_attr.name, stack_ref, sizeof(stack_ref));
+    StackMon_Register(comm_attr.name, stack_comm, sizeof(stack_comm));
+#if LOG_THREAD
+    StackMon_Register(log_attr.name, stack_log, sizeof(stack_log));
+#endif
+
+#if ADAPT
+    // Before app_comm feeds and runs the estimator, the client
+    // reports its velocity filter with every sample
+    const Adapt_Config_t adapt_config = {ADAPT_ORDER, ADAPT_DECIMATION, ADAPT_LAMBDA, 1000,
+                                         ADAPT_WARMUP, ADAPT_PUBLISH, motor_model};
+    Adapt_Init(&adapt_config);
+#endif
+
     // 1. Create sub-threads first
-    tid_app_ref = osThreadNew(app_ref, NULL, NULL);
-    tid_app_comm = osThreadNew(app_comm, NULL, NULL);
+    tid_app_ref = osThreadNew(app_ref, NULL, &ref_attr);
+    tid_app_comm = osThreadNew(app_comm, NULL, &comm_attr);
+#if LOG_THREAD
+    tid_app_log = osThreadNew(app_log, NULL, &log_attr);
+#endif
 
     // 2. Allow kernel to register Thread IDs before creating timer
     osDelay(100); 
     
-    timer_ref = osTimerNew(Timer_Callback, osTimerPeriodic, NULL, NULL);
+    timer_ref = osTimerNew(Timer_Callback, osTimerPeriodic, NULL, &timer_attr);
+    Monitor_Init();
+
+    // Controller parameters can be read and written on a live connection
+    socket(PARAM_SOCKET, Sn_MR_UDP, PARAM_PORT, 0);
 
     uint8_t sn = 0; // WIZnet Socket 0
 
@@ -70,6 +242,24 @@ void app_main(void *argument) {
                         if (status == SOCK_ESTABLISHED) {
                             connected = 1;
                             Controller_Reset();
+                            Controller_SetFeedforward(&motor_model, FEEDFORWARD);
+                            Controller_SetDisturbanceObserver(&motor_model, DISTURBANCE_OBSERVER);
+                            Controller_SetSchedule(GAIN_SCHEDULE ? &gain_schedule : NULL);
+                            Preview_SetModel(&motor_model, PREVIEW_FEEDFORWARD);
+                            Predictor_Init(SMITH_PREDICTOR ? &motor_model : NULL, PREDICTOR_BASE_DELAY);
+                            
+                            // Ramp up to the current target from standstill
+                            uint32_t now = Main_GetTickMillisec();
+                            Trajectory_Init(0);
+                            Trajectory_Configure(TRAJ_PROFILE, TRAJ_ACCEL, TRAJ_JERK);
+                            Trajectory_Start(reference, now);
+                            
+                            // Announce the first flip so it enters the look-ahead window early
+                            Preview_Reset(now);
+                            Preview_Schedule(-reference, now + PERIOD_REF);
+                            
+                            // Deadline statistics are kept per connection
+                            Monitor_Configure(MONITOR_TASK_REF, PERIOD_REF);
                             
                             // Start reference toggle timer (e.g. 2000ms)
                             osTimerStart(timer_ref, PERIOD_REF); 
@@ -79,12 +269,21 @@ void app_main(void *argument) {
                         } else if (status == SOCK_CLOSED) {
                             break; 
                         }
+                        while (Param_Serve(PARAM_SOCKET) == 0) {}
                         osDelay(100);
                     }
                 }
             }
         }
-        osDelay(1000); 
+        Monitor_Report();
+        StackMon_Report();
+
+        // Serve parameter requests until the next report, all of those
+        // queued since the last poll at once
+        for (uint32_t i = 0; i < 1000 / PERIOD_PARAM; i++) {
+            while (Param_Serve(PARAM_SOCKET) == 0) {}
+            osDelay(PERIOD_PARAM);
+        }
     }
 }
 
@@ -100,18 +299,113 @@ void app_comm(void *argument) {
     for (;;) {
         // Block until a client connects
         osThreadFlagsWait(FLAG_CONN_UP, osFlagsWaitAny, osWaitForever);
+#if SESSION_LOG
+        // The controller was configured for the connection by app_main
+        Controller_Config_t config;
+        Controller_GetConfig(&config);
+        SessionLog_Start(&config);
+#endif
+        int64_t position = 0;
+        int32_t mode = -1; // The first sample enters the current mode
         
         while (connected) {
-            // Blocking receive: wait for packet from Client
-            int32_t ret = recv(sn, (uint8_t*)&rx_pkt, sizeof(rx_pkt));
-            
-            if (ret <= 0) {
+            // Sleep until the packet from the Client is complete, recv() then
+            // returns without polling the W5500
+            if (Comm_Wait(sn) != 0 || recv(sn, (uint8_t*)&rx_pkt, sizeof(rx_pkt)) != sizeof(rx_pkt)) {
                 connected = 0;
                 break;
             }
 
-            // Calculate PI signal based on the current 'reference' global
-            tx_pkt.control = Controller_PIController(&reference, &rx_pkt.velocity, &rx_pkt.timestamp);
+            // Keep the look-ahead window filled, then steer towards the
+            // reference PREVIEW_LEAD ms ahead to make up for the loop lag
+            uint32_t now = Main_GetTickMillisec();
+            Preview_Fill(now);
+            int32_t ref = Preview_Lookup(now + PREVIEW_LEAD);
+
+            // Position mode: the position loop sets the reference instead,
+            // holding the position where the mode was entered
+            position = mode < 0 ? (int32_t)rx_pkt.position : Position_Unwrap(position, rx_pkt.position);
+            if (control_mode != mode) {
+                mode = control_mode;
+                if (mode == PARAM_MODE_POSITION) {
+                    Position_Init(position, &position_params);
+                } else if (mode == PARAM_MODE_SYSID) {
+                    // The controller is idle during the experiment, a replay
+                    // of the session stops at its first step
+                    Controller_Reset();
+                    Sysid_Start(&sysid_config, rx_pkt.timestamp);
+#if FRA
+                } else if (mode == PARAM_MODE_FRA) {
+                    Fra_Start(&fra_config, rx_pkt.timestamp);
+#endif
+                }
+            }
+            if (mode == PARAM_MODE_POSITION) {
+                ref = Position_Update(position, rx_pkt.timestamp);
+            }
+
+#if ADAPT
+            // Apply the latest adapted model between two controller steps
+            if (Adapt_TakeModel(&motor_model) == 0) {
+                Model_Publish();
+                Controller_SetFeedforward(&motor_model, FEEDFORWARD);
+                Controller_SetDisturbanceObserver(&motor_model, DISTURBANCE_OBSERVER);
+                Preview_SetModel(&motor_model, PREVIEW_FEEDFORWARD);
+                Predictor_SetModel(&motor_model);
+            }
+            int32_t measured = rx_pkt.velocity;
+#endif
+
+            int32_t feedforward = 0;
+            if (mode == PARAM_MODE_SYSID) {
+                // Identification: the experiment drives the motor instead of
+                // the controller, on the velocity as measured
+                ref = 0;
+                tx_pkt.control = Sysid_Step(rx_pkt.velocity, rx_pkt.timestamp);
+                if (Sysid_GetState() != SYSID_RUNNING) {
+                    Sysid_Result_t result;
+                    if (Sysid_GetResult(&result) == 0) {
+                        motor_model = result.model;
+                        Model_Publish();
+                        Controller_SetFeedforward(&motor_model, FEEDFORWARD);
+                        Controller_SetDisturbanceObserver(&motor_model, DISTURBANCE_OBSERVER);
+                        Preview_SetModel(&motor_model, PREVIEW_FEEDFORWARD);
+                        Predictor_Init(SMITH_PREDICTOR ? &motor_model : NULL, PREDICTOR_BASE_DELAY);
+                    }
+                    Controller_Reset();
+                    control_mode = PARAM_MODE_VELOCITY;
+                }
+            } else {
+                // Replace the measurement by its prediction over the loop delay,
+                // the session log then holds the actual controller input
+                rx_pkt.velocity = Predictor_Update(rx_pkt.velocity, rx_pkt.echo, now);
+#if FRA
+                if (mode == PARAM_MODE_FRA) {
+                    ref = Fra_Step(rx_pkt.velocity, rx_pkt.timestamp);
+                    if (Fra_GetState() != FRA_RUNNING) {
+                        control_mode = PARAM_MODE_VELOCITY;
+                    }
+                }
+#endif
+                // The preview feedforward follows the window, the position loop
+                // and the analyzer set a reference of their own
+                if (mode == PARAM_MODE_VELOCITY) {
+                    feedforward = Preview_Feedforward(now + PREVIEW_FF_LEAD);
+                }
+                Controller_SetFeedforwardInput(feedforward);
+                tx_pkt.control = Controller_PIController(&ref, &rx_pkt.velocity, &rx_pkt.timestamp);
+            }
+            Predictor_Apply(tx_pkt.control, now);
+            tx_pkt.sent = now; // Echoed by the client for the round trip
+#if ADAPT
+            // The fit runs through the client's low-pass, paused with any
+            // other filter
+            Adapt_Push(measured, tx_pkt.control, rx_pkt.timestamp,
+                       rx_pkt.filter_mode == PARAM_FILTER_FIRST_ORDER ? rx_pkt.filter_alpha : 0);
+#endif
+#if SESSION_LOG
+            SessionLog_Append(&rx_pkt, ref, feedforward, &tx_pkt, Controller_GetGeneration());
+#endif
             
             // Send control value back to client
             if (send(sn, (uint8_t*)&tx_pkt, sizeof(tx_pkt)) != sizeof(tx_pkt)) {
@@ -119,8 +413,14 @@ void app_comm(void *argument) {
                 break;
             }
 
-            /* CRITICAL: Yield the CPU to allow app_ref to run! 
-               Without this, app_comm may starve other threads of the same priority. */
+#if ADAPT
+            // Fit the model once the control is on its way, a bounded number
+            // of samples per packet so the next one is never late
+            Adapt_Run(ADAPT_BUDGET);
+#endif
+
+            /* Yield the CPU to app_ref, Comm_Wait() then sleeps until the
+               next packet so that the lower priority threads run as well */
             osThreadYield();
         }
         
@@ -131,6 +431,90 @@ void app_comm(void *argument) {
     }
 }
 
+#if LOG_THREAD
+/**
+ * @brief Session Log Thread: Streams the recorded controller steps and the
+ * frequency-response reports over UDP.
+ */
+void app_log(void *argument) {
+    uint8_t host_ip[4] = {192, 168, 0, 100};
+    uint8_t sn = 1; // WIZnet Socket 1
+    uint32_t tick;
+
+    while (socket(sn, Sn_MR_UDP, SESSION_LOG_PORT, 0) != sn) {
+        osDelay(1000);
+    }
+
+    tick = osKernelGetTickCount();
+    for (;;) {
+        tick += PERIOD_LOG;
+        osDelayUntil(tick);
+
+#if SESSION_LOG
+        uint16_t len;
+        while ((len = SessionLog_BuildFrame(log_frame, sizeof(log_frame))) > 0) {
+            if (sendto(sn, log_frame, len, host_ip, SESSION_LOG_PORT) != len) {
+                break;
+            }
+        }
+#endif
+#if FRA
+        Analyzer_Report(sn, host_ip);
+#endif
+    }
+}
+#endif
+
+#if FRA
+/**
+ * @brief Send the points measured by the analyzer since the last call, then
+ * the margins once the sweep is over. A new sweep starts over from its
+ * first point.
+ */
+static void Analyzer_Report(uint8_t sn, uint8_t *host_ip) {
+    static uint32_t sent = 0;
+    static uint8_t finished = 1;
+    FraReport_t report = { .magic = FRA_MAGIC };
+    Fra_State_t state = Fra_GetState();
+    Fra_Point_t point;
+    Fra_Result_t result;
+
+    if ((state == FRA_RUNNING && finished) || Fra_GetPointCount() < sent) {
+        sent = 0;
+        finished = 0;
+    }
+
+    while (Fra_GetPoint(sent, &point) == 0) {
+        report.type = FRA_REPORT_POINT;
+        report.index = (uint8_t)sent;
+        report.value[0] = (int32_t)point.freq_mhz;
+        report.value[1] = point.gain;
+        report.value[2] = point.phase;
+        report.value[3] = point.amplitude;
+        if (sendto(sn, (uint8_t*)&report, sizeof(report), host_ip, FRA_PORT) != sizeof(report)) {
+            return;
+        }
+        sent++;
+    }
+
+    if (!finished && state != FRA_RUNNING) {
+        report.type = FRA_REPORT_FAILED;
+        report.index = (uint8_t)sent;
+        report.value[0] = report.value[1] = report.value[2] = report.value[3] = 0;
+        if (Fra_GetResult(&result) == 0) {
+            report.type = FRA_REPORT_RESULT;
+            report.value[0] = (int32_t)result.crossover_mhz;
+            report.value[1] = result.phase_margin;
+            report.value[2] = (int32_t)result.phase_crossover_mhz;
+            report.value[3] = result.gain_margin;
+        }
+        if (sendto(sn, (uint8_t*)&report, sizeof(report), host_ip, FRA_PORT) == sizeof(report)) {
+            finished = 1;
+        }
+    }
+}
+#endif
+
 /**
  * @brief Reference Thread: Toggles the reference value for a square wave.
  */
@@ -138,13 +522,28 @@ void app_ref(void *argument) {
     for (;;) {
         // Wait for the periodic signal from the Timer
         osThreadFlagsWait(FLAG_TICK, osFlagsWaitAny, osWaitForever);
+        uint32_t periods = Monitor_Release(MONITOR_TASK_REF, Main_GetTickMillisec());
         
         if (connected) {
-            reference = -reference; // Square wave flip
+#if COMPENSATE_SKIPPED
+            // Coalesced timer flags hide flips: keep the square wave in phase
+            uint32_t flips = periods;
+#else
+            uint32_t flips = 1;
+            (void)periods;
+#endif
+            if (flips & 1u) {
+                reference = -reference; // Square wave flip of the target
+            }
+            
+            // The flip happening now was scheduled one period ago, announce the next one
+            Preview_Schedule(-reference, Main_GetTickMillisec() + PERIOD_REF);
             
             // HEARTBEAT: Toggle Green LED (PA5) to confirm thread is waking up
             HAL_GPIO_TogglePin(GPIOA, GPIO_PIN_5); 
         }
+
+        Monitor_Complete(MONITOR_TASK_REF);
     }
 }
 
@@ -157,6 +556,150 @@ static void Timer_Callback(void *argument) {
     }
 }
 
+/**
+ * @brief W5500 critical section: Serializes SPI access between threads.
+ */
+static void Wizchip_Enter(void) {
+    osMutexAcquire(mutex_spi, osWaitForever);
+}
+
+static void Wizchip_Exit(void) {
+    osMutexRelease(mutex_spi);
+}
+
+/**
+ * @brief Wait for a whole ClientData_t on the connection.
+ * Polls the receive size every PERIOD_RECV ms and sleeps in between, so the
+ * lower priority threads run while app_comm waits for the client.
+ * @return 0 when the packet is received, -1 when the connection is closed.
+ */
+static int32_t Comm_Wait(uint8_t sn) {
+    for (;;) {
+        uint16_t pending = 0;
+        getsockopt(sn, SO_RECVBUF, &pending);
+        if (pending >= sizeof(ClientData_t)) {
+            return 0;
+        }
+
+        uint8_t status;
+        getsockopt(sn, SO_STATUS, &status);
+        if (status != SOCK_ESTABLISHED) {
+            return -1;
+        }
+        osDelay(PERIOD_RECV);
+    }
+}
+
+/**
+ * @brief Answer one pending parameter request, if any.
+ * Writes are staged in the controller and taken over at its next step,
+ * so app_comm never waits for this thread.
+ * @return 0 when a datagram was taken, -1 when none is pending.
+ */
+static int32_t Param_Serve(uint8_t sn) {
+    ParamMessage_t msg;
+    Controller_Params_t params;
+    uint8_t ip[4];
+    uint16_t port;
+    uint16_t pending = 0;
+
+    getsockopt(sn, SO_RECVBUF, &pending);
+    if (pending == 0) {
+        return -1;
+    }
+    int32_t len = recvfrom(sn, (uint8_t*)&msg, sizeof(msg), ip, &port);
+    if (len <= 0) {
+        return -1;
+    }
+    if (len != sizeof(msg) || msg.magic != PARAM_MAGIC) {
+        return 0;
+    }
+
+    Controller_GetParams(&params);
+    msg.status = PARAM_STATUS_OK;
+
+    if (msg.type == PARAM_MSG_WRITE) {
+        if (msg.mask & ~(PARAM_SERVER_MASK & ~PARAM_MODEL_MASK)) {
+            msg.status = PARAM_STATUS_UNSUPPORTED;
+        } else {
+            if (msg.mask & (1u << PARAM_KP)) params.gains.kp = msg.value[PARAM_KP];
+            if (msg.mask & (1u << PARAM_KI)) params.gains.ki = msg.value[PARAM_KI];
+            if (msg.mask & (1u << PARAM_CONTROL_MAX)) params.control_max = msg.value[PARAM_CONTROL_MAX];
+            if (msg.mask & (1u << PARAM_CONTROL_MIN)) params.control_min = msg.value[PARAM_CONTROL_MIN];
+            int32_t mode = (msg.mask & (1u << PARAM_CONTROL_MODE)) ? msg.value[PARAM_CONTROL_MODE] : control_mode;
+
+            if (params.gains.kp < 0 || params.gains.ki < 0 ||
+                params.control_max <= 0 || params.control_min >= 0 ||
+                mode < PARAM_MODE_VELOCITY || mode > (FRA ? PARAM_MODE_FRA : PARAM_MODE_SYSID)) {
+                msg.status = PARAM_STATUS_RANGE;
+            } else if ((msg.mask & PARAM_CONTROLLER_MASK) && Controller_SetParams(&params) != 0) {
+                msg.status = PARAM_STATUS_BUSY;
+            } else if ((msg.mask & (1u << PARAM_POSITION_TARGET)) &&
+                       Position_Move(msg.value[PARAM_POSITION_TARGET]) != 0) {
+                msg.status = PARAM_STATUS_BUSY;
+            } else {
+                // A move staged before the position mode is entered is taken
+                // right away, Position_Init() keeps it
+                control_mode = mode;
+            }
+
+            // Report what the controller will actually use
+            if (msg.status != PARAM_STATUS_OK) {
+                Controller_GetParams(&params);
+            }
+        }
+    } else if (msg.type != PARAM_MSG_READ) {
+        msg.status = PARAM_STATUS_INVALID;
+    }
+
+    msg.type = PARAM_MSG_REPLY;
+    msg.mask = PARAM_SERVER_MASK;
+    for (uint32_t i = 0; i < PARAM_COUNT; i++) {
+        msg.value[i] = 0;
+    }
+    msg.value[PARAM_KP] = params.gains.kp;
+    msg.value[PARAM_KI] = params.gains.ki;
+    msg.value[PARAM_CONTROL_MAX] = params.control_max;
+    msg.value[PARAM_CONTROL_MIN] = params.control_min;
+    msg.value[PARAM_CONTROL_MODE] = control_mode;
+    msg.value[PARAM_POSITION_TARGET] = (int32_t)Position_GetTarget();
+    MotorModel_t model;
+    Model_Read(&model);
+    msg.value[PARAM_MODEL_GAIN] = model.gain;
+    msg.value[PARAM_MODEL_TAU] = (int32_t)model.tau_ms;
+    msg.value[PARAM_MODEL_FRICTION] = model.friction;
+
+    sendto(sn, (uint8_t*)&msg, sizeof(msg), ip, port);
+    return 0;
+}
+
+/**
+ * @brief Publish the motor model of app_comm to Param_Serve.
+ */
+static void Model_Publish(void) {
+    reported_sequence++;
+    __DMB();
+    reported_model = motor_model;
+    __DMB();
+    reported_sequence++;
+}
+
+/**
+ * @brief Read the published motor model, again if app_comm published a new
+ * one meanwhile. app_comm runs above the Manager thread and finishes a
+ * publication before this one resumes, so the retry ends.
+ */
+static void Model_Read(MotorModel_t *model) {
+    uint32_t sequence;
+
+    do {
+        sequence = reported_sequence;
+        __DMB();
+        *model = reported_model;
+        __DMB();
+    } while ((sequence & 1u) || sequence != reported_sequence);
+}
+
 /**
  * @brief Yields the main loop to RTOS threads.
  */
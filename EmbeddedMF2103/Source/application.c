@@ -1,20 +1,358 @@
 #include "main.h" 
 
+#include "adapt.h"
 #include "application.h" 
+#include "autotune.h"
+#include "biquad.h"
+#include "cogging.h"
 #include "controller.h"
+#include "fra.h"
+#include "monitor.h"
 #include "peripherals.h"
+#include "position.h"
+#include "recorder.h"
+#include "sysid.h"
+#include "trajectory.h"
+#include <stdio.h>
 
 /* Global variables ----------------------------------------------------------*/
-int32_t reference, velocity, control;
+int32_t target, reference, velocity, control;
 uint32_t millisec;
 
+/* Motor model used by the feedforward, nominal unless identified at start
+   or adapted online */
+static MotorModel_t motor_model = {MOTOR_GAIN, MOTOR_TAU, MOTOR_FRICTION};
+
+/* Outer loop of the position mode */
+static const Position_Params_t position_params = {POSITION_KP, POSITION_KI, POSITION_MAX_SPEED, POSITION_DIVIDER};
+
+/* Gain schedule over the measured speed */
+static const Controller_Schedule_t gain_schedule = {{GAIN_SCHEDULE_ROW, GAIN_SCHEDULE_ROW}, GAIN_SCHEDULE_SHIFT};
+
 /* Functions -----------------------------------------------------------------*/
 
+#if AUTOTUNE || SYSID || FRA || PWM_STAIRCASE
+/* Wait for the next control period */
+static uint32_t Application_WaitPeriod(uint32_t last)
+{
+  while((Main_GetTickMillisec() % PERIOD_CTRL > 0) || (Main_GetTickMillisec() == last))
+  {
+    // Do nothing while waiting
+  }
+  return Main_GetTickMillisec();
+}
+#endif
+
+#if PWM_STAIRCASE
+/* Open-loop duty staircase in each direction, printing the mean velocity
+   of each step for Tools/pwm_linearize.py. The duty steps down from the
+   top, so the motor runs into each step and the deadband found is the one
+   of the running motor, below the breakaway from standstill. */
+static void Application_Staircase(void)
+{
+  uint32_t now = Application_WaitPeriod(Main_GetTickMillisec());
+
+  Peripheral_Encoder_CalculateVelocity(now);
+  for (int32_t dir = 1; dir >= -1; dir -= 2) {
+    for (int32_t k = PWM_STAIRCASE_STEPS; k > 0; k--) {
+      int32_t duty = dir * k * PWM_STAIRCASE_STEP;
+      uint32_t start = now, from_ms = now;
+      int64_t from = Peripheral_Encoder_GetPosition();
+
+      Peripheral_PWM_ActuateMotor(duty);
+      while (now - start < PWM_STAIRCASE_HOLD) {
+        // The encoder is read every period, before its counter wraps
+        now = Application_WaitPeriod(now);
+        velocity = Peripheral_Encoder_CalculateVelocity(now);
+        if (now - start < PWM_STAIRCASE_HOLD / 2) {
+          from = Peripheral_Encoder_GetPosition();
+          from_ms = now;
+        }
+      }
+      int32_t rpm = (int32_t)((Peripheral_Encoder_GetPosition() - from) * 60000 /
+                              ((int64_t)RESOLUTION * (now - from_ms)));
+      printf("[pwm] duty=%ld rpm=%ld\r\n", (long)duty, (long)rpm);
+    }
+
+    // Stop before the other direction
+    Peripheral_PWM_ActuateMotor(0);
+    for (uint32_t start = now; now - start < PWM_STAIRCASE_HOLD;) {
+      now = Application_WaitPeriod(now);
+      velocity = Peripheral_Encoder_CalculateVelocity(now);
+    }
+  }
+  millisec = now;
+}
+#endif
+
+#if FILTER_BENCH
+/* Time the velocity filter presets one sample per call, as the encoder
+   velocity runs them, with the interrupts masked around each call */
+static void Application_FilterBench(void)
+{
+  static const Biquad_Coeffs_t presets[] = {VELOCITY_LOWPASS_COEFFS, VELOCITY_NOTCH_COEFFS};
+  static const char *const names[] = {"lowpass", "notch"};
+  static Biquad_t filter;
+  uint32_t overhead = UINT32_MAX;
+
+  // Enables the cycle counter, set up again before the loop starts
+  Monitor_Init();
+
+  // Cost of reading the counter itself, subtracted from every call
+  for (uint32_t i = 0; i < 16; i++) {
+    __disable_irq();
+    uint32_t start = DWT->CYCCNT;
+    uint32_t cycles = DWT->CYCCNT - start;
+    __enable_irq();
+    if (cycles < overhead)
+      overhead = cycles;
+  }
+
+  for (uint32_t f = 0; f < sizeof(presets) / sizeof(presets[0]); f++) {
+    uint32_t min = UINT32_MAX, max = 0;
+    uint64_t sum = 0;
+    int32_t x = 0, y;
+
+    Biquad_Init(&filter, &presets[f]);
+    for (uint32_t i = 0; i < FILTER_BENCH_SAMPLES; i++) {
+      // Velocity-like input in Q31 with some bits changing every sample
+      x = (int32_t)((uint32_t)x * 1664525u + 1013904223u) >> 8;
+
+      __disable_irq();
+      uint32_t start = DWT->CYCCNT;
+      Biquad_Process(&filter, &x, &y, 1);
+      uint32_t cycles = DWT->CYCCNT - start - overhead;
+      __enable_irq();
+
+      sum += cycles;
+      if (cycles < min)
+        min = cycles;
+      if (cycles > max)
+        max = cycles;
+    }
+    printf("[biquad] filter=%s stages=%u cmsis=%d min=%lu mean=%lu max=%lu mhz=%lu\r\n", names[f],
+           presets[f].stages, BIQUAD_CMSIS, (unsigned long)min,
+           (unsigned long)(sum / FILTER_BENCH_SAMPLES), (unsigned long)max,
+           (unsigned long)(SystemCoreClock / 1000000u));
+  }
+}
+#endif
+
+#if SYSID
+/* Excitation experiment: drive the motor open loop around the bias and fit
+   the motor model on the unfiltered velocity */
+static void Application_Identify(void)
+{
+  const Sysid_Config_t config = {
+    .signal = SYSID_SIGNAL,
+    .order = SYSID_ORDER,
+    .bias = SYSID_BIAS,
+    .amplitude = SYSID_AMPLITUDE,
+    .bit_ms = SYSID_BIT,
+    .f_start_mhz = SYSID_F_START,
+    .f_stop_mhz = SYSID_F_STOP,
+    .settle_ms = SYSID_SETTLE,
+    .duration_ms = SYSID_DURATION,
+    .limit = SYSID_VELOCITY_SCALE - 1,
+  };
+  Sysid_Result_t result;
+  uint32_t now = Application_WaitPeriod(Main_GetTickMillisec());
+
+  // The filter lag would be fitted as part of the motor
+  Peripheral_Encoder_SetFilter(1000);
+  Peripheral_Encoder_CalculateVelocity(now);
+  Sysid_Start(&config, now);
+
+  while (Sysid_GetState() == SYSID_RUNNING) {
+    now = Application_WaitPeriod(now);
+    velocity = Peripheral_Encoder_CalculateVelocity(now);
+    control = Sysid_Step(velocity, now);
+    Peripheral_PWM_ActuateMotor(control);
+  }
+  Peripheral_PWM_ActuateMotor(0);
+  Peripheral_Encoder_SetFilter(VELOCITY_ALPHA);
+
+  if (Sysid_GetResult(&result) == 0) {
+    motor_model = result.model;
+    printf("[sysid] %lu samples, residual %ld RPM -> gain=%ld RPM tau=%lu ms friction=%ld\r\n",
+           (unsigned long)result.samples, (long)result.residual, (long)motor_model.gain,
+           (unsigned long)motor_model.tau_ms, (long)motor_model.friction);
+  } else {
+    printf("[sysid] identification failed, keeping the nominal model\r\n");
+  }
+  millisec = now;
+}
+#endif
+
+#if COGGING
+/* Slow position-controlled sweep: learn the friction and cogging table
+   and store it, or find the angle of the stored one after a reboot in a
+   single revolution */
+static void Application_Calibrate(void)
+{
+  static Cogging_Table_t table;
+  Cogging_Config_t config = {
+    .mode = COGGING_CALIBRATE,
+    .speed = COGGING_SPEED,
+    .revolutions = COGGING_REVOLUTIONS,
+    .settle_ms = COGGING_SETTLE,
+    .bandwidth = COGGING_BANDWIDTH,
+    .timeout_ms = COGGING_TIMEOUT,
+    .model = motor_model,
+  };
+  Cogging_Result_t result;
+  uint32_t now = Main_GetTickMillisec();
+
+  Peripheral_Flash_Read(&table, sizeof(table));
+  if (!COGGING_RECALIBRATE && Cogging_Load(&table) == 0) {
+    config.mode = COGGING_ALIGN;
+    config.revolutions = 1;
+  }
+
+  Peripheral_Encoder_CalculateVelocity(now);
+  Cogging_Start(&config, Peripheral_Encoder_GetPosition(), now);
+
+  while (Cogging_GetState() == COGGING_RUNNING) {
+    // Faster than the control loop, which hasn't started yet
+    while (Main_GetTickMillisec() - now < COGGING_PERIOD)
+    {
+      // Do nothing while waiting
+    }
+    now = Main_GetTickMillisec();
+    velocity = Peripheral_Encoder_CalculateVelocity(now);
+    control = Cogging_Step(Peripheral_Encoder_GetPosition(), now);
+    Peripheral_PWM_ActuateMotor(control);
+  }
+  Peripheral_PWM_ActuateMotor(0);
+
+  if (Cogging_GetResult(&result) == 0) {
+    // Only a new calibration is written, the flash keeps the angle it was learned in
+    if (config.mode == COGGING_CALIBRATE && (Cogging_Save(&table) != 0 ||
+        Peripheral_Flash_Write(&table, sizeof(table)) != 0))
+      printf("[cogging] storing the table failed\r\n");
+    Cogging_Enable(COGGING_BLEND);
+    printf("[cogging] %s: %lu samples, friction=%ld/%ld ripple=%ld shift=%lu counts\r\n",
+           config.mode == COGGING_CALIBRATE ? "calibrated" : "aligned", (unsigned long)result.samples,
+           (long)result.friction[0], (long)result.friction[1], (long)result.ripple, (unsigned long)result.shift);
+  } else {
+    printf("[cogging] sweep failed, no compensation\r\n");
+  }
+
+  // Resume from standstill
+  control = 0;
+  millisec = now;
+}
+#endif
+
+#if AUTOTUNE
+
+/* Relay experiment: settle at the setpoint with the current gains, let the
+   relay drive the motor into a limit cycle, then swap in the tuned gains */
+static void Application_Autotune(void)
+{
+  Autotune_Config_t config = {
+    .setpoint = AUTOTUNE_SETPOINT,
+    .amplitude = AUTOTUNE_AMPLITUDE,
+    .hysteresis = AUTOTUNE_HYSTERESIS,
+    .bias = 0,
+    .limit = 3 * AUTOTUNE_SETPOINT,
+    .timeout_ms = AUTOTUNE_TIMEOUT,
+  };
+  Autotune_Result_t result;
+  uint32_t start = Main_GetTickMillisec();
+  uint32_t now = start;
+
+  do {
+    now = Application_WaitPeriod(now);
+    velocity = Peripheral_Encoder_CalculateVelocity(now);
+    control = Controller_PIController(&config.setpoint, &velocity, &now);
+    Peripheral_PWM_ActuateMotor(control);
+  } while (now - start < AUTOTUNE_LEAD);
+
+  // The relay oscillates around the control that holds the setpoint
+  config.bias = control;
+  Autotune_Start(&config, now);
+
+  while (Autotune_GetState() == AUTOTUNE_RUNNING) {
+    now = Application_WaitPeriod(now);
+    velocity = Peripheral_Encoder_CalculateVelocity(now);
+    control = Autotune_Step(velocity, now);
+    Peripheral_PWM_ActuateMotor(control);
+  }
+
+  if (Autotune_GetResult(&result) == 0) {
+    Controller_SetGains(&result.gains);
+    printf("[autotune] Tu=%lu ms a=%ld RPM Ku=%ld -> kp=%ld ki=%ld\r\n",
+           (unsigned long)result.period_ms, (long)result.amplitude, (long)result.ku,
+           (long)result.gains.kp, (long)result.gains.ki);
+  } else {
+    printf("[autotune] relay experiment failed, keeping the default gains\r\n");
+  }
+
+  // Resume from the setpoint with the new gains
+  Controller_Reset();
+  reference = AUTOTUNE_SETPOINT;
+  millisec = now;
+}
+#endif
+
+#if FRA
+/* Swept sine on the reference: the analyzer keeps the loop gain at each
+   frequency, printed with the stability margins once the sweep is over */
+static void Application_Analyze(void)
+{
+  static const uint32_t freqs[] = FRA_FREQUENCIES;
+  const Fra_Config_t config = {
+    .setpoint = FRA_SETPOINT,
+    .amplitude = FRA_AMPLITUDE,
+    .freq_mhz = freqs,
+    .points = sizeof(freqs) / sizeof(freqs[0]),
+    .settle_ms = FRA_SETTLE,
+    .settle_cycles = FRA_SETTLE_CYCLES,
+    .cycles = FRA_CYCLES,
+    .limit = 3 * FRA_SETPOINT,
+  };
+  Fra_Point_t point;
+  Fra_Result_t result;
+  uint32_t now = Application_WaitPeriod(Main_GetTickMillisec());
+
+  Controller_Reset();
+  Fra_Start(&config, now);
+
+  while (Fra_GetState() == FRA_RUNNING) {
+    now = Application_WaitPeriod(now);
+    velocity = Peripheral_Encoder_CalculateVelocity(now);
+    reference = Fra_Step(velocity, now);
+    control = Controller_PIController(&reference, &velocity, &now);
+    Peripheral_PWM_ActuateMotor(control);
+  }
+
+  for (uint32_t i = 0; Fra_GetPoint(i, &point) == 0; i++) {
+    printf("[fra] f=%lu mHz gain=%ld/1000 phase=%ld/10 deg a=%ld RPM\r\n",
+           (unsigned long)point.freq_mhz, (long)point.gain, (long)point.phase, (long)point.amplitude);
+  }
+
+  if (Fra_GetResult(&result) == 0) {
+    printf("[fra] %lu points: fc=%lu mHz PM=%ld/10 deg, f180=%lu mHz GM=%ld/1000\r\n",
+           (unsigned long)result.points, (unsigned long)result.crossover_mhz, (long)result.phase_margin,
+           (unsigned long)result.phase_crossover_mhz, (long)result.gain_margin);
+  } else {
+    printf("[fra] sweep aborted on the velocity limit\r\n");
+  }
+
+  // Resume from the setpoint
+  Controller_Reset();
+  reference = FRA_SETPOINT;
+  millisec = now;
+}
+#endif
+
 /* Run setup needed for all periodic tasks */
 void Application_Setup()
 {
   // Reset global variables
-  reference = 2000;
+  target = 2000;
+  reference = 0;
   velocity = 0;
   control = 0;
   millisec = 0;
@@ -22,8 +360,77 @@ void Application_Setup()
   // Initialise hardware
   Peripheral_GPIO_EnableMotor();
 
+#if FILTER_BENCH
+  Application_FilterBench();
+#endif
+
+#if PWM_STAIRCASE
+  // Measure the half-bridge as it is, before any linearization
+  Application_Staircase();
+#endif
+
+#if PWM_LINEARIZE
+  {
+    static const int32_t pwm_table[ACTUATOR_POINTS] = PWM_LINEARIZATION;
+    Actuator_SetLinearization(pwm_table);
+  }
+#endif
+  Peripheral_PWM_SetDither(PWM_DITHER);
+
+#if SYSID
+  // Identify the motor model before the feedforward uses it
+  Application_Identify();
+#endif
+
+#if COGGING
+  // Learn or align the compensation before the feedforward is enabled
+  Application_Calibrate();
+#endif
+
+  Peripheral_Encoder_SetObserver(VELOCITY_OBSERVER);
+
   // Initialize controller
   Controller_Reset();
+  Controller_SetFeedforward(&motor_model, FEEDFORWARD);
+  Controller_SetDisturbanceObserver(&motor_model, DISTURBANCE_OBSERVER);
+  Controller_SetSchedule(GAIN_SCHEDULE ? &gain_schedule : NULL);
+
+#if AUTOTUNE
+  // Commission the gains of this motor
+  Application_Autotune();
+#endif
+
+#if FRA
+  // Measure the margins of the loop as configured
+  Application_Analyze();
+#endif
+
+  // Supervise the control loop deadline
+  Monitor_Init();
+  Monitor_Configure(MONITOR_TASK_CTRL, PERIOD_CTRL);
+
+  // Trace every sample into the flight recorder, freeze it on a large
+  // tracking error or a missed deadline
+  Recorder_Init();
+  Recorder_SetErrorTrigger(RECORDER_ERROR);
+  Recorder_Arm(RECORDER_POST);
+
+#if ADAPT
+  // Follow the drift of the motor from the model in use
+  const Adapt_Config_t adapt_config = {ADAPT_ORDER, ADAPT_DECIMATION, ADAPT_LAMBDA, VELOCITY_ALPHA,
+                                       ADAPT_WARMUP, ADAPT_PUBLISH, motor_model};
+  Adapt_Init(&adapt_config);
+#endif
+
+#if POSITION_CONTROL
+  // Hold the start position, the first flip moves to POSITION_MOVE
+  Position_Init(0, &position_params);
+#endif
+
+  // Ramp the reference up to the first target
+  Trajectory_Init(reference);
+  Trajectory_Configure(TRAJ_PROFILE, TRAJ_ACCEL, TRAJ_JERK);
+  Trajectory_Start(target, millisec);
 }
 
 /* Define what to do in the infinite loop */
@@ -36,13 +443,28 @@ void Application_Loop()
   }
 
   // Get time
+  uint32_t millisec_prev = millisec;
   millisec = Main_GetTickMillisec();
+  if (Monitor_Release(MONITOR_TASK_CTRL, millisec) > 1)
+  {
+    // Keep the samples around the skipped cycles
+    Recorder_Trigger();
+  }
 
   // Every 4 sec ...
+#if COMPENSATE_SKIPPED
+  // ... including reference boundaries crossed during skipped cycles
+  if (((millisec / PERIOD_REF) - (millisec_prev / PERIOD_REF)) & 1u)
+#else
   if (millisec % PERIOD_REF == 0)
+#endif
   {
-    // Flip the direction of the reference
-    reference = -reference;
+    // Flip the direction of the target, the trajectory shapes the transition
+    target = -target;
+    Trajectory_Start(target, millisec);
+#if POSITION_CONTROL
+    Position_Move(target > 0 ? 0 : POSITION_MOVE);
+#endif
   }
 
   // Every 10 msec ...
@@ -51,11 +473,60 @@ void Application_Loop()
     // Calculate motor velocity
     velocity = Peripheral_Encoder_CalculateVelocity(millisec);
 
+#if ADAPT
+    // Apply the latest adapted model between two controller steps
+    if (Adapt_TakeModel(&motor_model) == 0)
+    {
+      Controller_SetFeedforward(&motor_model, FEEDFORWARD);
+      Controller_SetDisturbanceObserver(&motor_model, DISTURBANCE_OBSERVER);
+    }
+#endif
+
+#if POSITION_CONTROL
+    // The position loop sets the velocity reference
+    reference = Position_Update(Peripheral_Encoder_GetPosition(), millisec);
+#else
+    // Evaluate the reference profile
+    reference = Trajectory_Evaluate(millisec);
+#endif
+
+#if COGGING
+    // The friction and cogging of this angle as a feedforward, which the
+    // saturation and the disturbance observer account for
+    Controller_SetFeedforwardInput(Cogging_Compensate(Peripheral_Encoder_GetPosition(), reference, PERIOD_CTRL));
+#endif
+
     // Calculate control signal
     control = Controller_PIController(&reference, &velocity, &millisec);
 
     // Apply control signal to motor
     Peripheral_PWM_ActuateMotor(control);
+
+    // Record the sample with the latency from release to actuation
+    Recorder_Record(millisec, reference, velocity, control, encoder,
+                    Monitor_GetCycles(MONITOR_TASK_CTRL));
+
+#if ADAPT
+    // Fit the model in the slack after the actuation, a bounded number of
+    // samples per period so the next sample is never late
+    Adapt_Push(velocity, control, millisec, VELOCITY_ALPHA);
+    Adapt_Run(ADAPT_BUDGET);
+#endif
 		
 	}
+
+  if (Monitor_Complete(MONITOR_TASK_CTRL))
+  {
+    Recorder_Trigger();
+  }
+
+  // Report missed deadlines in the slack before the next sample
+  Monitor_Report();
+
+  // Print a frozen trace a few lines per period in the slack before the next
+  // sample, then start over
+  if (Recorder_IsFrozen() && Recorder_Dump(RECORDER_DUMP_LINES) == 0)
+  {
+    Recorder_Arm(RECORDER_POST);
+  }
 }
@@ -0,0 +1,179 @@
+/***
+ * Group: 8
+ *
+ * Members: Alice Ahlberg
+ *          Daniel Fjelkner
+ *          David Georgian Iosifescu
+ *
+ * Course code: MF2103
+ *
+ * Task description: Relay Autotuning
+ *                   Relay-feedback experiment and PI gain computation.
+ *
+ * Compiler: ARM GCC
+ *
+ * Other information: A cycle starts at each switch of the relay to its high
+ * output. The relay replaces the controller until the result is taken:
+ * the application feeds the measured velocity and applies the returned
+ * control before the first target.
+ *
+ * References: K. J. Astrom, T. Hagglund, Automatic tuning of simple
+ * regulators with specifications on phase and amplitude margins, 1984.
+ *
+ ***/
+
+#include "autotune.h"
+
+#define CONTROL_MAX 1073741823L
+#define CONTROL_MIN (-1073741824L)
+
+static Autotune_Config_t cfg;
+static Autotune_Result_t result;
+static Autotune_State_t state = AUTOTUNE_IDLE;
+
+static uint32_t t_start = 0;
+static uint32_t t_rise = 0;       // Start of the current cycle
+static uint32_t t_fall = 0;       // Switch to the low output in the current cycle
+static uint8_t high = 0;          // Relay output
+static uint8_t started = 0;       // A cycle boundary was seen
+static int32_t bias = 0;
+static int32_t v_min = 0, v_max = 0;
+
+// Sums over the measured cycles
+static uint32_t cycles = 0;
+static uint32_t sum_period = 0;
+static int64_t sum_amplitude = 0;
+
+static uint32_t Autotune_ISqrt(uint64_t x) {
+  uint64_t r = 0, bit = 1ULL << 62;
+
+  while (bit > x)
+    bit >>= 2;
+  while (bit) {
+    if (x >= r + bit) {
+      x -= r + bit;
+      r = (r >> 1) + bit;
+    } else {
+      r >>= 1;
+    }
+    bit >>= 2;
+  }
+  return (uint32_t)r;
+}
+
+static void Autotune_Finish(void) {
+  uint32_t tu = sum_period / AUTOTUNE_PERIODS;
+  int64_t a = sum_amplitude / AUTOTUNE_PERIODS;
+  int64_t h = cfg.hysteresis;
+
+  // Describing function of the relay with hysteresis
+  int64_t a_eff = a > h ? (int64_t)Autotune_ISqrt((uint64_t)(a * a - h * h)) : 0;
+  if (a_eff <= 0 || tu == 0) {
+    state = AUTOTUNE_FAILED;
+    return;
+  }
+
+  // Ku = 4d / (pi * a_eff), pi as 31416 / 10000
+  int64_t ku = 4LL * cfg.amplitude * 10000 / (31416LL * a_eff);
+
+  // Tyreus-Luyben: Kp = Ku / 3.2, Ki = Kp / Ti with Ti = 2.2 Tu in seconds
+  int64_t kp = ku * 10 / 32;
+  int64_t ki = kp * 1000 * 10 / (22LL * tu);
+
+  result.period_ms = tu;
+  result.amplitude = (int32_t)a;
+  result.ku = (int32_t)ku;
+  result.bias = bias;
+  result.gains.kp = (int32_t)kp;
+  result.gains.ki = (int32_t)ki;
+  state = AUTOTUNE_DONE;
+}
+
+void Autotune_Start(const Autotune_Config_t *config, uint32_t millisec) {
+  if (!config || config->amplitude <= 0) {
+    state = AUTOTUNE_FAILED;
+    return;
+  }
+
+  cfg = *config;
+  result = (Autotune_Result_t){0};
+  t_start = millisec;
+  t_rise = t_fall = millisec;
+  high = 0;
+  started = 0;
+  bias = cfg.bias;
+  cycles = 0;
+  sum_period = 0;
+  sum_amplitude = 0;
+  state = AUTOTUNE_RUNNING;
+}
+
+int32_t Autotune_Step(int32_t velocity, uint32_t millisec) {
+  if (state != AUTOTUNE_RUNNING)
+    return 0;
+
+  int32_t error = cfg.setpoint - velocity;
+
+  // Safety: give up on a runaway or a loop that never oscillates
+  if (millisec - t_start > cfg.timeout_ms || error > cfg.limit || error < -cfg.limit) {
+    state = AUTOTUNE_FAILED;
+    return 0;
+  }
+
+  if (velocity < v_min)
+    v_min = velocity;
+  if (velocity > v_max)
+    v_max = velocity;
+
+  if (high && error < -cfg.hysteresis) {
+    high = 0;
+    t_fall = millisec;
+  } else if (!high && error > cfg.hysteresis) {
+    high = 1;
+
+    // A full cycle ends at each switch to the high output
+    if (started) {
+      uint32_t period = millisec - t_rise;
+      uint32_t t_high = t_fall - t_rise;
+
+      // Centre the cycle: move the bias by half the on/off imbalance
+      if (period > 0)
+        bias += (int32_t)((int64_t)cfg.amplitude * ((int64_t)t_high * 2 - (int64_t)period) /
+                          (2 * (int64_t)period));
+
+      cycles++;
+      if (cycles > AUTOTUNE_SETTLE) {
+        sum_period += period;
+        sum_amplitude += (v_max - v_min) / 2;
+        if (cycles == AUTOTUNE_SETTLE + AUTOTUNE_PERIODS) {
+          Autotune_Finish();
+          return 0;
+        }
+      }
+    }
+
+    started = 1;
+    t_rise = millisec;
+    v_min = v_max = velocity;
+  }
+
+  int64_t u = (int64_t)bias + (high ? cfg.amplitude : -cfg.amplitude);
+  if (u > CONTROL_MAX)
+    u = CONTROL_MAX;
+  else if (u < CONTROL_MIN)
+    u = CONTROL_MIN;
+
+  return (int32_t)u;
+}
+
+Autotune_State_t Autotune_GetState(void) {
+  return state;
+}
+
+int32_t Autotune_GetResult(Autotune_Result_t *res) {
+  if (state != AUTOTUNE_DONE || !res)
+    return -1;
+
+  *res = result;
+  return 0;
+}
@@ -0,0 +1,93 @@
+/***
+ * Group: 8
+ *
+ * Members: Alice Ahlberg
+ *          Daniel Fjelkner
+ *          David Georgian Iosifescu
+ *
+ * Course code: MF2103
+ *
+ * Task description: Biquad Filter Cascade
+ *                   Q31 direct form I second-order sections for the velocity
+ *                   estimate.
+ *
+ * Compiler: ARM GCC
+ *
+ * Other information: On target with the CMSIS-DSP component the cascade runs
+ * on arm_biquad_cascade_df1_q31(). The reference implementation below
+ * follows the same arithmetic (64-bit accumulation, one truncating shift per
+ * stage, wrap-around) and the same state layout, so the host tools see the
+ * bit-exact output of the target.
+ *
+ * References: Course material MF2103, CMSIS-DSP documentation
+ *
+ ***/
+
+#include "biquad.h"
+
+int32_t Biquad_Init(Biquad_t *filter, const Biquad_Coeffs_t *coeffs) {
+  if (!filter || !coeffs || coeffs->stages == 0 || coeffs->stages > BIQUAD_MAX_STAGES ||
+      coeffs->post_shift < 0 || coeffs->post_shift > 31)
+    return -1;
+
+  filter->coeffs = coeffs;
+#if BIQUAD_CMSIS
+  // The coefficients are only read, older CMSIS-DSP versions declare them
+  // without const
+  arm_biquad_cascade_df1_init_q31(&filter->inst, coeffs->stages, (q31_t *)coeffs->coeffs,
+                                  filter->state, coeffs->post_shift);
+#endif
+  Biquad_Reset(filter, 0);
+  return 0;
+}
+
+void Biquad_Reset(Biquad_t *filter, int32_t value) {
+  if (!filter)
+    return;
+
+  for (uint32_t i = 0; i < 4 * BIQUAD_MAX_STAGES; i++)
+    filter->state[i] = value;
+}
+
+void Biquad_Process(Biquad_t *filter, const int32_t *in, int32_t *out, uint32_t count) {
+  if (!filter || !filter->coeffs || !in || !out)
+    return;
+
+#if BIQUAD_CMSIS
+  arm_biquad_cascade_df1_q31(&filter->inst, (q31_t *)in, out, count);
+#else
+  const uint32_t shift = 31u - (uint32_t)filter->coeffs->post_shift;
+  const int32_t *c = filter->coeffs->coeffs;
+  int32_t *s = filter->state;
+  const int32_t *src = in;
+
+  // Stage by stage over the block, as CMSIS-DSP does
+  for (uint32_t stage = 0; stage < filter->coeffs->stages; stage++) {
+    int32_t x1 = s[0], x2 = s[1], y1 = s[2], y2 = s[3];
+
+    for (uint32_t n = 0; n < count; n++) {
+      int32_t x = src[n];
+      int64_t acc = (int64_t)c[0] * x;
+      acc += (int64_t)c[1] * x1;
+      acc += (int64_t)c[2] * x2;
+      acc += (int64_t)c[3] * y1;
+      acc += (int64_t)c[4] * y2;
+
+      int32_t y = (int32_t)(acc >> shift);
+      x2 = x1;
+      x1 = x;
+      y2 = y1;
+      y1 = y;
+      out[n] = y;
+    }
+
+    s[0] = x1;
+    s[1] = x2;
+    s[2] = y1;
+    s[3] = y2;
+    s += 4;
+    c += 5;
+    src = out;
+  }
+#endif
+}
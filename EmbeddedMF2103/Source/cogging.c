@@ -0,0 +1,338 @@
+/***
+ * Group: 8
+ *
+ * Members: Alice Ahlberg
+ *          Daniel Fjelkner
+ *          David Georgian Iosifescu
+ *
+ * Course code: MF2103
+ *
+ * Task description: Friction and Cogging Compensation
+ *                   Table of the control needed over the angle in each
+ *                   direction, learned in a slow position-controlled sweep.
+ *
+ * Compiler: ARM GCC
+ *
+ * Other information: The table is kept in the angle of the calibration
+ * and read with the shift found by the last alignment. Storing it is left
+ * to the application (Peripheral_Flash_Write()), which also gives the
+ * encoder position, so the table follows the rotor across a reboot.
+ *
+ * References: Course material MF2103, B. Armstrong-Helouvry et al., A
+ * Survey of Models, Analysis Tools and Compensation Methods for the Control
+ * of Machines with Friction, Automatica 30(7), 1994
+ *
+ ***/
+
+#include <stddef.h>
+
+#include "cogging.h"
+#include "peripherals.h"
+
+#define BIN_COUNTS (RESOLUTION / COGGING_BINS)
+#define BIN_MASK (COGGING_BINS - 1U)
+#define ANGLE_MASK (RESOLUTION - 1U)
+#define CORRELATION_SHIFT 8   // Keeps the products of the cross-correlation in 64 bits
+#define RAMP_Q 16             // Fractional bits of the position ramp
+
+#if (COGGING_BINS & BIN_MASK) != 0 || (RESOLUTION % COGGING_BINS) != 0
+#error "COGGING_BINS must be a power of two dividing RESOLUTION"
+#endif
+
+static Cogging_Config_t cfg;
+static Cogging_Result_t result;
+static volatile Cogging_State_t state = COGGING_IDLE;
+static Cogging_Table_t stored;        // In the angle of the calibration
+static uint8_t loaded = 0;            // Table present, calibrated or from flash
+static uint8_t valid = 0;             // Table in a known angle, may be applied
+static uint32_t shift = 0;            // Calibration angle minus the current one, in counts
+static int32_t blend_rpm = 0;         // 0 while disabled
+static int32_t mean[2];               // Mean of the table per direction
+
+// Sweep
+static int64_t sum[2][COGGING_BINS];
+static uint32_t count[2][COGGING_BINS];
+static uint32_t t_start = 0;
+static uint32_t t_prev = 0;
+static uint32_t t_phase = 0;          // Start of the current direction
+static int64_t p_prev = 0;
+static int64_t p_start = 0;           // Position when the sampling started
+static uint8_t dir = 0;               // 0 forward, 1 reverse
+static uint8_t sampling = 0;
+
+// Position loop of the sweep
+static int64_t ramp = 0;              // Position reference in counts, Q RAMP_Q
+static int64_t ramp_rate = 0;         // Counts per millisecond, Q RAMP_Q
+static int64_t kp = 0;                // Control per count
+static int64_t ki = 0;                // Control per count and second
+static int64_t integral = 0;          // Control units
+static int32_t viscous = 0;           // Control holding the speed without friction
+static int32_t u_prev = 0;            // Control applied since the previous step
+
+static uint32_t Cogging_Bin(int64_t position) {
+  return (((uint32_t)position + shift) & ANGLE_MASK) / BIN_COUNTS;
+}
+
+static uint32_t Cogging_Checksum(const Cogging_Table_t *t) {
+  const uint32_t *w = (const uint32_t *)t;
+  uint32_t h = 2166136261u;
+
+  for (size_t i = 0; i < offsetof(Cogging_Table_t, checksum) / sizeof(uint32_t); i++) {
+    h ^= w[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+/* Shift of the stored forward row that best matches the measured one */
+static uint32_t Cogging_Correlate(const int32_t *row) {
+  int64_t mean_r = 0, mean_t = 0, best = INT64_MIN;
+  uint32_t best_s = 0;
+
+  for (uint32_t b = 0; b < COGGING_BINS; b++) {
+    mean_r += row[b];
+    mean_t += stored.table[0][b];
+  }
+  mean_r /= COGGING_BINS;
+  mean_t /= COGGING_BINS;
+
+  for (uint32_t s = 0; s < COGGING_BINS; s++) {
+    int64_t corr = 0;
+    for (uint32_t b = 0; b < COGGING_BINS; b++)
+      corr += ((row[b] - mean_r) >> CORRELATION_SHIFT) *
+              ((stored.table[0][(b + s) & BIN_MASK] - mean_t) >> CORRELATION_SHIFT);
+    if (corr > best) {
+      best = corr;
+      best_s = s;
+    }
+  }
+  return best_s * BIN_COUNTS;
+}
+
+static void Cogging_Summarize(void) {
+  result.ripple = 0;
+  for (uint32_t d = 0; d < 2; d++) {
+    int64_t sum_d = 0;
+    int32_t lo = stored.table[d][0], hi = stored.table[d][0];
+    for (uint32_t b = 0; b < COGGING_BINS; b++) {
+      int32_t v = stored.table[d][b];
+      sum_d += v;
+      lo = v < lo ? v : lo;
+      hi = v > hi ? v : hi;
+    }
+    result.friction[d] = (int32_t)(sum_d / COGGING_BINS);
+    mean[d] = result.friction[d];
+    if (hi - lo > result.ripple)
+      result.ripple = hi - lo;
+  }
+  result.shift = shift;
+}
+
+static void Cogging_Finish(void) {
+  uint32_t rows = cfg.mode == COGGING_CALIBRATE ? 2 : 1;
+  int32_t row[COGGING_BINS];
+
+  for (uint32_t d = 0; d < rows; d++)
+    for (uint32_t b = 0; b < COGGING_BINS; b++)
+      if (count[d][b] == 0) {
+        state = COGGING_FAILED;
+        return;
+      }
+
+  if (cfg.mode == COGGING_CALIBRATE) {
+    // Only the friction and cogging remain, in the direction of the motion
+    for (uint32_t b = 0; b < COGGING_BINS; b++) {
+      stored.table[0][b] = (int32_t)(sum[0][b] / count[0][b]) - viscous;
+      stored.table[1][b] = (int32_t)(sum[1][b] / count[1][b]) + viscous;
+    }
+    loaded = 1;
+  } else {
+    // The row is in the current angle, find the one of the stored table
+    for (uint32_t b = 0; b < COGGING_BINS; b++)
+      row[b] = (int32_t)(sum[0][b] / count[0][b]);
+    shift = Cogging_Correlate(row);
+  }
+
+  valid = 1;
+  Cogging_Summarize();
+  state = COGGING_DONE;
+}
+
+int32_t Cogging_Start(const Cogging_Config_t *config, int64_t position, uint32_t millisec) {
+  if (!config || config->speed <= 0 || config->revolutions == 0 || config->timeout_ms == 0 ||
+      config->bandwidth == 0 || config->model.gain <= 0 || (config->mode == COGGING_ALIGN && !loaded))
+    return -1;
+
+  cfg = *config;
+  valid = 0;
+  blend_rpm = 0;
+  shift = 0;
+  for (uint32_t d = 0; d < 2; d++)
+    for (uint32_t b = 0; b < COGGING_BINS; b++) {
+      sum[d][b] = 0;
+      count[d][b] = 0;
+    }
+
+  // Loop crossing over at the bandwidth on the motor gain in counts per second
+  kp = (int64_t)cfg.bandwidth * MOTOR_CONTROL_SCALE * 60 / ((int64_t)cfg.model.gain * RESOLUTION);
+  ki = kp * cfg.bandwidth / 4;
+  viscous = (int32_t)((int64_t)cfg.speed * MOTOR_CONTROL_SCALE / cfg.model.gain);
+  ramp_rate = ((int64_t)cfg.speed * RESOLUTION << RAMP_Q) / 60000;
+  ramp = position * (1 << RAMP_Q);
+  integral = cfg.model.friction;
+  u_prev = 0;
+
+  result.samples = 0;
+  t_start = millisec;
+  t_prev = millisec;
+  t_phase = millisec;
+  p_prev = position;
+  dir = 0;
+  sampling = 0;
+  state = COGGING_RUNNING;
+  return 0;
+}
+
+int32_t Cogging_Step(int64_t position, uint32_t millisec) {
+  if (state != COGGING_RUNNING)
+    return 0;
+
+  uint32_t dt = millisec - t_prev;
+  t_prev = millisec;
+  if (millisec - t_start >= cfg.timeout_ms) {
+    state = COGGING_FAILED;
+    return 0;
+  }
+
+  if (sampling) {
+    // The control was held between both positions, credit the angle halfway
+    uint32_t b = Cogging_Bin(p_prev + (position - p_prev) / 2);
+    sum[dir][b] += u_prev;
+    count[dir][b]++;
+    result.samples++;
+
+    int64_t travelled = position - p_start;
+    if (travelled < 0)
+      travelled = -travelled;
+    if (travelled >= (int64_t)cfg.revolutions * RESOLUTION) {
+      if (dir == 0 && cfg.mode == COGGING_CALIBRATE) {
+        // Reverse from here, the friction held by the integral changes sign
+        dir = 1;
+        sampling = 0;
+        t_phase = millisec;
+        ramp = position * (1 << RAMP_Q);
+        integral = -integral;
+      } else {
+        Cogging_Finish();
+        return 0;
+      }
+    }
+  } else if (millisec - t_phase >= cfg.settle_ms) {
+    sampling = 1;
+    p_start = position;
+  }
+
+  p_prev = position;
+
+  // Advance the ramp and close the position loop on it
+  int64_t sign = dir ? -1 : 1;
+  ramp += sign * ramp_rate * dt;
+  int64_t e = (ramp >> RAMP_Q) - position;
+  if (e > RESOLUTION || e < -RESOLUTION) {
+    state = COGGING_FAILED;
+    return 0;
+  }
+
+  integral += ki * e * dt / 1000;
+  if (integral > MOTOR_CONTROL_SCALE / 2)
+    integral = MOTOR_CONTROL_SCALE / 2;
+  else if (integral < -MOTOR_CONTROL_SCALE / 2)
+    integral = -MOTOR_CONTROL_SCALE / 2;
+
+  int64_t u = sign * viscous + kp * e + integral;
+  if (u > MOTOR_CONTROL_SCALE)
+    u = MOTOR_CONTROL_SCALE;
+  else if (u < -MOTOR_CONTROL_SCALE)
+    u = -MOTOR_CONTROL_SCALE;
+  u_prev = (int32_t)u;
+  return u_prev;
+}
+
+Cogging_State_t Cogging_GetState(void) {
+  return state;
+}
+
+int32_t Cogging_GetResult(Cogging_Result_t *r) {
+  if (!r || state != COGGING_DONE)
+    return -1;
+
+  *r = result;
+  return 0;
+}
+
+int32_t Cogging_Load(const Cogging_Table_t *table) {
+  if (!table || table->magic != COGGING_MAGIC || table->bins != COGGING_BINS ||
+      table->checksum != Cogging_Checksum(table))
+    return -1;
+
+  stored = *table;
+  Cogging_Summarize();
+  loaded = 1;
+  valid = 0;
+  blend_rpm = 0;
+  shift = 0;
+  return 0;
+}
+
+int32_t Cogging_Save(Cogging_Table_t *table) {
+  if (!table || !valid)
+    return -1;
+
+  stored.magic = COGGING_MAGIC;
+  stored.bins = COGGING_BINS;
+  stored.checksum = Cogging_Checksum(&stored);
+  *table = stored;
+  return 0;
+}
+
+int32_t Cogging_Enable(int32_t blend) {
+  if (blend < 0 || (blend > 0 && !valid))
+    return -1;
+
+  blend_rpm = blend;
+  return 0;
+}
+
+int32_t Cogging_Compensate(int64_t position, int32_t reference, uint32_t period) {
+  if (blend_rpm == 0 || reference == 0)
+    return 0;
+
+  uint32_t d = reference < 0;
+  const int32_t *t = stored.table[d];
+  int32_t speed = reference < 0 ? -reference : reference;
+  int64_t span = (int64_t)speed * RESOLUTION * period / 60000;
+  int32_t c;
+
+  if (span >= RESOLUTION) {
+    c = mean[d];
+  } else if (span >= BIN_COUNTS) {
+    // Mean of the bins ahead in the direction of motion
+    uint32_t i = Cogging_Bin(position), n = (uint32_t)(span / BIN_COUNTS) + 1U;
+    uint32_t step = d ? BIN_MASK : 1U;
+    int64_t acc = 0;
+    for (uint32_t k = 0; k < n; k++, i = (i + step) & BIN_MASK)
+      acc += t[i];
+    c = (int32_t)(acc / n);
+  } else {
+    // Interpolate between the centres of the two nearest bins
+    uint32_t angle = ((uint32_t)position + shift - BIN_COUNTS / 2) & ANGLE_MASK;
+    uint32_t i = angle / BIN_COUNTS;
+    int64_t frac = angle % BIN_COUNTS;
+    c = t[i] + (int32_t)(((int64_t)t[(i + 1) & BIN_MASK] - t[i]) * frac / BIN_COUNTS);
+  }
+
+  // Fade out towards standstill
+  if (speed < blend_rpm)
+    c = (int32_t)((int64_t)c * speed / blend_rpm);
+  return c;
+}
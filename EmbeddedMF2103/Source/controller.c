@@ -19,9 +19,10 @@
  ***/
 
 #include "controller.h"
+#include <stddef.h>
 #include <stdint.h>
 
-// Controller gains
+// Default controller gains
 // Kp: [control units / RPM]
 // Ki: [control units / (RPM * second)]
 #define KP 300000
@@ -35,14 +36,130 @@ static int64_t integrator = 0;
 static uint32_t time_prev = 0;
 static uint8_t first_call_after_reset = 1;
 
+// Parameters in use, and the staging buffer they are taken over from
+static const Controller_Params_t defaults = {{KP, KI}, CONTROL_MAX, CONTROL_MIN};
+static Controller_Params_t params = {{KP, KI}, CONTROL_MAX, CONTROL_MIN};
+static volatile Controller_Params_t staged;
+static volatile uint8_t staged_ready = 0;
+
+// Changes of the configuration and resets, read with the steps
+static volatile uint32_t generation = 0;
+
+static void Controller_TakeParams(void) {
+  if (staged_ready) {
+    params.gains.kp = staged.gains.kp;
+    params.gains.ki = staged.gains.ki;
+    params.control_max = staged.control_max;
+    params.control_min = staged.control_min;
+    staged_ready = 0;
+    generation++;
+  }
+}
+
+// Feedforward gains
+// kv: [control units / RPM]
+// ka: [control units / (RPM / ms)]
+// kf: [control units]
+static int32_t ff_kv = 0;
+static int32_t ff_ka = 0;
+static int32_t ff_kf = 0;
+static int32_t ff_input = 0; // External term, Controller_SetFeedforwardInput()
+static int32_t ref_prev = 0;
+
+// Disturbance observer
+// dob_kv: [control units / RPM]
+// dob_bw: [rad/s], 0 when disabled
+static int32_t dob_kv = 0;
+static int32_t dob_tau = 0;
+static int32_t dob_kf = 0;
+static uint32_t dob_bw = 0;
+static int64_t dob_estimate = 0;
+static int32_t meas_prev = 0;
+static int32_t output_prev = 0;
+
+static int64_t Controller_Disturbance(int32_t meas, uint32_t dt_ms) {
+  // Control the measured motion took over the last step, in the nominal model
+  int64_t u_eq = (int64_t)dob_kv * meas +
+                 (int64_t)dob_kv * dob_tau * (meas - meas_prev) / (int64_t)dt_ms;
+  if (meas > 0)
+    u_eq += dob_kf;
+  else if (meas < 0)
+    u_eq -= dob_kf;
+
+  // First-order low-pass at the bandwidth, g = dt / (dt + 1 / bw)
+  int64_t g = ((int64_t)dt_ms * dob_bw << 16) / (1000 + (int64_t)dt_ms * dob_bw);
+  dob_estimate += ((output_prev - u_eq) - dob_estimate) * g >> 16;
+
+  // The compensation alone never exceeds the output range
+  if (dob_estimate > params.control_max)
+    dob_estimate = params.control_max;
+  else if (dob_estimate < params.control_min)
+    dob_estimate = params.control_min;
+
+  return dob_estimate;
+}
+
+// Gain schedule, NULL when the gains are used unscaled
+static const Controller_Schedule_t *schedule;
+static Controller_Schedule_t schedule_copy; // Set by Controller_SetConfig()
+
+/* Interpolate the gain factors without a branch: the speed is clamped with
+   masks so that the segment index stays within the table and the fraction
+   reaches a full segment at the last breakpoint. */
+static Controller_ScheduleFactor_t Controller_Schedule(int32_t ref, int32_t meas) {
+  const uint32_t shift = schedule->shift;
+  const Controller_ScheduleFactor_t *row = schedule->factor[(uint32_t)ref >> 31];
+  const uint32_t last = CONTROLLER_SCHEDULE_POINTS - 2;
+
+  // |meas|, INT32_MIN gives 2^31 and is clamped below
+  uint32_t sign = (uint32_t)(meas >> 31);
+  uint32_t speed = ((uint32_t)meas ^ sign) - sign;
+
+  // speed = min(speed, top)
+  uint32_t top = (last + 1) << shift;
+  uint32_t over = 0u - (uint32_t)(speed > top);
+  speed -= (speed - top) & over;
+
+  // i = min(speed >> shift, last)
+  uint32_t i = speed >> shift;
+  i -= (i - last) & (0u - (uint32_t)(i > last));
+  int32_t frac = (int32_t)(speed - (i << shift));
+
+  int32_t kp = row[i].kp + (((row[i + 1].kp - row[i].kp) * frac) >> shift);
+  int32_t ki = row[i].ki + (((row[i + 1].ki - row[i].ki) * frac) >> shift);
+  return (Controller_ScheduleFactor_t){(uint16_t)kp, (uint16_t)ki};
+}
+
+static int64_t Controller_Feedforward(int32_t ref, uint32_t dt_ms) {
+  int64_t u = (int64_t)ff_kv * (int64_t)ref + ff_input;
+
+  // Acceleration from the reference derivative
+  u += (int64_t)ff_ka * (int64_t)(ref - ref_prev) / (int64_t)dt_ms;
+  ref_prev = ref;
+
+  if (ref > 0)
+    u += ff_kf;
+  else if (ref < 0)
+    u -= ff_kf;
+
+  return u;
+}
+
 int32_t Controller_PIController(const int32_t *ref, const int32_t *meas,
                                 const uint32_t *ms) {
   if (!ref || !meas || !ms)
     return 0;
 
+  // New parameters only apply at a step boundary
+  Controller_TakeParams();
+
   // First call: initialize timing
   if (first_call_after_reset) {
     time_prev = *ms;
+    ref_prev = *ref;
+    meas_prev = *meas;
+    output_prev = 0;
+    dob_estimate = 0;
     integrator = 0;
     first_call_after_reset = 0;
     return 0;
@@ -59,33 +176,191 @@ int32_t Controller_PIController(const int32_t *ref, const int32_t *meas,
   // Error in RPM
   int32_t error = *ref - *meas;
 
+  // Scheduled gains, Q12 factors applied in 64-bit
+  int64_t kp = params.gains.kp;
+  int64_t ki = params.gains.ki;
+  if (schedule) {
+    Controller_ScheduleFactor_t f = Controller_Schedule(*ref, *meas);
+    kp = (kp * f.kp) >> 12;
+    ki = (ki * f.ki) >> 12;
+  }
+
   // Proportional term (calc in 64-bit to avoid overflow)
-  int64_t p_term = (int64_t)KP * (int64_t)error;
+  int64_t p_term = kp * (int64_t)error;
 
   // Integral term
   // I += Ki * error * dt
   // dt = dt_ms / 1000
-  int64_t i_increment = (int64_t)KI * (int64_t)error * (int64_t)dt_ms / 1000;
+  int64_t i_increment = ki * (int64_t)error * (int64_t)dt_ms / 1000;
 
   integrator += i_increment;
 
+  // Feedforward term, plus the load compensation
+  int64_t ff_term = Controller_Feedforward(*ref, dt_ms);
+  if (dob_bw)
+    ff_term += Controller_Disturbance(*meas, dt_ms);
+
   // PI output
-  int64_t control_64 = p_term + integrator;
+  int64_t control_64 = p_term + integrator + ff_term;
 
   // Saturate output and update integrator (anti-windup)
-  if (control_64 > CONTROL_MAX) {
-    control_64 = CONTROL_MAX;
-    integrator = CONTROL_MAX - p_term;
-  } else if (control_64 < CONTROL_MIN) {
-    control_64 = CONTROL_MIN;
-    integrator = CONTROL_MIN - p_term;
+  // The integrator takes the headroom left by the P and feedforward terms.
+  // When they saturate the output on their own (e.g. the acceleration term
+  // of a reference step) the integrator keeps its previous value instead of
+  // winding up in the opposite direction. The plain PI law keeps the
+  // back-calculation to the limit minus the P term.
+  uint8_t ff_active = ff_kv || ff_ka || ff_kf || ff_input || dob_bw;
+  if (control_64 > params.control_max) {
+    int64_t headroom = params.control_max - p_term - ff_term;
+    control_64 = params.control_max;
+    integrator = (headroom >= 0 || !ff_active) ? headroom : integrator - i_increment;
+  } else if (control_64 < params.control_min) {
+    int64_t headroom = params.control_min - p_term - ff_term;
+    control_64 = params.control_min;
+    integrator = (headroom <= 0 || !ff_active) ? headroom : integrator - i_increment;
   }
 
+  meas_prev = *meas;
+  output_prev = (int32_t)control_64;
   return (int32_t)control_64;
 }
 
 void Controller_Reset(void) {
   integrator = 0;
   time_prev = 0;
+  ref_prev = 0;
+  meas_prev = 0;
+  output_prev = 0;
+  dob_estimate = 0;
+  ff_input = 0;
   first_call_after_reset = 1;
+  Controller_TakeParams();
+  generation++;
+}
+
+void Controller_SetFeedforward(const MotorModel_t *model, uint8_t terms) {
+  generation++;
+  if (!model || model->gain <= 0) {
+    ff_kv = 0;
+    ff_ka = 0;
+    ff_kf = 0;
+    return;
+  }
+
+  int32_t kv = (int32_t)(MOTOR_CONTROL_SCALE / model->gain);
+
+  ff_kv = (terms & CONTROLLER_FF_VELOCITY) ? kv : 0;
+  ff_ka = (terms & CONTROLLER_FF_ACCEL) ? kv * (int32_t)model->tau_ms : 0;
+  ff_kf = (terms & CONTROLLER_FF_FRICTION) ? model->friction : 0;
+}
+
+void Controller_SetFeedforwardInput(int32_t control) {
+  ff_input = control;
+}
+
+void Controller_SetDisturbanceObserver(const MotorModel_t *model, uint32_t bandwidth) {
+  generation++;
+  if (!model || model->gain <= 0 || bandwidth == 0) {
+    dob_bw = 0;
+    dob_estimate = 0;
+    return;
+  }
+
+  dob_kv = (int32_t)(MOTOR_CONTROL_SCALE / model->gain);
+  dob_tau = (int32_t)model->tau_ms;
+  dob_kf = model->friction;
+  dob_bw = bandwidth;
+}
+
+int32_t Controller_GetDisturbance(void) {
+  return dob_bw ? (int32_t)dob_estimate : 0;
+}
+
+void Controller_SetSchedule(const Controller_Schedule_t *s) {
+  schedule = (s && s->shift >= 1 && s->shift <= 14) ? s : NULL;
+  generation++;
+}
+
+int32_t Controller_SetParams(const Controller_Params_t *p) {
+  if (!p)
+    p = &defaults;
+
+  if (staged_ready || p->control_max <= 0 || p->control_min >= 0)
+    return -1;
+
+  staged.gains.kp = p->gains.kp;
+  staged.gains.ki = p->gains.ki;
+  staged.control_max = p->control_max;
+  staged.control_min = p->control_min;
+
+  // Publish after the set is written, the flag is the only shared state
+  staged_ready = 1;
+  return 0;
+}
+
+int32_t Controller_SetGains(const Controller_Gains_t *g) {
+  Controller_Params_t p;
+
+  Controller_GetParams(&p);
+  p.gains = g ? *g : defaults.gains;
+  return Controller_SetParams(&p);
+}
+
+void Controller_GetParams(Controller_Params_t *p) {
+  if (!p)
+    return;
+
+  // The controller only writes its set while one is staged, and never
+  // writes the staged one
+  if (staged_ready) {
+    p->gains.kp = staged.gains.kp;
+    p->gains.ki = staged.gains.ki;
+    p->control_max = staged.control_max;
+    p->control_min = staged.control_min;
+  } else {
+    *p = params;
+  }
+}
+
+uint32_t Controller_GetGeneration(void) {
+  return generation;
+}
+
+void Controller_GetConfig(Controller_Config_t *config) {
+  if (!config)
+    return;
+
+  config->generation = generation;
+  config->params = params;
+  config->ff_kv = ff_kv;
+  config->ff_ka = ff_ka;
+  config->ff_kf = ff_kf;
+  config->dob_kv = dob_kv;
+  config->dob_tau = dob_tau;
+  config->dob_kf = dob_kf;
+  config->dob_bw = dob_bw;
+  config->scheduled = schedule ? 1u : 0u;
+  if (schedule)
+    config->schedule = *schedule;
+  else
+    config->schedule = (Controller_Schedule_t){0};
+}
+
+int32_t Controller_SetConfig(const Controller_Config_t *config) {
+  if (!config || config->params.control_max <= 0 || config->params.control_min >= 0)
+    return -1;
+
+  staged_ready = 0;
+  params = config->params;
+  ff_kv = config->ff_kv;
+  ff_ka = config->ff_ka;
+  ff_kf = config->ff_kf;
+  dob_kv = config->dob_kv;
+  dob_tau = config->dob_tau;
+  dob_kf = config->dob_kf;
+  dob_bw = config->dob_bw;
+  schedule_copy = config->schedule;
+  schedule = (config->scheduled && schedule_copy.shift >= 1 && schedule_copy.shift <= 14) ? &schedule_copy : NULL;
+  generation = config->generation;
+  return 0;
 }
@@ -0,0 +1,280 @@
+/***
+ * Group: 8
+ *
+ * Members: Alice Ahlberg
+ *          Daniel Fjelkner
+ *          David Georgian Iosifescu
+ *
+ * Course code: MF2103
+ *
+ * Task description: Frequency-Response Analyzer
+ *                   Swept-sine measurement of the loop gain and of the
+ *                   stability margins of the velocity loop.
+ *
+ * Compiler: ARM GCC
+ *
+ * Other information: Phases are in 2^32 per turn. The sine of the reference
+ * and the magnitude and angle of the demodulated phasors all come from one
+ * CORDIC (rotation and vectoring modes), so no trigonometric table or
+ * division is needed per sample. The analyzer only sets the reference: the
+ * velocity controller under test closes the loop it measures.
+ *
+ * References: Course material MF2103, J. E. Volder, The CORDIC Trigonometric
+ * Computing Technique (1959)
+ *
+ ***/
+
+#include "fra.h"
+
+#if defined(__arm__)
+#include "cmsis_compiler.h"
+#define BARRIER() __DMB()
+#else
+#define BARRIER() __sync_synchronize()
+#endif
+
+#define CORDIC_STEPS 20
+#define CORDIC_GAIN 652032874L      // Product of cos(atan(2^-i)), Q30
+#define HALF_TURN 0x80000000u
+#define QUARTER_TURN (1L << 30)
+
+// atan(2^-i) in 2^32 per turn
+static const int32_t atan_table[CORDIC_STEPS] = {
+  536870912, 316933406, 167458907, 85004756, 42667331, 21354465, 10679838,
+  5340245, 2670163, 1335087, 667544, 333772, 166886, 83443, 41722, 20861,
+  10430, 5215, 2608, 1304};
+
+static Fra_Config_t cfg;
+static Fra_Result_t result;
+static volatile Fra_State_t state = FRA_IDLE;
+static Fra_Point_t points[FRA_MAX_POINTS];
+static volatile uint32_t count = 0;    // Points published
+
+static uint32_t t_start = 0;
+static uint32_t t_prev = 0;
+static uint32_t period = 0;      // Sampling period, from the first two steps
+static uint32_t freq_index = 0;  // Frequency being measured, cfg.points before the first
+static uint32_t phase = 0;
+static uint32_t wraps = 0;       // Periods since the frequency change
+static uint32_t samples = 0;
+static int64_t y_sin, y_cos, e_sin, e_cos; // Demodulated velocity and error, RPM Q15
+
+/* Sine and cosine of a phase, Q15 */
+static void Fra_SinCos(uint32_t ph, int32_t *s, int32_t *c) {
+  int32_t z = (int32_t)ph;
+  int32_t sign = 1;
+
+  // Rotate by half a turn into the convergence range of the CORDIC
+  if (z > QUARTER_TURN || z < -QUARTER_TURN) {
+    z = (int32_t)(ph + HALF_TURN);
+    sign = -1;
+  }
+
+  int32_t x = (int32_t)CORDIC_GAIN, y = 0;
+  for (uint32_t i = 0; i < CORDIC_STEPS; i++) {
+    int32_t xs = x >> i, ys = y >> i;
+    if (z >= 0) {
+      x -= ys;
+      y += xs;
+      z -= atan_table[i];
+    } else {
+      x += ys;
+      y -= xs;
+      z += atan_table[i];
+    }
+  }
+  *c = sign * ((x + (1 << 14)) >> 15);
+  *s = sign * ((y + (1 << 14)) >> 15);
+}
+
+/* Magnitude and angle of a phasor */
+static void Fra_Vector(int64_t re, int64_t im, int64_t *mag, uint32_t *angle) {
+  uint32_t shift = 0;
+  while (re >= (1L << 29) || re <= -(1L << 29) || im >= (1L << 29) || im <= -(1L << 29)) {
+    re >>= 1;
+    im >>= 1;
+    shift++;
+  }
+
+  int32_t x = (int32_t)re, y = (int32_t)im;
+  uint32_t z = 0;
+  if (x < 0) {
+    x = -x;
+    y = -y;
+    z = HALF_TURN;
+  }
+  for (uint32_t i = 0; i < CORDIC_STEPS; i++) {
+    int32_t xs = x >> i, ys = y >> i;
+    if (y > 0) {
+      x += ys;
+      y -= xs;
+      z += (uint32_t)atan_table[i];
+    } else {
+      x -= ys;
+      y += xs;
+      z -= (uint32_t)atan_table[i];
+    }
+  }
+  *mag = (((int64_t)x * CORDIC_GAIN) >> 30) << shift;
+  *angle = z;
+}
+
+/* Move to the next frequency a quarter of the sampling rate allows */
+static void Fra_Select(uint32_t next) {
+  while (next < cfg.points && period > 0 && (uint64_t)cfg.freq_mhz[next] * period * 4 >= 1000000)
+    next++;
+
+  freq_index = next;
+  phase = 0;
+  wraps = 0;
+  samples = 0;
+  y_sin = y_cos = e_sin = e_cos = 0;
+}
+
+/* Loop gain L = Y / E of the frequency just measured */
+static void Fra_Measure(void) {
+  int64_t mag_y, mag_e;
+  uint32_t ang_y, ang_e;
+  Fra_Point_t *p = &points[count];
+
+  // x = a sin(phase + theta) demodulates to (sum x sin, sum x cos) ~ n a / 2 (cos theta, sin theta)
+  Fra_Vector(y_sin, y_cos, &mag_y, &ang_y);
+  Fra_Vector(e_sin, e_cos, &mag_e, &ang_e);
+
+  p->freq_mhz = cfg.freq_mhz[freq_index];
+  p->gain = mag_e > 0 ? (int32_t)(mag_y * 1000 / mag_e) : 0;
+  p->phase = (int32_t)(((int64_t)(int32_t)(ang_y - ang_e) * 3600) >> 32);
+  p->amplitude = (int32_t)((2 * mag_y / (samples ? samples : 1)) >> 15);
+
+  // Unwrap along the sweep
+  if (count > 0) {
+    while (p->phase - points[count - 1].phase > 1800)
+      p->phase -= 3600;
+    while (p->phase - points[count - 1].phase < -1800)
+      p->phase += 3600;
+  }
+  BARRIER(); // The point is complete before a reader sees it
+  count++;
+}
+
+/* Interpolate the gain and phase crossovers */
+static void Fra_Margins(void) {
+  result.points = count;
+  result.crossover_mhz = 0;
+  result.phase_margin = 0;
+  result.phase_crossover_mhz = 0;
+  result.gain_margin = 0;
+
+  for (uint32_t i = 1; i < count; i++) {
+    const Fra_Point_t *a = &points[i - 1], *b = &points[i];
+    int64_t df = (int64_t)b->freq_mhz - a->freq_mhz;
+
+    if (result.crossover_mhz == 0 && a->gain >= 1000 && b->gain < 1000) {
+      int64_t num = a->gain - 1000, den = a->gain - b->gain;
+      result.crossover_mhz = (uint32_t)(a->freq_mhz + df * num / den);
+      result.phase_margin = (int32_t)(1800 + a->phase + ((int64_t)b->phase - a->phase) * num / den);
+    }
+    if (result.phase_crossover_mhz == 0 && a->phase > -1800 && b->phase <= -1800) {
+      int64_t num = a->phase + 1800, den = a->phase - b->phase;
+      int64_t gain = a->gain + ((int64_t)b->gain - a->gain) * num / den;
+      result.phase_crossover_mhz = (uint32_t)(a->freq_mhz + df * num / den);
+      result.gain_margin = gain > 0 ? (int32_t)(1000000 / gain) : 0;
+    }
+  }
+}
+
+int32_t Fra_Start(const Fra_Config_t *config, uint32_t millisec) {
+  if (!config || !config->freq_mhz || config->points == 0 || config->points > FRA_MAX_POINTS ||
+      config->amplitude <= 0 || config->cycles == 0)
+    return -1;
+
+  cfg = *config;
+  t_start = millisec;
+  t_prev = millisec;
+  period = 0;
+  count = 0;
+  Fra_Select(cfg.points);
+  state = FRA_RUNNING;
+  return 0;
+}
+
+int32_t Fra_Step(int32_t velocity, uint32_t millisec) {
+  if (state != FRA_RUNNING)
+    return cfg.setpoint;
+
+  if (velocity - cfg.setpoint > cfg.limit || velocity - cfg.setpoint < -cfg.limit) {
+    state = FRA_FAILED;
+    return cfg.setpoint;
+  }
+
+  uint32_t dt = millisec - t_prev;
+  t_prev = millisec;
+  if (period == 0)
+    period = dt;
+  if (millisec - t_start < cfg.settle_ms)
+    return cfg.setpoint;
+
+  if (freq_index == cfg.points) {
+    // First step of the sweep
+    Fra_Select(0);
+  } else {
+    uint32_t next = phase + (uint32_t)((uint64_t)cfg.freq_mhz[freq_index] * dt * 4294967296ULL / 1000000);
+    if (next < phase)
+      wraps++;
+    phase = next;
+
+    if (wraps >= cfg.settle_cycles + cfg.cycles) {
+      Fra_Measure();
+      Fra_Select(freq_index + 1);
+    }
+  }
+
+  if (freq_index >= cfg.points) {
+    Fra_Margins();
+    BARRIER();
+    state = FRA_DONE;
+    return cfg.setpoint;
+  }
+
+  int32_t s, c;
+  Fra_SinCos(phase, &s, &c);
+  int32_t reference = cfg.setpoint + (int32_t)(((int64_t)cfg.amplitude * s) >> 15);
+
+  // Demodulate over whole periods once the loop has settled on the frequency
+  if (wraps >= cfg.settle_cycles) {
+    int64_t y = velocity - cfg.setpoint;
+    int64_t e = reference - velocity;
+    y_sin += y * s;
+    y_cos += y * c;
+    e_sin += e * s;
+    e_cos += e * c;
+    samples++;
+  }
+  return reference;
+}
+
+Fra_State_t Fra_GetState(void) {
+  return state;
+}
+
+uint32_t Fra_GetPointCount(void) {
+  return count;
+}
+
+int32_t Fra_GetPoint(uint32_t i, Fra_Point_t *point) {
+  if (!point || i >= count)
+    return -1;
+
+  BARRIER();
+  *point = points[i];
+  return 0;
+}
+
+int32_t Fra_GetResult(Fra_Result_t *r) {
+  if (!r || state != FRA_DONE)
+    return -1;
+
+  BARRIER();
+  *r = result;
+  return 0;
+}
@@ -0,0 +1,150 @@
+/***
+ * Group: 8
+ *
+ * Members: Alice Ahlberg
+ *          Daniel Fjelkner
+ *          David Georgian Iosifescu
+ *
+ * Course code: MF2103
+ *
+ * Task description: Deadline Monitor
+ *                   Overrun detection and response-time statistics for the
+ *                   periodic tasks.
+ *
+ * Compiler: ARM GCC
+ *
+ * Other information: Response times are measured with the DWT cycle counter,
+ * release times with the millisecond tick.
+ *
+ * References: Course material MF2103
+ *
+ ***/
+
+#include "monitor.h"
+#include "main.h"
+#include <stdio.h>
+
+typedef struct {
+  Monitor_Stats_t stats;
+  uint32_t late_ms;          // Release delay counted as a lost period
+  uint32_t last_release_ms;
+  uint32_t start_cycles;
+  uint32_t period_cycles;
+  uint32_t wcrt_cycles;
+  uint32_t reported_overruns;
+  uint32_t reported_skipped;
+} Monitor_TaskState_t;
+
+static Monitor_TaskState_t tasks[MONITOR_TASK_COUNT];
+static uint32_t cycles_per_us = 1;
+
+void Monitor_Init(void) {
+  // Enable the cycle counter
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  cycles_per_us = SystemCoreClock / 1000000u;
+  if (cycles_per_us == 0)
+    cycles_per_us = 1;
+
+  for (uint32_t i = 0; i < MONITOR_TASK_COUNT; i++)
+    Monitor_Configure((Monitor_Task_t)i, 0);
+}
+
+void Monitor_Configure(Monitor_Task_t task, uint32_t period_ms) {
+  if (task >= MONITOR_TASK_COUNT)
+    return;
+
+  Monitor_TaskState_t *t = &tasks[task];
+  *t = (Monitor_TaskState_t){0};
+  t->stats.period_ms = period_ms;
+
+  // A release later than half a period is treated as a lost period
+  t->late_ms = period_ms + period_ms / 2;
+  t->period_cycles = period_ms * 1000u * cycles_per_us;
+}
+
+uint32_t Monitor_Release(Monitor_Task_t task, uint32_t millisec) {
+  if (task >= MONITOR_TASK_COUNT)
+    return 1;
+
+  Monitor_TaskState_t *t = &tasks[task];
+  uint32_t periods = 1;
+
+  t->start_cycles = DWT->CYCCNT;
+
+  if (t->stats.releases > 0) {
+    uint32_t dt_ms = millisec - t->last_release_ms;
+
+    // Divide only on the slow path, a nominal release costs one compare
+    if (dt_ms >= t->late_ms && t->stats.period_ms > 0) {
+      periods = (dt_ms + t->stats.period_ms / 2) / t->stats.period_ms;
+      t->stats.skipped += periods - 1;
+    }
+  }
+
+  t->last_release_ms = millisec;
+  t->stats.releases++;
+
+  return periods;
+}
+
+uint8_t Monitor_Complete(Monitor_Task_t task) {
+  if (task >= MONITOR_TASK_COUNT)
+    return 0;
+
+  Monitor_TaskState_t *t = &tasks[task];
+
+  // Unsigned difference handles counter wrap-around
+  uint32_t rt_cycles = DWT->CYCCNT - t->start_cycles;
+
+  if (rt_cycles > t->wcrt_cycles)
+    t->wcrt_cycles = rt_cycles;
+
+  t->stats.last_rt_us = rt_cycles / cycles_per_us;
+
+  if (t->period_cycles > 0 && rt_cycles > t->period_cycles) {
+    t->stats.overruns++;
+    return 1;
+  }
+  return 0;
+}
+
+uint32_t Monitor_GetCycles(Monitor_Task_t task) {
+  if (task >= MONITOR_TASK_COUNT)
+    return 0;
+
+  return DWT->CYCCNT - tasks[task].start_cycles;
+}
+
+void Monitor_GetStats(Monitor_Task_t task, Monitor_Stats_t *stats) {
+  if (task >= MONITOR_TASK_COUNT || !stats)
+    return;
+
+  *stats = tasks[task].stats;
+  stats->wcrt_us = tasks[task].wcrt_cycles / cycles_per_us;
+}
+
+void Monitor_Report(void) {
+  static const char *const names[MONITOR_TASK_COUNT] = {"ctrl", "ref"};
+  Monitor_Stats_t s;
+
+  for (uint32_t i = 0; i < MONITOR_TASK_COUNT; i++) {
+    Monitor_TaskState_t *t = &tasks[i];
+
+    if (t->stats.overruns == t->reported_overruns &&
+        t->stats.skipped == t->reported_skipped)
+      continue;
+
+    Monitor_GetStats((Monitor_Task_t)i, &s);
+    t->reported_overruns = s.overruns;
+    t->reported_skipped = s.skipped;
+
+    printf("[monitor] %s: period=%lu ms releases=%lu overruns=%lu "
+           "skipped=%lu wcrt=%lu us\r\n",
+           names[i], (unsigned long)s.period_ms, (unsigned long)s.releases,
+           (unsigned long)s.overruns, (unsigned long)s.skipped,
+           (unsigned long)s.wcrt_us);
+  }
+}
@@ -0,0 +1,91 @@
+/***
+ * Group: 8
+ *
+ * Members: Alice Ahlberg
+ *          Daniel Fjelkner
+ *          David Georgian Iosifescu
+ *
+ * Course code: MF2103
+ *
+ * Task description: Velocity Observer
+ *                   Tracking observer on the encoder position estimating
+ *                   velocity and acceleration.
+ *
+ * Compiler: ARM GCC
+ *
+ * Other information: Position in counts Q16, velocity in counts/ms Q32 and
+ * acceleration in counts/ms^2 Q32, all in 64-bit. The gains are the
+ * critically damped alpha-beta-gamma gains of a triple pole
+ * theta = 1 / (1 + bandwidth * T), recomputed when the period changes.
+ * Peripheral_Encoder_CalculateVelocity() runs it on the raw encoder delta
+ * in place of the low-pass filter.
+ *
+ * References: Course material MF2103, E. Brookner, Tracking and Kalman
+ * Filtering Made Easy (fading-memory filters)
+ *
+ ***/
+
+#include "observer.h"
+#include "peripherals.h"
+
+#define ONE (1 << 16)
+
+static int64_t x = 0;         // Position estimate relative to the last reading, counts Q16
+static int64_t v = 0;         // Velocity estimate, counts/ms Q32
+static int64_t a = 0;         // Acceleration estimate, counts/ms^2 Q32
+
+static uint32_t bw = 1;       // Bandwidth in rad/s
+static uint32_t gains_dt = 0; // Period the gains were computed for
+static int64_t alpha, beta, gamma2; // Q16, gamma2 is twice the gamma of the literature
+
+static void Observer_Gains(uint32_t dt_ms) {
+  int64_t theta = ((int64_t)ONE * 1000) / (1000 + (int64_t)bw * dt_ms);
+  int64_t d = ONE - theta;
+
+  alpha = ONE - ((theta * theta >> 16) * theta >> 16);
+  beta = (3 * (d * d >> 16) * (ONE + theta) >> 16) / 2;
+  gamma2 = (d * d >> 16) * d >> 16;
+  gains_dt = dt_ms;
+}
+
+void Observer_Init(uint32_t bandwidth, int32_t velocity) {
+  bw = bandwidth < 1 ? 1 : (bandwidth > 1000 ? 1000 : bandwidth);
+  gains_dt = 0;
+
+  x = 0;
+  v = (int64_t)velocity * ((int64_t)1 << 43) / 60000;
+  a = 0;
+}
+
+void Observer_Update(int32_t counts, uint32_t dt_ms) {
+  if (dt_ms == 0)
+    return;
+
+  if (dt_ms != gains_dt)
+    Observer_Gains(dt_ms);
+
+  const int64_t t = dt_ms;
+  const int64_t z = (int64_t)counts * ONE;
+
+  // Predict over dt
+  int64_t x_p = x + ((v * t + a * t * t / 2) >> 16);
+  int64_t v_p = v + a * t;
+
+  // Correct with the position residual, in counts Q16
+  int64_t r = z - x_p;
+  v = v_p + beta * r / t;
+  a += gamma2 * r / (t * t);
+
+  // Keep the position relative to this reading, only differences matter
+  x = x_p + (alpha * r >> 16) - z;
+}
+
+int32_t Observer_GetVelocity(void) {
+  // counts/ms Q32 to RPM: * 60000 / RESOLUTION / 2^32
+  return (int32_t)((v * 60000 / RESOLUTION + ((int64_t)1 << 31)) >> 32);
+}
+
+int32_t Observer_GetAcceleration(void) {
+  // counts/ms^2 Q32 to RPM/s: * 60000000 / RESOLUTION / 2^32
+  return (int32_t)((a * 60000 / RESOLUTION * 1000 + ((int64_t)1 << 31)) >> 32);
+}
@@ -22,11 +22,33 @@
 
 #include "peripherals.h"
 
-#define RESOLUTION 2048
+#include <string.h>
+
+#define PWM_GUARD 64       // Timer counts kept clear of the update event when stopping the DMA
+#define PWM_REVERSE 0x80000000u // Direction bit of the posted duty cycle
+#define PWM_PATTERN 16u    // Periods of the circular DMA pattern, refilled one half at a time
+#define PWM_BURST_BASE 13u // CCR1 in words from the start of the timer, first register of the burst
+#define PWM_DMA_REQUEST 5u // TIM3_UP on DMA1 channel 3
+#define PWM_DMA_PRIORITY 1 // Above the RTOS, the interrupt never calls it
+#define FLASH_KEY1 0x45670123u
+#define FLASH_KEY2 0xCDEF89ABu
+#define FLASH_SR_ERRORS (FLASH_SR_OPERR | FLASH_SR_PROGERR | FLASH_SR_WRPERR | FLASH_SR_PGAERR | \
+                         FLASH_SR_SIZERR | FLASH_SR_PGSERR | FLASH_SR_MISERR | FLASH_SR_FASTERR | \
+                         FLASH_SR_RDERR | FLASH_SR_OPTVERR)
 
 int16_t encoder; // Global variable, can be used for debugging purposes
 static int32_t rpm_filt = 0;
 static uint8_t vel_initialized = 0;
+static int32_t alpha_num = VELOCITY_ALPHA;
+static Biquad_t velocity_biquad;
+static uint8_t biquad_enabled = 0;
+static uint32_t observer_bw = 0; // 0 while the filters are used
+static int64_t position = 0;     // Sum of the encoder deltas in counts
+static uint32_t dither_bits = 0; // Fractional duty bits, 0 without dithering
+static uint8_t pwm_dma = 0;      // 1 once the DMA is started
+static volatile uint32_t pwm_duty = 0; // Duty in 1/2^dither_bits counts and PWM_REVERSE
+static uint32_t dither_acc = 0;        // Fraction carried over between periods, owned by the fill
+static uint32_t pwm_burst[PWM_PATTERN];   // CCR1 (low half-word) and CCR2 of each period, read by the DMA
 
 /* Enable both half-bridges to drive the motor */
 void Peripheral_GPIO_EnableMotor(void) {
@@ -42,6 +64,71 @@ void Peripheral_GPIO_DisableMotor(void) {
   return;
 }
 
+/* Wait with the interrupts masked until the counter is clear of the update
+   event and of its DMA burst, return the PRIMASK to restore */
+static uint32_t Peripheral_PWM_Guard(void) {
+  uint32_t primask = __get_PRIMASK();
+
+  for (;;) {
+    __disable_irq();
+    uint32_t cnt = TIM3->CNT;
+    if (cnt >= PWM_GUARD && cnt + PWM_GUARD <= TIM3->ARR)
+      return primask;
+    __set_PRIMASK(primask);
+  }
+}
+
+/* Sigma-delta on the posted duty cycle, for the given periods of the
+   pattern: the fraction accumulates over the periods, including those of
+   the previous call, and adds a count to the period it overflows in */
+static void Peripheral_PWM_Fill(uint32_t first, uint32_t count) {
+  uint32_t duty_fine = pwm_duty;
+  uint32_t level = duty_fine & ~PWM_REVERSE;
+  uint32_t mask = (1u << dither_bits) - 1u;
+  uint32_t arr = TIM3->ARR;
+
+  for (uint32_t i = first; i < first + count; i++) {
+    dither_acc += level & mask;
+    uint32_t duty_cycle = (level >> dither_bits) + (dither_acc >> dither_bits);
+    dither_acc &= mask;
+    if (duty_cycle > arr)
+      duty_cycle = arr;
+
+    // One store per period, the DMA never reads half of it
+    pwm_burst[i] = (duty_fine & PWM_REVERSE) ? duty_cycle << 16 : duty_cycle;
+  }
+}
+
+/* Post the duty cycle in 1/2^dither_bits counts as a single word, the DMA
+   interrupt takes it for the next half of the pattern. Without dithering
+   all periods are the same and the pattern is written here instead */
+static void Peripheral_PWM_Write(uint32_t duty_fine, uint8_t reverse) {
+  uint32_t arr = TIM3->ARR;
+
+  pwm_duty = reverse ? (duty_fine | PWM_REVERSE) : duty_fine;
+
+  if (!pwm_dma) {
+    // DMA not started yet
+    uint32_t duty_cycle = duty_fine > arr ? arr : duty_fine;
+    TIM3->CCR1 = reverse ? 0 : duty_cycle;
+    TIM3->CCR2 = reverse ? duty_cycle : 0;
+  } else if (dither_bits == 0) {
+    Peripheral_PWM_Fill(0, PWM_PATTERN);
+  }
+}
+
+/* Refill the half of the pattern the DMA has just read while it reads the
+   other one, from the duty cycle posted last */
+void DMA1_Channel3_IRQHandler(void) {
+  uint32_t isr = DMA1->ISR;
+
+  DMA1->IFCR = DMA_IFCR_CGIF3;
+  if (isr & DMA_ISR_TCIF3)
+    Peripheral_PWM_Fill(PWM_PATTERN / 2, PWM_PATTERN / 2);
+  else if (isr & DMA_ISR_HTIF3)
+    Peripheral_PWM_Fill(0, PWM_PATTERN / 2);
+}
+
 /* Drive the motor in both directions */
 void Peripheral_PWM_ActuateMotor(int32_t vel) {
   uint32_t arr = TIM3->ARR;
@@ -54,39 +141,136 @@ void Peripheral_PWM_ActuateMotor(int32_t vel) {
     vel = -VEL_MAX;
 
   if (vel == 0) {
-    TIM3->CCR1 = 0;
-    TIM3->CCR2 = 0;
+    Peripheral_PWM_Write(0, 0);
     return;
   }
 
-  int32_t duty_cycle;
-  uint32_t duty_abs;
+  // Duty cycle producing the requested torque across the deadband
+  vel = Actuator_Linearize(vel);
+
+  // Convert velocity (scaled 2^30) to duty cycle (timer counts), keeping
+  // the fractional bits of the dithering
+  // Formula: duty = (vel / 2^30) * ARR
+  uint64_t duty_abs = vel > 0 ? (uint64_t)vel : (uint64_t)(-(int64_t)vel);
+  uint32_t duty_fine = (uint32_t)((duty_abs * arr) >> (30 - dither_bits));
+
+  Peripheral_PWM_Write(duty_fine, vel < 0);
+}
+
+/* Start the compare updates by DMA at the update event, with the given
+   fractional duty cycle bits */
+int32_t Peripheral_PWM_SetDither(uint32_t bits) {
+  if (bits > PWM_DITHER_MAX)
+    return -1;
+
+  // Stop the bursts between two of them, so the timer starts the next with CCR1
+  if (pwm_dma) {
+    uint32_t primask = Peripheral_PWM_Guard();
+    TIM3->DIER &= ~TIM_DIER_UDE;
+    __set_PRIMASK(primask);
+    DMA1_Channel3->CCR &= ~DMA_CCR_EN;
+    NVIC_DisableIRQ(DMA1_Channel3_IRQn);
+  }
+
+  dither_bits = bits;
+  pwm_dma = 1;
+  pwm_duty = 0;
+  dither_acc = 0;
+  memset(pwm_burst, 0, sizeof(pwm_burst));
+  TIM3->CCR1 = 0;
+  TIM3->CCR2 = 0;
+
+  // Compare values and period only taken at the update event
+  TIM3->CCMR1 |= TIM_CCMR1_OC1PE | TIM_CCMR1_OC2PE;
+  TIM3->CR1 |= TIM_CR1_ARPE;
+
+  // Each update requests a burst of two words through DMAR into CCR1 and
+  // CCR2, read circularly from the pattern; with dithering the half and
+  // complete transfer interrupts refill the half just read
+  RCC->AHB1ENR |= RCC_AHB1ENR_DMA1EN;
+  DMA1_CSELR->CSELR = (DMA1_CSELR->CSELR & ~(0xFu << DMA_CSELR_C3S_Pos)) | (PWM_DMA_REQUEST << DMA_CSELR_C3S_Pos);
+  DMA1_Channel3->CPAR = (uint32_t)(uintptr_t)&TIM3->DMAR;
+  DMA1_Channel3->CMAR = (uint32_t)(uintptr_t)pwm_burst;
+  DMA1_Channel3->CNDTR = 2u * PWM_PATTERN;
+  DMA1_Channel3->CCR = DMA_CCR_DIR | DMA_CCR_CIRC | DMA_CCR_MINC | DMA_CCR_PSIZE_1 | DMA_CCR_MSIZE_0;
+  DMA1->IFCR = DMA_IFCR_CGIF3;
+  if (bits > 0) {
+    DMA1_Channel3->CCR |= DMA_CCR_HTIE | DMA_CCR_TCIE;
+    NVIC_ClearPendingIRQ(DMA1_Channel3_IRQn);
+    NVIC_SetPriority(DMA1_Channel3_IRQn, PWM_DMA_PRIORITY);
+    NVIC_EnableIRQ(DMA1_Channel3_IRQn);
+  }
+  DMA1_Channel3->CCR |= DMA_CCR_EN;
+  TIM3->DCR = (PWM_BURST_BASE << TIM_DCR_DBA_Pos) | (1u << TIM_DCR_DBL_Pos);
+  TIM3->DIER |= TIM_DIER_UDE;
+  return 0;
+}
+
+/* Read the calibration data kept in flash */
+void Peripheral_Flash_Read(void *data, uint32_t size) {
+  if (size > CALIBRATION_SIZE)
+    size = CALIBRATION_SIZE;
+  memcpy(data, (const void *)CALIBRATION_ADDRESS, size);
+}
+
+#ifdef STM32L476xx
+/* Wait for the end of a flash operation, -1 on an error flag */
+static int32_t Peripheral_Flash_Wait(void) {
+  while (FLASH->SR & FLASH_SR_BSY) {
+    // Do nothing while the flash is busy
+  }
+  return (FLASH->SR & FLASH_SR_ERRORS) ? -1 : 0;
+}
+#endif
 
-  if (vel > 0) {
-    // Convert velocity (scaled 2^30) to duty cycle (timer counts)
-    // Formula: duty = (vel / 2^30) * ARR
-    duty_cycle = (int32_t)(((int64_t)vel * (int64_t)arr) >> 30);
+/* Replace the calibration data kept in flash, at register level like the
+   timers since the HAL flash driver isn't part of the project */
+int32_t Peripheral_Flash_Write(const void *data, uint32_t size) {
+#ifdef STM32L476xx
+  const uint8_t *bytes = (const uint8_t *)data;
+  volatile uint32_t *flash = (volatile uint32_t *)CALIBRATION_ADDRESS;
+  uint32_t page = (CALIBRATION_ADDRESS - FLASH_BASE) / CALIBRATION_SIZE;
+  int32_t status;
 
-    if (duty_cycle > (int32_t)arr)
-      duty_cycle = (int32_t)arr;
-    if (duty_cycle < 0)
-      duty_cycle = 0;
+  if (size > CALIBRATION_SIZE)
+    return -1;
 
-    TIM3->CCR1 = (uint16_t)duty_cycle;
-    TIM3->CCR2 = 0;
-  } else {
-    duty_abs = (uint32_t)(-vel); // safe now, since vel >= -2^30
+  if (FLASH->CR & FLASH_CR_LOCK) {
+    FLASH->KEYR = FLASH_KEY1;
+    FLASH->KEYR = FLASH_KEY2;
+  }
+  FLASH->SR = FLASH_SR_ERRORS | FLASH_SR_EOP;
 
-    duty_cycle = (int32_t)(((int64_t)duty_abs * (int64_t)arr) >> 30);
+  // Erase the page, 256 pages per bank
+  FLASH->CR = (FLASH->CR & ~(FLASH_CR_PNB | FLASH_CR_BKER)) | FLASH_CR_PER |
+              ((page & 0xFFu) << FLASH_CR_PNB_Pos) | (page >= 256u ? FLASH_CR_BKER : 0u);
+  FLASH->CR |= FLASH_CR_STRT;
+  status = Peripheral_Flash_Wait();
+  FLASH->CR &= ~FLASH_CR_PER;
 
-    if (duty_cycle > (int32_t)arr)
-      duty_cycle = (int32_t)arr;
-    if (duty_cycle < 0)
-      duty_cycle = 0;
+  // Program double words, the last one padded with the erased value
+  FLASH->CR |= FLASH_CR_PG;
+  for (uint32_t i = 0; i < size && status == 0; i += 8) {
+    uint32_t word[2] = {0xFFFFFFFFu, 0xFFFFFFFFu};
+    memcpy(word, bytes + i, size - i < 8 ? size - i : 8);
+    flash[i / 4] = word[0];
+    flash[i / 4 + 1] = word[1];
+    status = Peripheral_Flash_Wait();
+  }
+  FLASH->CR &= ~FLASH_CR_PG;
+  FLASH->CR |= FLASH_CR_LOCK;
 
-    TIM3->CCR1 = 0;
-    TIM3->CCR2 = (uint16_t)duty_cycle;
+  // The data cache may still hold the old page
+  if (FLASH->ACR & FLASH_ACR_DCEN) {
+    FLASH->ACR &= ~FLASH_ACR_DCEN;
+    FLASH->ACR |= FLASH_ACR_DCRST;
+    FLASH->ACR &= ~FLASH_ACR_DCRST;
+    FLASH->ACR |= FLASH_ACR_DCEN;
   }
+  return status;
+#else
+  return -1;
+#endif
 }
 
 /* Read the encoder value and calculate the current velocity in RPM */
@@ -97,6 +281,10 @@ int32_t Peripheral_Encoder_CalculateVelocity(uint32_t ms) {
   if (!vel_initialized) {
     last_ms = ms;
     rpm_filt = 0;
+    position = 0;
+    Biquad_Reset(&velocity_biquad, 0);
+    if (observer_bw)
+      Observer_Init(observer_bw, 0);
     vel_initialized = 1;
 
     // Reset counter for clean start
@@ -119,6 +307,14 @@ int32_t Peripheral_Encoder_CalculateVelocity(uint32_t ms) {
 
   // Reset counter for next interval
   TIM1->EGR |= TIM_EGR_UG;
+  position += encoder;
+
+  // The observer integrates the counts itself, no differencing
+  if (observer_bw) {
+    Observer_Update(encoder, dt_ms);
+    rpm_filt = Observer_GetVelocity();
+    return rpm_filt;
+  }
 
   // -------------------------------------------------------------------------
   // Instantaneous RPM:
@@ -131,19 +327,82 @@ int32_t Peripheral_Encoder_CalculateVelocity(uint32_t ms) {
   if (den == 0)
     return rpm_filt;
 
+  if (biquad_enabled) {
+    // Keep the fraction of the raw velocity, round once at the output
+    int64_t x = num * (1 << VELOCITY_Q) / den;
+    int32_t x_q, y_q;
+
+    if (x > INT32_MAX)
+      x = INT32_MAX;
+    else if (x < INT32_MIN)
+      x = INT32_MIN;
+    x_q = (int32_t)x;
+
+    Biquad_Process(&velocity_biquad, &x_q, &y_q, 1);
+    rpm_filt = (int32_t)(((int64_t)y_q + (1 << (VELOCITY_Q - 1))) >> VELOCITY_Q);
+    return rpm_filt;
+  }
+
   int32_t rpm = (int32_t)(num / den);
 
   // Apply IIR low-pass filter to smooth RPM
   // Formula: Y[n] = alpha*X[n] + (1-alpha)*Y[n-1]
   // Implemented as: (alpha_num * rpm + (alpha_den - alpha_num) * rpm_filt) /
-  // alpha_den
+  // alpha_den, in 64-bit since alpha_den is 1000
   {
-    const int32_t alpha_num = 1; // alpha = 1/4
-    const int32_t alpha_den = 10;
+    const int32_t alpha_den = 1000;
 
-    rpm_filt =
-        (alpha_num * rpm + (alpha_den - alpha_num) * rpm_filt) / alpha_den;
+    rpm_filt = (int32_t)(((int64_t)alpha_num * rpm +
+                          (int64_t)(alpha_den - alpha_num) * rpm_filt) / alpha_den);
   }
 
   return rpm_filt;
 }
+
+/* Set the coefficient of the velocity filter */
+void Peripheral_Encoder_SetFilter(uint32_t alpha) {
+  if (alpha < 1)
+    alpha = 1;
+  else if (alpha > 1000)
+    alpha = 1000;
+
+  alpha_num = (int32_t)alpha;
+}
+
+int32_t Peripheral_Encoder_SetBiquad(const Biquad_Coeffs_t *coeffs) {
+  if (!coeffs) {
+    biquad_enabled = 0;
+    return 0;
+  }
+
+  if (Biquad_Init(&velocity_biquad, coeffs) != 0)
+    return -1;
+
+  // Start from the current estimate
+  int32_t limit = INT32_MAX >> VELOCITY_Q;
+  int32_t rpm = rpm_filt > limit ? limit : (rpm_filt < -limit ? -limit : rpm_filt);
+  Biquad_Reset(&velocity_biquad, rpm * (1 << VELOCITY_Q));
+  biquad_enabled = 1;
+  return 0;
+}
+
+void Peripheral_Encoder_SetObserver(uint32_t bandwidth) {
+  if (bandwidth == 0) {
+    // Continue the filter from the observer estimate
+    if (observer_bw && biquad_enabled)
+      Peripheral_Encoder_SetBiquad(velocity_biquad.coeffs);
+    observer_bw = 0;
+    return;
+  }
+
+  Observer_Init(bandwidth, rpm_filt);
+  observer_bw = bandwidth;
+}
+
+int64_t Peripheral_Encoder_GetPosition(void) {
+  return position;
+}
+
+int32_t Peripheral_Encoder_GetAcceleration(void) {
+  return observer_bw ? Observer_GetAcceleration() : 0;
+}
@@ -0,0 +1,129 @@
+/***
+ * Group: 8
+ *
+ * Members: Alice Ahlberg
+ *          Daniel Fjelkner
+ *          David Georgian Iosifescu
+ *
+ * Course code: MF2103
+ *
+ * Task description: Position Controller
+ *                   Outer P/PI position loop of the position/velocity cascade.
+ *
+ * Compiler: ARM GCC
+ *
+ * Other information: Positions in encoder counts (64-bit), the integrator
+ * in RPM * counts per revolution so the output needs a single division.
+ * The loop runs at the velocity loop rate divided by the divider; the
+ * integrator is frozen while the velocity reference saturates. A new
+ * target is staged by Position_Move() and taken at the next update, so
+ * the server's parameter thread can set it during a move.
+ *
+ * References: Course material MF2103
+ *
+ ***/
+
+#include "peripherals.h"
+#include "position.h"
+
+// Position error beyond which the loop saturates anyway, keeps kp * error in 64 bits
+#define ERROR_LIMIT ((int64_t)1 << 40)
+
+static Position_Params_t params = {600, 0, 2000, 1};
+static int64_t target = 0;
+static int64_t integrator = 0;   // RPM * RESOLUTION
+static int32_t output = 0;
+static uint32_t steps = 0;
+static uint32_t time_prev = 0;
+static uint8_t first_step = 1;
+
+// Staged move, written by Position_Move(), taken by Position_Update()
+static volatile int64_t staged_target;
+static volatile uint8_t staged_ready = 0;
+
+void Position_Init(int64_t position, const Position_Params_t *p) {
+  if (p) {
+    params = *p;
+    if (params.divider < 1)
+      params.divider = 1;
+    if (params.max_speed < 0)
+      params.max_speed = -params.max_speed;
+  }
+
+  target = position;
+  integrator = 0;
+  output = 0;
+  steps = params.divider - 1; // The first update runs the loop
+  first_step = 1;
+}
+
+int32_t Position_Move(int64_t t) {
+  if (staged_ready)
+    return -1;
+
+  staged_target = t;
+
+  // Publish after the target is written, the flag is the only shared state
+  staged_ready = 1;
+  return 0;
+}
+
+int64_t Position_GetTarget(void) {
+  // The loop only writes its target while a move is staged, and never
+  // writes the staged one
+  return staged_ready ? staged_target : target;
+}
+
+int32_t Position_Update(int64_t position, uint32_t millisec) {
+  // Rate split: the inner loop steps in between reuse the last output
+  if (++steps < params.divider)
+    return output;
+  steps = 0;
+
+  if (staged_ready) {
+    target = staged_target;
+    staged_ready = 0;
+  }
+
+  uint32_t dt_ms = first_step ? 0 : millisec - time_prev;
+  time_prev = millisec;
+  first_step = 0;
+
+  int64_t error = target - position;
+  if (error > ERROR_LIMIT)
+    error = ERROR_LIMIT;
+  else if (error < -ERROR_LIMIT)
+    error = -ERROR_LIMIT;
+
+  int64_t p_term = (int64_t)params.kp * error;
+  int64_t i_increment = (int64_t)params.ki * error * dt_ms / 1000;
+  integrator += i_increment;
+
+  // The integral only has to make up the offset of the velocity loop at low
+  // speed, a bound keeps it from winding up during the deceleration
+  int64_t i_limit = (int64_t)params.max_speed * RESOLUTION / 16;
+  if (integrator > i_limit)
+    integrator = i_limit;
+  else if (integrator < -i_limit)
+    integrator = -i_limit;
+
+  int64_t v = (p_term + integrator) / RESOLUTION;
+
+  // Saturate, and undo the integration that drove into the limit
+  if (v > params.max_speed) {
+    v = params.max_speed;
+    if (i_increment > 0)
+      integrator -= i_increment;
+  } else if (v < -params.max_speed) {
+    v = -params.max_speed;
+    if (i_increment < 0)
+      integrator -= i_increment;
+  }
+
+  output = (int32_t)v;
+  return output;
+}
+
+int64_t Position_Unwrap(int64_t previous, uint32_t low) {
+  return previous + (int32_t)(low - (uint32_t)previous);
+}
@@ -0,0 +1,178 @@
+/***
+ * Group: 8
+ *
+ * Members: Alice Ahlberg
+ *          Daniel Fjelkner
+ *          David Georgian Iosifescu
+ *
+ * Course code: MF2103
+ *
+ * Task description: Smith Predictor
+ *                   Network delay compensation of the server control loop.
+ *
+ * Compiler: ARM GCC
+ *
+ * Other information: Model velocities are RPM Q16, the model is integrated
+ * with forward Euler at each control step. The history is indexed by the
+ * server time, so the loop delay can change from one packet to the next.
+ *
+ * References: Course material MF2103
+ *
+ ***/
+
+#include "predictor.h"
+
+#define Q 16
+#define MASK (PREDICTOR_HISTORY - 1U)
+#define DELAY_SHIFT 3   // Delay smoothing: 1/8 of the new estimate per packet
+
+// Minimum spacing of the older points, so the history spans the largest
+// delay at any sampling period
+#define SPACING ((PREDICTOR_MAX_DELAY + PREDICTOR_HISTORY - 2U) / (PREDICTOR_HISTORY - 1U))
+
+#if (PREDICTOR_HISTORY & MASK) != 0
+#error "PREDICTOR_HISTORY must be a power of two"
+#endif
+
+#if (PREDICTOR_HISTORY - 2U) * SPACING < PREDICTOR_MAX_DELAY
+#error "PREDICTOR_HISTORY does not span PREDICTOR_MAX_DELAY"
+#endif
+
+typedef struct {
+  uint32_t t;      // Server time in milliseconds
+  int64_t v;       // Model velocity, RPM Q16
+} Predictor_Point_t;
+
+static MotorModel_t model;
+static uint8_t enabled = 0;
+
+// Model state
+static Predictor_Point_t history[PREDICTOR_HISTORY];
+static uint32_t head = 0;      // Slot of the next point
+static uint32_t count = 0;
+static int64_t v_model = 0;
+static int32_t u_model = 0;
+static uint32_t t_model = 0;
+
+// Delay estimate
+static uint8_t have_echo = 0;
+static uint32_t delay_q4 = 0;  // Loop delay in 1/16 ms
+
+/* Model velocity after dt_ms milliseconds at the current control */
+static int64_t Predictor_Step(int64_t v, uint32_t dt_ms) {
+  int64_t drive = (int64_t)model.gain * u_model / MOTOR_CONTROL_SCALE;
+  int64_t fric = (int64_t)model.gain * model.friction / MOTOR_CONTROL_SCALE;
+  int64_t v_ss;
+
+  // Coulomb friction holds the motor while the drive is weaker
+  if (drive > fric)
+    v_ss = drive - fric;
+  else if (drive < -fric)
+    v_ss = drive + fric;
+  else
+    v_ss = 0;
+
+  // Forward Euler is only stable below 2 tau, keep a step below one tau
+  if (dt_ms > model.tau_ms)
+    dt_ms = model.tau_ms;
+
+  return v + ((v_ss << Q) - v) * (int64_t)dt_ms / (int64_t)model.tau_ms;
+}
+
+/* Model velocity at a past time, interpolated between the stored points */
+static int64_t Predictor_Lookup(uint32_t t) {
+  uint32_t i = (head - 1U) & MASK;
+  const Predictor_Point_t *newer = &history[i];
+
+  // Between the last control step and now
+  if ((int32_t)(t - newer->t) >= 0)
+    return Predictor_Step(v_model, t - t_model);
+
+  for (uint32_t n = 1; n < count; n++) {
+    const Predictor_Point_t *older = &history[(i - n) & MASK];
+    int32_t span = (int32_t)(newer->t - older->t);
+    int32_t back = (int32_t)(t - older->t);
+
+    if (back >= 0) {
+      if (span <= 0 || back >= span)
+        return newer->v;
+      return older->v + (newer->v - older->v) * back / span;
+    }
+    newer = older;
+  }
+
+  // Older than the history: the oldest point is the best guess
+  return newer->v;
+}
+
+void Predictor_Init(const MotorModel_t *m, uint32_t base_ms) {
+  enabled = (m && m->gain > 0 && m->tau_ms > 0) ? 1 : 0;
+  if (enabled)
+    model = *m;
+
+  head = 0;
+  count = 0;
+  v_model = 0;
+  u_model = 0;
+  t_model = 0;
+
+  have_echo = 0;
+  delay_q4 = (base_ms < PREDICTOR_MAX_DELAY ? base_ms : PREDICTOR_MAX_DELAY) << 4;
+}
+
+void Predictor_SetModel(const MotorModel_t *m) {
+  if (enabled && m && m->gain > 0 && m->tau_ms > 0)
+    model = *m;
+}
+
+int32_t Predictor_Update(int32_t velocity, uint32_t echo_ms, uint32_t millisec) {
+  if (!enabled)
+    return velocity;
+
+  // Round trip of the link, both ends on the server clock; the first one
+  // replaces the base delay
+  if (echo_ms != 0) {
+    int32_t rtt = (int32_t)(millisec - echo_ms);
+    uint32_t delay = rtt < 0 ? 0U : (uint32_t)rtt;
+    if (delay > PREDICTOR_MAX_DELAY)
+      delay = PREDICTOR_MAX_DELAY;
+    delay <<= 4;
+    delay_q4 = have_echo ? delay_q4 + (delay >> DELAY_SHIFT) - (delay_q4 >> DELAY_SHIFT) : delay;
+    have_echo = 1;
+  }
+
+  if (count == 0)
+    return velocity;
+
+  // Smith correction: model now minus model one loop delay ago
+  int64_t v_now = Predictor_Step(v_model, millisec - t_model);
+  int64_t v_past = Predictor_Lookup(millisec - (delay_q4 >> 4));
+
+  return velocity + (int32_t)((v_now - v_past) >> Q);
+}
+
+void Predictor_Apply(int32_t control, uint32_t millisec) {
+  if (!enabled)
+    return;
+
+  if (count > 0)
+    v_model = Predictor_Step(v_model, millisec - t_model);
+
+  t_model = millisec;
+  u_model = control;
+
+  // Replace the newest point until it is SPACING after the one before it
+  if (count >= 2 && history[(head - 1U) & MASK].t - history[(head - 2U) & MASK].t < SPACING) {
+    head = (head - 1U) & MASK;
+    count--;
+  }
+
+  history[head] = (Predictor_Point_t){millisec, v_model};
+  head = (head + 1U) & MASK;
+  if (count < PREDICTOR_HISTORY)
+    count++;
+}
+
+uint32_t Predictor_GetDelay(void) {
+  return (delay_q4 + 8U) >> 4;
+}
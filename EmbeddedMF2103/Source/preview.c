@@ -0,0 +1,149 @@
+/***
+ * Group: 8
+ *
+ * Members: Alice Ahlberg
+ *          Daniel Fjelkner
+ *          David Georgian Iosifescu
+ *
+ * Course code: MF2103
+ *
+ * Task description: Reference Preview
+ *                   Look-ahead buffer of upcoming references indexed by time,
+ *                   and a feedforward inverting the motor model on it.
+ *
+ * Compiler: ARM GCC
+ *
+ * Other information: Samples are spaced by a power of two milliseconds so a
+ * timestamp maps to a slot and an interpolation weight with shifts and masks.
+ *
+ * References: Course material MF2103
+ *
+ ***/
+
+#include "preview.h"
+#include "controller.h"
+#include "main.h"
+#include "trajectory.h"
+
+#define STEP (1U << PREVIEW_STEP_SHIFT)
+#define MASK (PREVIEW_SAMPLES - 1U)
+
+#if (PREVIEW_SAMPLES & MASK) != 0
+#error "PREVIEW_SAMPLES must be a power of two"
+#endif
+
+#if (PREVIEW_HORIZON >> PREVIEW_STEP_SHIFT) >= PREVIEW_SAMPLES
+#error "PREVIEW_HORIZON does not fit in PREVIEW_SAMPLES"
+#endif
+
+static int32_t samples[PREVIEW_SAMPLES];
+static uint32_t tail = 0;      // Slot of the oldest sample
+static uint32_t count = 0;     // Number of buffered samples
+static uint32_t base_ms = 0;   // Timestamp of the oldest sample
+
+// Preview feedforward gains, 0 when disabled
+// kv: [control units / RPM]
+// ka: [control units / (RPM / ms)]
+// kf: [control units]
+static int32_t ff_kv = 0;
+static int32_t ff_ka = 0;
+static int32_t ff_kf = 0;
+
+// Mailbox from the thread deciding the targets
+static volatile int32_t next_target = 0;
+static volatile uint32_t next_ms = 0;
+static volatile uint8_t next_pending = 0;
+
+void Preview_Reset(uint32_t millisec) {
+  next_pending = 0;
+  tail = 0;
+  count = 0;
+  base_ms = millisec;
+}
+
+void Preview_Schedule(int32_t target, uint32_t millisec) {
+  next_pending = 0;
+  next_target = target;
+  next_ms = millisec;
+  __DMB();
+  next_pending = 1;
+}
+
+void Preview_Fill(uint32_t millisec) {
+  // Drop samples that are entirely in the past
+  while (count > 1 && (int32_t)(millisec - (base_ms + STEP)) >= 0) {
+    tail = (tail + 1U) & MASK;
+    count--;
+    base_ms += STEP;
+  }
+
+  uint32_t end = base_ms + (count << PREVIEW_STEP_SHIFT);
+  while (count < PREVIEW_SAMPLES && (int32_t)(end - millisec) <= PREVIEW_HORIZON) {
+    if (next_pending && (int32_t)(end - next_ms) >= 0) {
+      Trajectory_Start(next_target, next_ms);
+      next_pending = 0;
+    }
+
+    samples[(tail + count) & MASK] = Trajectory_Evaluate(end);
+    count++;
+    end += STEP;
+  }
+}
+
+int32_t Preview_Lookup(uint32_t millisec) {
+  if (count == 0)
+    return Trajectory_Evaluate(millisec);
+
+  int32_t dt = (int32_t)(millisec - base_ms);
+  if (dt < 0)
+    dt = 0;
+
+  uint32_t idx = (uint32_t)dt >> PREVIEW_STEP_SHIFT;
+  int32_t frac = (int32_t)((uint32_t)dt & (STEP - 1U));
+
+  if (idx + 1U >= count)
+    return samples[(tail + count - 1U) & MASK];
+
+  int32_t a = samples[(tail + idx) & MASK];
+  int32_t b = samples[(tail + idx + 1U) & MASK];
+  return a + (((b - a) * frac) >> PREVIEW_STEP_SHIFT);
+}
+
+void Preview_SetModel(const MotorModel_t *model, uint8_t terms) {
+  if (!model || model->gain <= 0) {
+    ff_kv = 0;
+    ff_ka = 0;
+    ff_kf = 0;
+    return;
+  }
+
+  int32_t kv = (int32_t)(MOTOR_CONTROL_SCALE / model->gain);
+
+  ff_kv = (terms & CONTROLLER_FF_VELOCITY) ? kv : 0;
+  ff_ka = (terms & CONTROLLER_FF_ACCEL) ? kv * (int32_t)model->tau_ms : 0;
+  ff_kf = (terms & CONTROLLER_FF_FRICTION) ? model->friction : 0;
+}
+
+int32_t Preview_Feedforward(uint32_t millisec) {
+  int32_t r = Preview_Lookup(millisec);
+  int64_t u = (int64_t)ff_kv * r;
+
+  // Slope of the window centred on the time: no lag, the next samples are known
+  if (ff_ka) {
+    int32_t before = Preview_Lookup(millisec - STEP);
+    int32_t after = Preview_Lookup(millisec + STEP);
+    u += (int64_t)ff_ka * (after - before) / (int64_t)(2U * STEP);
+  }
+
+  if (r > 0)
+    u += ff_kf;
+  else if (r < 0)
+    u -= ff_kf;
+
+  // More than the full control only winds up the saturation
+  if (u > MOTOR_CONTROL_SCALE)
+    u = MOTOR_CONTROL_SCALE;
+  else if (u < -MOTOR_CONTROL_SCALE)
+    u = -MOTOR_CONTROL_SCALE;
+  return (int32_t)u;
+}
@@ -0,0 +1,188 @@
+/***
+ * Group: 8
+ *
+ * Members: Alice Ahlberg
+ *          Daniel Fjelkner
+ *          David Georgian Iosifescu
+ *
+ * Course code: MF2103
+ *
+ * Task description: Flight Recorder
+ *                   Circular trace buffer of control-loop samples with
+ *                   trigger and freeze.
+ *
+ * Compiler: ARM GCC
+ *
+ * Other information: The buffer lives at the start of SRAM2 (0x10000000) so it
+ * does not compete with the stacks in SRAM1 and can be read by the debugger
+ * at a fixed address.
+ *
+ * References: Course material MF2103
+ *
+ ***/
+
+#include "recorder.h"
+#include <stdio.h>
+#include <string.h>
+
+#define RECORDER_MASK (RECORDER_SAMPLES - 1U)
+
+#if (RECORDER_SAMPLES & RECORDER_MASK) != 0
+#error "RECORDER_SAMPLES must be a power of two"
+#endif
+
+static Recorder_Sample_t buffer[RECORDER_SAMPLES]
+    __attribute__((section(".bss.ARM.__at_0x10000000")));
+
+static uint32_t head = 0;         // Total number of samples written
+static uint32_t post_trigger = 0; // Samples left to record after the trigger
+static int32_t error_threshold = 0;
+static volatile uint8_t triggered = 0;
+static volatile uint8_t frozen = 0;
+
+/* Arming: staged by the dumping thread, taken by Recorder_Record */
+static volatile uint32_t staged_post = 0;
+static volatile uint8_t staged_arm = 0;
+
+static uint32_t dump_index = 0;   // Next sample sent or printed
+static uint16_t capture = 0;      // Number of captures armed since start
+
+void Recorder_Init(void) {
+  // Nothing records yet, the state is written directly
+  head = 0;
+  post_trigger = 0;
+  error_threshold = 0;
+  triggered = 0;
+  frozen = 0;
+  staged_arm = 0;
+  dump_index = 0;
+  capture = 0;
+}
+
+void Recorder_Arm(uint32_t post_samples) {
+  dump_index = 0;
+  capture++;
+  staged_post = post_samples < RECORDER_SAMPLES ? post_samples : RECORDER_SAMPLES - 1U;
+  // Publish last, the recording thread takes the request on its next sample
+  staged_arm = 1;
+}
+
+void Recorder_SetErrorTrigger(int32_t threshold) {
+  error_threshold = threshold < 0 ? -threshold : threshold;
+}
+
+void Recorder_Trigger(void) {
+  triggered = 1;
+}
+
+void Recorder_Record(uint32_t timestamp, int32_t reference, int32_t velocity,
+                     int32_t control, int16_t encoder, uint32_t latency) {
+  // Restart on the cycle boundary, a trigger pending from before is dropped
+  if (staged_arm) {
+    head = 0;
+    post_trigger = staged_post;
+    triggered = 0;
+    frozen = 0;
+    staged_arm = 0;
+  }
+
+  if (frozen)
+    return;
+
+  Recorder_Sample_t *s = &buffer[head & RECORDER_MASK];
+  uint16_t flags = 0;
+
+  if (!triggered && error_threshold > 0) {
+    int32_t error = reference - velocity;
+    if (error > error_threshold || error < -error_threshold)
+      triggered = 1;
+  }
+  if (triggered == 1) {
+    // Mark the sample once, then count down the post-trigger window
+    flags = RECORDER_FLAG_TRIGGER;
+    triggered = 2;
+  }
+
+  s->timestamp = timestamp;
+  s->reference = reference;
+  s->velocity = velocity;
+  s->control = control;
+  s->latency = latency;
+  s->encoder = encoder;
+  s->flags = flags;
+  head++;
+
+  if (triggered) {
+    if (post_trigger == 0)
+      frozen = 1;
+    else
+      post_trigger--;
+  }
+}
+
+uint8_t Recorder_IsFrozen(void) {
+  return frozen;
+}
+
+uint32_t Recorder_Count(void) {
+  return head < RECORDER_SAMPLES ? head : RECORDER_SAMPLES;
+}
+
+uint8_t Recorder_Read(uint32_t index, Recorder_Sample_t *sample) {
+  uint32_t count = Recorder_Count();
+
+  if (!sample || index >= count)
+    return 0;
+
+  *sample = buffer[(head - count + index) & RECORDER_MASK];
+  return 1;
+}
+
+uint16_t Recorder_BuildFrame(uint8_t *frame, uint16_t size) {
+  uint32_t count = Recorder_Count();
+
+  if (!frozen || staged_arm || dump_index >= count || size < sizeof(RecorderHeader_t) + sizeof(Recorder_Sample_t))
+    return 0;
+
+  RecorderHeader_t hdr;
+  Recorder_Sample_t s;
+  uint32_t n = (uint32_t)((size - sizeof(RecorderHeader_t)) / sizeof(Recorder_Sample_t));
+  uint8_t *p = frame + sizeof(RecorderHeader_t);
+
+  if (n > count - dump_index)
+    n = count - dump_index;
+
+  hdr.magic = RECORDER_MAGIC;
+  hdr.count = (uint16_t)n;
+  hdr.capture = capture;
+  hdr.total = (uint16_t)count;
+  hdr.index = dump_index;
+  memcpy(frame, &hdr, sizeof(hdr));
+
+  // The frame may be unaligned, copy the samples bytewise
+  for (uint32_t i = 0; i < n; i++, p += sizeof(s)) {
+    Recorder_Read(dump_index + i, &s);
+    memcpy(p, &s, sizeof(s));
+  }
+  dump_index += n;
+
+  return (uint16_t)(p - frame);
+}
+
+uint32_t Recorder_Dump(uint32_t lines) {
+  Recorder_Sample_t s;
+  uint32_t count = Recorder_Count();
+
+  if (!frozen || staged_arm || dump_index >= count)
+    return 0;
+
+  if (dump_index == 0)
+    printf("timestamp,reference,velocity,control,encoder,latency,flags\r\n");
+  for (; lines > 0 && dump_index < count; lines--, dump_index++) {
+    Recorder_Read(dump_index, &s);
+    printf("%lu,%ld,%ld,%ld,%d,%lu,%u\r\n", (unsigned long)s.timestamp,
+           (long)s.reference, (long)s.velocity, (long)s.control, s.encoder,
+           (unsigned long)s.latency, s.flags);
+  }
+  return count - dump_index;
+}
@@ -0,0 +1,106 @@
+/***
+ * Group: 8
+ *
+ * Members: Alice Ahlberg
+ *          Daniel Fjelkner
+ *          David Georgian Iosifescu
+ *
+ * Course code: MF2103
+ *
+ * Task description: Recursive Least Squares
+ *                   Fixed-point RLS estimator with exponential forgetting.
+ *
+ * Compiler: ARM GCC
+ *
+ * Other information: The regressors are Q15 fractions, the estimates and
+ * the covariance Q24 in 64-bit. The gain vector is P * phi / (lambda +
+ * phi' * P * phi), divided after scaling both sides down to keep the
+ * quotient in 64 bits. Only the upper triangle of P is computed, the lower
+ * one is mirrored so P stays symmetric. The identification (sysid.c) runs
+ * it without forgetting, the adaptation (adapt.c) with.
+ *
+ * References: Course material MF2103, K. J. Astrom, B. Wittenmark,
+ * Adaptive Control, 2nd ed., ch. 2
+ *
+ ***/
+
+#include "rls.h"
+
+#define ONE ((int64_t)1 << RLS_P_Q)
+
+/* a * 2^RLS_P_Q / b, scaled down while the product would overflow */
+static int64_t Rls_Divide(int64_t a, int64_t b) {
+  int64_t m = a < 0 ? -a : a;
+
+  while (m >= ((int64_t)1 << (62 - RLS_P_Q)) && b > ((int64_t)1 << 16)) {
+    m >>= 1;
+    a /= 2;
+    b /= 2;
+  }
+  return b ? (a << RLS_P_Q) / b : 0;
+}
+
+int32_t Rls_Init(Rls_t *rls, uint8_t n, int32_t lambda, int64_t p0) {
+  if (!rls || n < 1 || n > RLS_MAX_PARAMS || lambda < RLS_LAMBDA_ONE / 2 ||
+      lambda > RLS_LAMBDA_ONE || p0 < ONE || p0 > 1000 * ONE)
+    return -1;
+
+  rls->n = n;
+  rls->lambda = lambda;
+  rls->p0 = p0;
+  for (uint32_t i = 0; i < RLS_MAX_PARAMS; i++) {
+    rls->theta[i] = 0;
+    for (uint32_t j = 0; j < RLS_MAX_PARAMS; j++)
+      rls->P[i][j] = i == j ? p0 : 0;
+  }
+  return 0;
+}
+
+int32_t Rls_Update(Rls_t *rls, const int32_t *phi, int32_t y) {
+  int64_t pphi[RLS_MAX_PARAMS];
+  int64_t k[RLS_MAX_PARAMS];
+  const uint32_t n = rls->n;
+
+  // A priori error e = y - theta' * phi, Q15
+  int64_t yhat = 0;
+  for (uint32_t i = 0; i < n; i++)
+    yhat += (int64_t)rls->theta[i] * phi[i];
+  int32_t e = (int32_t)(y - (yhat >> RLS_THETA_Q));
+
+  // P * phi and the denominator lambda + phi' * P * phi, Q24
+  int64_t den = (int64_t)rls->lambda >> (30 - RLS_P_Q);
+  for (uint32_t i = 0; i < n; i++) {
+    int64_t s = 0;
+    for (uint32_t j = 0; j < n; j++)
+      s += rls->P[i][j] * phi[j];
+    pphi[i] = s >> RLS_Q;
+    den += (pphi[i] * phi[i]) >> RLS_Q;
+  }
+
+  // Gain vector and parameter update
+  for (uint32_t i = 0; i < n; i++) {
+    k[i] = Rls_Divide(pphi[i], den);
+    rls->theta[i] += (int32_t)((k[i] * e) >> RLS_Q);
+  }
+
+  // P = (P - k * (P * phi)') / lambda, forgetting only below p0
+  int64_t trace = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    for (uint32_t j = i; j < n; j++) {
+      int64_t p = rls->P[i][j] - ((k[i] * pphi[j]) >> RLS_P_Q);
+      rls->P[i][j] = p;
+      rls->P[j][i] = p;
+    }
+    trace += rls->P[i][i];
+  }
+  if (rls->lambda < RLS_LAMBDA_ONE && trace < (int64_t)n * rls->p0) {
+    // P / lambda = P + P * (1 - lambda) / lambda, Q20 factors keep it in 64 bits
+    const int64_t num = (RLS_LAMBDA_ONE - rls->lambda) >> 10;
+    const int64_t lam = rls->lambda >> 10;
+    for (uint32_t i = 0; i < n; i++)
+      for (uint32_t j = 0; j < n; j++)
+        rls->P[i][j] += rls->P[i][j] * num / lam;
+  }
+
+  return e;
+}
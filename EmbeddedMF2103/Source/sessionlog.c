@@ -0,0 +1,125 @@
+/***
+ * Group: 8
+ *
+ * Members: Alice Ahlberg
+ *          Daniel Fjelkner
+ *          David Georgian Iosifescu
+ *
+ * Course code: MF2103
+ *
+ * Task description: Session Log
+ *                   Recording of every controller step on the server for
+ *                   offline replay.
+ *
+ * Compiler: ARM GCC
+ *
+ * Other information: Single-producer (communication thread) and
+ * single-consumer (log thread) queue, no lock needed.
+ *
+ * References: Course material MF2103
+ *
+ ***/
+
+#include "sessionlog.h"
+#include "main.h"
+#include <string.h>
+
+#define QUEUE_MASK (SESSIONLOG_QUEUE - 1U)
+
+#if (SESSIONLOG_QUEUE & QUEUE_MASK) != 0
+#error "SESSIONLOG_QUEUE must be a power of two"
+#endif
+
+static SessionRecord_t queue[SESSIONLOG_QUEUE];
+static volatile uint32_t q_head = 0; // Written by the producer only
+static volatile uint32_t q_tail = 0; // Written by the consumer only
+static volatile uint32_t dropped = 0;
+static uint32_t sequence = 0;
+static volatile uint32_t start_index = 0; // First record of the new session
+static volatile uint8_t start_pending = 0;
+static Controller_Config_t start_config;  // Sent in frame 0 of the new session
+
+void SessionLog_Start(const Controller_Config_t *config) {
+  start_config = *config;
+  start_index = q_head;
+  __DMB();
+  start_pending = 1;
+}
+
+void SessionLog_Append(const ClientData_t *rx, int32_t reference, int32_t feedforward,
+                       const ServerData_t *tx, uint32_t config) {
+  uint32_t head = q_head;
+
+  if (head - q_tail >= SESSIONLOG_QUEUE) {
+    dropped++;
+    return;
+  }
+
+  SessionRecord_t *r = &queue[head & QUEUE_MASK];
+  r->rx = *rx;
+  r->reference = reference;
+  r->feedforward = feedforward;
+  r->tx = *tx;
+  r->config = config;
+
+  // Publish the record only once it is complete
+  __DMB();
+  q_head = head + 1U;
+}
+
+uint16_t SessionLog_BuildFrame(uint8_t *frame, uint16_t size) {
+  if (!frame || size < sizeof(SessionLogHeader_t) + sizeof(Controller_Config_t) ||
+      size < sizeof(SessionLogHeader_t) + sizeof(SessionRecord_t))
+    return 0;
+
+  uint32_t tail = q_tail;
+  uint32_t count = q_head - tail;
+  uint32_t room = (uint32_t)((size - sizeof(SessionLogHeader_t)) / sizeof(SessionRecord_t));
+
+  if (start_pending) {
+    if (tail == start_index) {
+      // Frame 0 holds the configuration the records are replayed with
+      SessionLogHeader_t header = {
+          .magic = SESSION_LOG_MAGIC,
+          .count = 0,
+          .sequence = 0,
+          .dropped = dropped,
+      };
+      memcpy(frame, &header, sizeof(header));
+      memcpy(frame + sizeof(header), &start_config, sizeof(start_config));
+      sequence = 1;
+      start_pending = 0;
+      return (uint16_t)(sizeof(header) + sizeof(start_config));
+    } else if (start_index - tail < count) {
+      // Never mix two sessions in one frame
+      count = start_index - tail;
+    }
+  }
+
+  if (count == 0)
+    return 0;
+  if (count > room)
+    count = room;
+  if (count > SESSION_LOG_BATCH)
+    count = SESSION_LOG_BATCH;
+
+  SessionLogHeader_t header = {
+      .magic = SESSION_LOG_MAGIC,
+      .count = (uint16_t)count,
+      .sequence = sequence++,
+      .dropped = dropped,
+  };
+  memcpy(frame, &header, sizeof(header));
+
+  uint8_t *out = frame + sizeof(header);
+  for (uint32_t i = 0; i < count; i++) {
+    memcpy(out, &queue[(tail + i) & QUEUE_MASK], sizeof(SessionRecord_t));
+    out += sizeof(SessionRecord_t);
+  }
+
+  // Release the slots to the producer
+  __DMB();
+  q_tail = tail + count;
+
+  return (uint16_t)(sizeof(header) + count * sizeof(SessionRecord_t));
+}
@@ -0,0 +1,81 @@
+/***
+ * Group: 8
+ *
+ * Members: Alice Ahlberg
+ *          Daniel Fjelkner
+ *          David Georgian Iosifescu
+ *
+ * Course code: MF2103
+ *
+ * Task description: Stack Monitor
+ *                   Stack painting and high-water-mark report per thread.
+ *
+ * Compiler: ARM GCC
+ *
+ * Other information: Stacks grow downwards, so the untouched part of a
+ * painted stack is found by scanning up from the lowest address.
+ *
+ * References: Course material MF2103
+ *
+ ***/
+
+#include "stackmon.h"
+#include <stdio.h>
+
+// Same fill pattern as the RTX stack watermark
+#define STACK_PATTERN 0xCCCCCCCCU
+
+typedef struct {
+  const char *name;
+  uint32_t *mem;
+  uint32_t words;
+  uint32_t reported;
+} StackMon_Entry_t;
+
+static StackMon_Entry_t stacks[STACKMON_MAX_THREADS];
+static uint32_t stack_count = 0;
+
+int32_t StackMon_Register(const char *name, void *stack_mem, uint32_t stack_size) {
+  if (!stack_mem || stack_count >= STACKMON_MAX_THREADS)
+    return -1;
+
+  StackMon_Entry_t *e = &stacks[stack_count];
+  e->name = name;
+  e->mem = (uint32_t *)stack_mem;
+  e->words = stack_size / 4;
+  e->reported = 0;
+
+  for (uint32_t i = 0; i < e->words; i++)
+    e->mem[i] = STACK_PATTERN;
+
+  return (int32_t)stack_count++;
+}
+
+uint32_t StackMon_GetPeak(int32_t index) {
+  if (index < 0 || (uint32_t)index >= stack_count)
+    return 0;
+
+  const StackMon_Entry_t *e = &stacks[index];
+
+  // The lowest word holds the RTX overflow magic word, skip it
+  uint32_t i = 1;
+  while (i < e->words && e->mem[i] == STACK_PATTERN)
+    i++;
+
+  return (e->words - i) * 4;
+}
+
+void StackMon_Report(void) {
+  for (uint32_t i = 0; i < stack_count; i++) {
+    StackMon_Entry_t *e = &stacks[i];
+    uint32_t peak = StackMon_GetPeak((int32_t)i);
+
+    if (peak <= e->reported)
+      continue;
+    e->reported = peak;
+
+    printf("[stack] %s: %lu/%lu bytes (%lu%%)\r\n", e->name ? e->name : "?",
+           (unsigned long)peak, (unsigned long)(e->words * 4),
+           (unsigned long)(peak * 100 / (e->words * 4)));
+  }
+}
@@ -0,0 +1,263 @@
+/***
+ * Group: 8
+ *
+ * Members: Alice Ahlberg
+ *          Daniel Fjelkner
+ *          David Georgian Iosifescu
+ *
+ * Course code: MF2103
+ *
+ * Task description: System Identification
+ *                   PRBS or chirp excitation and least-squares fit of an
+ *                   ARX model of the motor.
+ *
+ * Compiler: ARM GCC
+ *
+ * Other information: The fit runs online on Source/rls.c without
+ * forgetting, so no response is logged and the cost per sample is fixed.
+ * Samples that don't follow the previous one by the period of the first
+ * one are skipped by the fit. The excitation drives the motor open loop:
+ * the application applies the returned control instead of the
+ * controller's.
+ *
+ * References: Course material MF2103, L. Ljung, System Identification:
+ * Theory for the User, 2nd ed., ch. 4 and 13
+ *
+ ***/
+
+#include "sysid.h"
+#include "rls.h"
+
+#define ONE ((int64_t)1 << RLS_THETA_Q)
+#define CONTROL_MAX 1073741823L
+#define CONTROL_MIN (-1073741824L)
+#define P0 (100 * ONE)   // Initial covariance, little trust in the zero start
+
+// Quarter sine wave in Q15, 64 segments
+static const int16_t sine[65] = {
+  0, 804, 1608, 2410, 3212, 4011, 4808, 5602, 6393, 7179, 7962, 8739, 9512,
+  10278, 11039, 11793, 12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530,
+  18204, 18868, 19519, 20159, 20787, 21403, 22005, 22594, 23170, 23731, 24279,
+  24811, 25329, 25832, 26319, 26790, 27245, 27683, 28105, 28510, 28898, 29268,
+  29621, 29956, 30273, 30571, 30852, 31113, 31356, 31580, 31785, 31971, 32137,
+  32285, 32412, 32521, 32609, 32678, 32728, 32757, 32767};
+
+static Sysid_Config_t cfg;
+static Sysid_Result_t result;
+static volatile Sysid_State_t state = SYSID_IDLE;
+static Rls_t rls;
+
+static uint32_t t_start = 0;
+static uint32_t t_prev = 0;
+static uint32_t period = 0;      // Sampling period, from the first two steps
+static uint32_t phase = 0;       // Chirp phase, a full turn is 2^32
+static uint16_t lfsr = 0x1FF;
+static uint32_t bit = 0;         // Index of the current PRBS bit
+static int32_t y1, y2, u1;       // Past outputs and the input before the last, Q15
+static int32_t control = 0;
+static uint8_t history = 0;      // Regular samples since the start
+static uint32_t fitted = 0;      // Samples used by the fit
+static int64_t sum_e2 = 0;
+
+/* Sine of a phase where 2^32 is a full turn, Q15 */
+static int32_t Sysid_Sine(uint32_t ph) {
+  uint32_t quarter = ph >> 30;
+  uint32_t x = (ph >> 14) & 0xFFFF;  // Position in the quarter, Q16
+  if (quarter & 1)
+    x = 0x10000 - x;
+  uint32_t i = x >> 10, f = x & 0x3FF;
+  int32_t s = i >= 64 ? sine[64] : sine[i] + (int32_t)(((sine[i + 1] - sine[i]) * (int32_t)f) >> 10);
+  return quarter & 2 ? -s : s;
+}
+
+/* ln(x) for x in Q24, 0 < x < 1, from 2 * atanh((x - 1) / (x + 1)) */
+static int64_t Sysid_Log(int64_t x) {
+  int64_t z = ((x - ONE) << RLS_THETA_Q) / (x + ONE);
+  int64_t z2 = (z * z) >> RLS_THETA_Q;
+  int64_t term = z, sum = 0;
+
+  for (int64_t k = 1; k < 40 && term != 0; k += 2) {
+    sum += term / k;
+    term = (term * z2) >> RLS_THETA_Q;
+  }
+  return 2 * sum;
+}
+
+static uint32_t Sysid_ISqrt(uint64_t x) {
+  uint64_t r = 0, b = 1ULL << 62;
+
+  while (b > x)
+    b >>= 2;
+  while (b) {
+    if (x >= r + b) {
+      x -= r + b;
+      r = (r >> 1) + b;
+    } else {
+      r >>= 1;
+    }
+    b >>= 2;
+  }
+  return (uint32_t)r;
+}
+
+static void Sysid_Finish(void) {
+  result.order = cfg.order;
+  result.a[0] = rls.theta[0];
+  result.a[1] = cfg.order == 2 ? rls.theta[1] : 0;
+  result.b[0] = rls.theta[cfg.order];
+  result.b[1] = cfg.order == 2 ? rls.theta[3] : 0;
+  result.c = rls.theta[2 * cfg.order];
+  result.period_ms = period;
+  result.samples = fitted;
+  result.residual = (int32_t)((int64_t)Sysid_ISqrt((uint64_t)(sum_e2 / (fitted ? fitted : 1))) *
+                              SYSID_VELOCITY_SCALE / 32768);
+
+  state = Sysid_ToModel(rls.theta, cfg.order, period, &result.model) == 0 ? SYSID_DONE : SYSID_FAILED;
+}
+
+int32_t Sysid_ToModel(const int32_t *theta, uint8_t order, uint32_t period_ms, MotorModel_t *model) {
+  if (!theta || !model || (order != 1 && order != 2) || period_ms == 0)
+    return -1;
+
+  const int64_t a1 = theta[0];
+  const int64_t a2 = order == 2 ? theta[1] : 0;
+  const int64_t b1 = theta[order];
+  const int64_t b2 = order == 2 ? theta[3] : 0;
+  const int64_t c = theta[2 * order];
+
+  // Dominant pole: the larger real root of z^2 + a1 z + a2
+  int64_t pole = -a1;
+  if (order == 2) {
+    int64_t disc = ((a1 * a1) >> RLS_THETA_Q) - 4 * a2;
+    if (disc < 0)
+      return -1;
+    pole = (-a1 + (int64_t)Sysid_ISqrt((uint64_t)disc << RLS_THETA_Q)) / 2;
+  }
+
+  int64_t a_sum = ONE + a1 + a2; // A(1)
+  int64_t b_sum = b1 + b2;       // B(1)
+  if (pole <= 0 || pole >= ONE || a_sum <= 0 || b_sum <= 0)
+    return -1;
+
+  // tau = -T / ln(pole), gain = B(1) / A(1) scaled to RPM at full control,
+  // friction = -c / B(1) in full control
+  int64_t ln = Sysid_Log(pole);
+  model->tau_ms = (uint32_t)(-(int64_t)period_ms * ONE / ln);
+  model->gain = (int32_t)(b_sum * SYSID_VELOCITY_SCALE / a_sum);
+  model->friction = (int32_t)(-c * MOTOR_CONTROL_SCALE / b_sum);
+  return 0;
+}
+
+int32_t Sysid_Start(const Sysid_Config_t *config, uint32_t millisec) {
+  if (!config || (config->order != 1 && config->order != 2) || config->amplitude <= 0 ||
+      config->duration_ms == 0 || (config->signal == SYSID_PRBS && config->bit_ms == 0))
+    return -1;
+
+  cfg = *config;
+
+  // The scaled velocity must stay below 1 in Q15
+  if (cfg.limit <= 0 || cfg.limit >= SYSID_VELOCITY_SCALE)
+    cfg.limit = SYSID_VELOCITY_SCALE - 1;
+  Rls_Init(&rls, (uint8_t)(2 * cfg.order + 1), RLS_LAMBDA_ONE, P0);
+
+  t_start = millisec;
+  t_prev = millisec;
+  period = 0;
+  phase = 0;
+  lfsr = 0x1FF;
+  bit = 0;
+  y1 = y2 = u1 = 0;
+  history = 0;
+  fitted = 0;
+  sum_e2 = 0;
+  control = cfg.bias;
+  state = SYSID_RUNNING;
+  return 0;
+}
+
+int32_t Sysid_Step(int32_t velocity, uint32_t millisec) {
+  if (state != SYSID_RUNNING)
+    return 0;
+
+  if (velocity > cfg.limit || velocity < -cfg.limit) {
+    state = SYSID_FAILED;
+    return 0;
+  }
+
+  uint32_t elapsed = millisec - t_start;
+  uint32_t dt = millisec - t_prev;
+  t_prev = millisec;
+  if (period == 0)
+    period = dt;
+
+  // The new output and the control applied since the previous step, Q15
+  int32_t y = velocity * 32768 / SYSID_VELOCITY_SCALE;
+  int32_t u = control >> 15;
+
+  if (dt != period || dt == 0) {
+    // Irregular sample: restart the regressor history
+    history = 0;
+  } else if (history < 2) {
+    history++;
+  } else if (elapsed > cfg.settle_ms) {
+    int32_t phi[RLS_MAX_PARAMS];
+    uint32_t n = 0;
+
+    phi[n++] = -y1;
+    if (cfg.order == 2)
+      phi[n++] = -y2;
+    phi[n++] = u;
+    if (cfg.order == 2)
+      phi[n++] = u1;
+    phi[n++] = 1 << RLS_Q;
+
+    int64_t e = Rls_Update(&rls, phi, y);
+    sum_e2 += e * e;
+    fitted++;
+  }
+  y2 = y1;
+  y1 = y;
+  u1 = u;
+
+  if (elapsed >= cfg.settle_ms + cfg.duration_ms) {
+    Sysid_Finish();
+    return 0;
+  }
+
+  // Next excitation sample
+  int32_t excitation = 0;
+  if (elapsed >= cfg.settle_ms) {
+    uint32_t t = elapsed - cfg.settle_ms;
+    if (cfg.signal == SYSID_PRBS) {
+      // x^9 + x^5 + 1, one shift per bit period
+      while (bit < t / cfg.bit_ms) {
+        uint16_t fb = (uint16_t)(((lfsr >> 8) ^ (lfsr >> 4)) & 1);
+        lfsr = (uint16_t)(((lfsr << 1) | fb) & 0x1FF);
+        bit++;
+      }
+      excitation = lfsr & 1 ? cfg.amplitude : -cfg.amplitude;
+    } else {
+      // Instantaneous frequency f0 + (f1 - f0) * t / duration, in mHz
+      int64_t f = (int64_t)cfg.f_start_mhz +
+                  ((int64_t)cfg.f_stop_mhz - cfg.f_start_mhz) * t / cfg.duration_ms;
+      phase += (uint32_t)((uint64_t)f * dt * 4294967296ULL / 1000000);
+      excitation = (int32_t)(((int64_t)cfg.amplitude * Sysid_Sine(phase)) >> 15);
+    }
+  }
+
+  int64_t out = (int64_t)cfg.bias + excitation;
+  control = (int32_t)(out > CONTROL_MAX ? CONTROL_MAX : (out < CONTROL_MIN ? CONTROL_MIN : out));
+  return control;
+}
+
+Sysid_State_t Sysid_GetState(void) {
+  return state;
+}
+
+int32_t Sysid_GetResult(Sysid_Result_t *r) {
+  if (!r || state != SYSID_DONE)
+    return -1;
+
+  *r = result;
+  return 0;
+}
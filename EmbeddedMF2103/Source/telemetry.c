@@ -0,0 +1,149 @@
+/***
+ * Group: 8
+ *
+ * Members: Alice Ahlberg
+ *          Daniel Fjelkner
+ *          David Georgian Iosifescu
+ *
+ * Course code: MF2103
+ *
+ * Task description: Telemetry
+ *                   Batching of control-loop samples into telemetry frames.
+ *
+ * Compiler: ARM GCC
+ *
+ * Other information: The queue is single-producer (control thread) and
+ * single-consumer (telemetry thread), so it needs no lock.
+ *
+ * References: Course material MF2103
+ *
+ ***/
+
+#include "telemetry.h"
+#include "telemetry_codec.h"
+#include "main.h"
+#include <string.h>
+
+#define QUEUE_MASK (TELEMETRY_QUEUE - 1U)
+
+#if (TELEMETRY_QUEUE & QUEUE_MASK) != 0
+#error "TELEMETRY_QUEUE must be a power of two"
+#endif
+
+typedef struct {
+  uint32_t timestamp;
+  int32_t velocity;
+  int32_t control;
+  uint32_t latency;
+  int16_t encoder;
+} Telemetry_Entry_t;
+
+static Telemetry_Entry_t queue[TELEMETRY_QUEUE];
+static volatile uint32_t q_head = 0; // Written by the producer only
+static volatile uint32_t q_tail = 0; // Written by the consumer only
+static volatile uint32_t dropped = 0;
+static uint32_t sequence = 0;
+static uint32_t cycles_per_us = 1;
+static uint8_t format = TELEMETRY_FORMAT_DELTA;
+
+// Staging area of the consumer, keeps the batch off the thread stack
+static TelemetrySample_t batch[TELEMETRY_BATCH];
+
+void Telemetry_Init(void) {
+  q_head = 0;
+  q_tail = 0;
+  dropped = 0;
+  sequence = 0;
+
+  cycles_per_us = SystemCoreClock / 1000000u;
+  if (cycles_per_us == 0)
+    cycles_per_us = 1;
+}
+
+void Telemetry_Push(uint32_t timestamp, int32_t velocity, int32_t control,
+                    int16_t encoder, uint32_t latency) {
+  uint32_t head = q_head;
+
+  if (head - q_tail >= TELEMETRY_QUEUE) {
+    dropped++;
+    return;
+  }
+
+  Telemetry_Entry_t *e = &queue[head & QUEUE_MASK];
+  e->timestamp = timestamp;
+  e->velocity = velocity;
+  e->control = control;
+  e->latency = latency;
+  e->encoder = encoder;
+
+  // Publish the entry only once it is complete
+  __DMB();
+  q_head = head + 1U;
+}
+
+void Telemetry_SetFormat(uint8_t fmt) {
+  if (fmt == TELEMETRY_FORMAT_RAW || fmt == TELEMETRY_FORMAT_DELTA)
+    format = fmt;
+}
+
+uint32_t Telemetry_Pending(void) {
+  return q_head - q_tail;
+}
+
+uint16_t Telemetry_BuildFrame(uint8_t *frame, uint16_t size) {
+  // The codec needs room for a worst-case keyframe, not just a raw sample
+  uint32_t sample_max = format == TELEMETRY_FORMAT_DELTA ? TELEMETRY_CODEC_MAX_SAMPLE
+                                                         : (uint32_t)sizeof(TelemetrySample_t);
+  if (!frame || size < sizeof(TelemetryHeader_t) + sample_max)
+    return 0;
+
+  uint32_t tail = q_tail;
+  uint32_t count = q_head - tail;
+  uint32_t payload = size - (uint32_t)sizeof(TelemetryHeader_t);
+  uint32_t len;
+
+  if (count == 0)
+    return 0;
+  if (count > TELEMETRY_BATCH)
+    count = TELEMETRY_BATCH;
+
+  for (uint32_t i = 0; i < count; i++) {
+    const Telemetry_Entry_t *e = &queue[(tail + i) & QUEUE_MASK];
+    uint32_t latency_us = e->latency / cycles_per_us;
+
+    batch[i].timestamp = e->timestamp;
+    batch[i].velocity = e->velocity;
+    batch[i].control = e->control;
+    batch[i].encoder = e->encoder;
+    batch[i].latency_us = (uint16_t)(latency_us > 0xFFFFu ? 0xFFFFu : latency_us);
+  }
+
+  uint8_t *out = frame + sizeof(TelemetryHeader_t);
+  if (format == TELEMETRY_FORMAT_DELTA) {
+    // Each frame starts with a keyframe, a lost frame never corrupts the next
+    len = TelemetryCodec_Encode(batch, count, out, payload, &count);
+  } else {
+    uint32_t room = payload / (uint32_t)sizeof(TelemetrySample_t);
+    if (count > room)
+      count = room;
+    len = count * (uint32_t)sizeof(TelemetrySample_t);
+    memcpy(out, batch, len);
+  }
+  if (count == 0)
+    return 0;
+
+  TelemetryHeader_t header = {
+      .magic = TELEMETRY_MAGIC,
+      .format = format,
+      .count = (uint8_t)count,
+      .sequence = sequence++,
+      .dropped = dropped,
+  };
+  memcpy(frame, &header, sizeof(header));
+
+  // Release the slots to the producer
+  __DMB();
+  q_tail = tail + count;
+
+  return (uint16_t)(sizeof(header) + len);
+}
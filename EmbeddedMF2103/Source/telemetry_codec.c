@@ -0,0 +1,108 @@
+/***
+ * Group: 8
+ *
+ * Members: Alice Ahlberg
+ *          Daniel Fjelkner
+ *          David Georgian Iosifescu
+ *
+ * Course code: MF2103
+ *
+ * Task description: Telemetry Codec
+ *                   Delta, zig-zag and varint coding of telemetry samples.
+ *
+ * Compiler: ARM GCC
+ *
+ * Other information: Hardware independent, also built into the host tools.
+ * Deltas are computed modulo 2^32 so they never overflow.
+ *
+ * References: Course material MF2103
+ *
+ ***/
+
+#include "telemetry_codec.h"
+
+static inline uint32_t ZigZag(int32_t v) {
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t UnZigZag(uint32_t u) {
+  return (int32_t)((u >> 1) ^ (0U - (u & 1U)));
+}
+
+static inline uint8_t *PutVarint(uint8_t *p, uint32_t v) {
+  while (v >= 0x80U) {
+    *p++ = (uint8_t)(v | 0x80U);
+    v >>= 7;
+  }
+  *p++ = (uint8_t)v;
+  return p;
+}
+
+static inline const uint8_t *GetVarint(const uint8_t *p, const uint8_t *end,
+                                       uint32_t *v) {
+  uint32_t result = 0;
+
+  for (uint32_t shift = 0; shift < 35U && p < end; shift += 7U) {
+    uint8_t b = *p++;
+    result |= (uint32_t)(b & 0x7FU) << shift;
+    if (!(b & 0x80U)) {
+      *v = result;
+      return p;
+    }
+  }
+  return 0;
+}
+
+uint32_t TelemetryCodec_Encode(const TelemetrySample_t *in, uint32_t count,
+                               uint8_t *out, uint32_t size, uint32_t *encoded) {
+  uint8_t *p = out;
+  uint32_t n = 0;
+  TelemetrySample_t prev = {0};
+
+  // Never start a sample that might not fit
+  while (n < count && (uint32_t)(p - out) + TELEMETRY_CODEC_MAX_SAMPLE <= size) {
+    const TelemetrySample_t *s = &in[n];
+
+    // Deltas against zero for the keyframe
+    p = PutVarint(p, ZigZag((int32_t)(s->timestamp - prev.timestamp)));
+    p = PutVarint(p, ZigZag((int32_t)((uint32_t)s->velocity - (uint32_t)prev.velocity)));
+    p = PutVarint(p, ZigZag((int32_t)((uint32_t)s->control - (uint32_t)prev.control)));
+    p = PutVarint(p, ZigZag(s->encoder));
+    p = PutVarint(p, ZigZag(s->latency_us));
+
+    prev = *s;
+    n++;
+  }
+
+  if (encoded)
+    *encoded = n;
+  return (uint32_t)(p - out);
+}
+
+uint32_t TelemetryCodec_Decode(const uint8_t *in, uint32_t len, uint32_t count,
+                               TelemetrySample_t *out) {
+  const uint8_t *p = in;
+  const uint8_t *end = in + len;
+  uint32_t timestamp = 0, velocity = 0, control = 0;
+  uint32_t v[5];
+
+  for (uint32_t n = 0; n < count; n++) {
+    for (uint32_t f = 0; f < 5U; f++) {
+      p = GetVarint(p, end, &v[f]);
+      if (!p)
+        return 0;
+    }
+
+    timestamp += (uint32_t)UnZigZag(v[0]);
+    velocity += (uint32_t)UnZigZag(v[1]);
+    control += (uint32_t)UnZigZag(v[2]);
+
+    out[n].timestamp = timestamp;
+    out[n].velocity = (int32_t)velocity;
+    out[n].control = (int32_t)control;
+    out[n].encoder = (int16_t)UnZigZag(v[3]);
+    out[n].latency_us = (uint16_t)UnZigZag(v[4]);
+  }
+
+  return (uint32_t)(p - in);
+}
@@ -0,0 +1,184 @@
+/***
+ * Group: 8
+ *
+ * Members: Alice Ahlberg
+ *          Daniel Fjelkner
+ *          David Georgian Iosifescu
+ *
+ * Course code: MF2103
+ *
+ * Task description: Trajectory Generator
+ *                   Step, trapezoidal and S-curve reference profiles.
+ *
+ * Compiler: ARM GCC
+ *
+ * Other information: Every segment is a second-order polynomial of the time
+ * since the segment start, v = c0 + c1*t + c2*t^2, with velocities in RPM Q16
+ * and time in milliseconds. All divisions happen in Trajectory_Start().
+ *
+ * References: Course material MF2103
+ *
+ ***/
+
+#include "trajectory.h"
+
+#define Q 16
+#define MAX_SEGMENTS 3
+
+typedef struct {
+  uint32_t duration;       // Segment length in milliseconds
+  int64_t c0, c1, c2;      // Polynomial coefficients, RPM Q16
+} Trajectory_Segment_t;
+
+typedef struct {
+  uint32_t t0;             // Start time of the transition
+  uint32_t count;          // Number of segments before the hold
+  int32_t start;           // Reference held before t0
+  int32_t target;          // Reference held after the last segment
+  Trajectory_Segment_t seg[MAX_SEGMENTS];
+} Trajectory_Plan_t;
+
+// Double buffer: the evaluator only ever reads the published plan
+static Trajectory_Plan_t plans[2];
+static const Trajectory_Plan_t *volatile active = &plans[0];
+
+static Trajectory_Profile_t profile = TRAJECTORY_STEP;
+static uint32_t max_accel = 0;
+static uint32_t max_jerk = 0;
+
+static uint32_t ISqrt(uint64_t x) {
+  uint64_t r = 0;
+  uint64_t bit = (uint64_t)1 << 62;
+
+  while (bit > x)
+    bit >>= 2;
+  while (bit) {
+    if (x >= r + bit) {
+      x -= r + bit;
+      r = (r >> 1) + bit;
+    } else {
+      r >>= 1;
+    }
+    bit >>= 2;
+  }
+  return (uint32_t)r;
+}
+
+void Trajectory_Init(int32_t initial) {
+  profile = TRAJECTORY_STEP;
+  max_accel = 0;
+  max_jerk = 0;
+
+  plans[0].t0 = 0;
+  plans[0].count = 0;
+  plans[0].start = initial;
+  plans[0].target = initial;
+  active = &plans[0];
+}
+
+void Trajectory_Configure(Trajectory_Profile_t p, uint32_t accel, uint32_t jerk) {
+  if (accel == 0)
+    p = TRAJECTORY_STEP;
+  if (p == TRAJECTORY_SCURVE && jerk == 0)
+    p = TRAJECTORY_TRAPEZOID;
+
+  profile = p;
+  max_accel = accel;
+  max_jerk = jerk;
+}
+
+void Trajectory_Start(int32_t target, uint32_t millisec) {
+  Trajectory_Plan_t *plan = (active == &plans[0]) ? &plans[1] : &plans[0];
+  int64_t v0 = (int64_t)Trajectory_Evaluate(millisec) << Q;
+  int64_t v1 = (int64_t)target << Q;
+  int64_t dv = (int64_t)target - (v0 >> Q);
+  int64_t s = dv < 0 ? -1 : 1;
+  uint64_t dv_abs = (uint64_t)(dv < 0 ? -dv : dv);
+
+  plan->t0 = millisec;
+  plan->start = (int32_t)(v0 >> Q);
+  plan->target = target;
+  plan->count = 0;
+
+  if (dv_abs == 0 || profile == TRAJECTORY_STEP) {
+    // Hold the target right away
+  } else if (profile == TRAJECTORY_TRAPEZOID) {
+    // T = |dv| / A, rounded up so the ramp never exceeds A
+    uint32_t t = (uint32_t)((dv_abs * 1000U + max_accel - 1U) / max_accel);
+    Trajectory_Segment_t *seg = &plan->seg[0];
+
+    seg->duration = t;
+    seg->c0 = v0;
+    seg->c1 = (v1 - v0) / (int64_t)t;
+    seg->c2 = 0;
+    plan->count = 1;
+  } else {
+    // Jerk phase length: A/J, or sqrt(|dv|/J) if A is never reached
+    uint32_t tj, ta;
+    if (dv_abs * max_jerk >= (uint64_t)max_accel * max_accel) {
+      tj = (uint32_t)((uint64_t)max_accel * 1000U / max_jerk);
+      ta = (uint32_t)(dv_abs * 1000U / max_accel) - tj;
+    } else {
+      tj = ISqrt(dv_abs * 1000000U / max_jerk);
+      ta = 0;
+    }
+    if (tj == 0)
+      tj = 1;
+
+    // Half jerk in RPM/ms^2 Q16, sign of the transition included. Without a
+    // constant-acceleration phase both jerk phases must meet at mid-velocity.
+    int64_t hj = s * (int64_t)(((uint64_t)max_jerk << Q) / 2000000U);
+    if (ta == 0)
+      hj = (v1 - v0) / (2 * (int64_t)tj * (int64_t)tj);
+    int64_t bend = hj * (int64_t)tj * (int64_t)tj;
+    Trajectory_Segment_t *seg = plan->seg;
+
+    // 1. Acceleration builds up: v0 + hj*t^2
+    seg->duration = tj;
+    seg->c0 = v0;
+    seg->c1 = 0;
+    seg->c2 = hj;
+    seg++;
+
+    // 2. Constant acceleration joining both jerk phases
+    if (ta > 0) {
+      seg->duration = ta;
+      seg->c0 = v0 + bend;
+      seg->c1 = (v1 - bend - (v0 + bend)) / (int64_t)ta;
+      seg->c2 = 0;
+      seg++;
+    }
+
+    // 3. Acceleration decays: v1 - hj*(tj - t)^2, expanded in t
+    seg->duration = tj;
+    seg->c0 = v1 - bend;
+    seg->c1 = 2 * hj * (int64_t)tj;
+    seg->c2 = -hj;
+    seg++;
+
+    plan->count = (uint32_t)(seg - plan->seg);
+  }
+
+  // Publish the new plan
+  active = plan;
+}
+
+int32_t Trajectory_Evaluate(uint32_t millisec) {
+  const Trajectory_Plan_t *plan = active;
+  uint32_t t = millisec - plan->t0;
+
+  // A transition started ahead of time (Preview_Fill()) hasn't begun yet
+  if ((int32_t)t < 0)
+    return plan->start;
+
+  for (uint32_t i = 0; i < plan->count; i++) {
+    const Trajectory_Segment_t *seg = &plan->seg[i];
+    if (t < seg->duration) {
+      int64_t x = (int64_t)t;
+      return (int32_t)((seg->c0 + seg->c1 * x + seg->c2 * x * x) >> Q);
+    }
+    t -= seg->duration;
+  }
+
+  return plan->target;
+}
@@ -0,0 +1,116 @@
+#!/usr/bin/env python3
+"""
+Design a Q31 biquad cascade for Biquad_Coeffs_t (Include/biquad.h).
+
+Each stage is an RBJ cookbook low-pass or notch at the sampling rate of the
+velocity filter, quantized to Q31 with a post-shift of 1 (coefficients in
+[-2, 2)) in the CMSIS-DSP DF1 layout {b0, b1, b2, a1, a2}, where the
+feedback coefficients are negated:
+    y[n] = b0*x[n] + b1*x[n-1] + b2*x[n-2] + a1*y[n-1] + a2*y[n-2]
+
+Prints the C initializer of the cascade and its gain and group delay,
+computed from the quantized coefficients, at a few frequencies.
+
+Usage: python3 Tools/biquad_design.py <fs_hz> lowpass:<fc_hz>[:q] notch:<f0_hz>[:q] ...
+Example (client sampling every 10 ms):
+       python3 Tools/biquad_design.py 100 lowpass:4 notch:25:2
+"""
+
+import cmath
+import math
+import sys
+
+POST_SHIFT = 1
+MAX_STAGES = 4
+
+
+def lowpass(fc, q, fs):
+    w = 2 * math.pi * fc / fs
+    alpha = math.sin(w) / (2 * q)
+    c = math.cos(w)
+    return [(1 - c) / 2, 1 - c, (1 - c) / 2], [1 + alpha, -2 * c, 1 - alpha]
+
+
+def notch(f0, q, fs):
+    w = 2 * math.pi * f0 / fs
+    alpha = math.sin(w) / (2 * q)
+    c = math.cos(w)
+    return [1, -2 * c, 1], [1 + alpha, -2 * c, 1 - alpha]
+
+
+DESIGNS = {"lowpass": (lowpass, 0.7071), "notch": (notch, 2.0)}
+
+
+def quantize(b, a):
+    scale = 1 << (31 - POST_SHIFT)
+    coeffs = [x / a[0] for x in b] + [-x / a[0] for x in a[1:]]
+    q = [int(round(x * scale)) for x in coeffs]
+    if any(v < -(1 << 31) or v >= (1 << 31) for v in q):
+        raise ValueError("coefficient out of range for post-shift %d" % POST_SHIFT)
+    return q
+
+
+def response(stages, f, fs):
+    scale = float(1 << (31 - POST_SHIFT))
+    z1 = cmath.exp(-2j * math.pi * f / fs)
+    h = 1.0
+    for b0, b1, b2, a1, a2 in stages:
+        num = (b0 + b1 * z1 + b2 * z1 * z1) / scale
+        den = 1.0 - (a1 * z1 + a2 * z1 * z1) / scale
+        h *= num / den
+    return h
+
+
+def group_delay(stages, f, fs):
+    df = fs * 1e-5
+    p0 = cmath.phase(response(stages, max(f - df, 0.0), fs))
+    p1 = cmath.phase(response(stages, f + df, fs))
+    dp = (p1 - p0 + math.pi) % (2 * math.pi) - math.pi
+    return -dp / (2 * math.pi * (f + df - max(f - df, 0.0)))
+
+
+def main(argv):
+    if len(argv) < 3:
+        print(__doc__.strip())
+        return 2
+
+    fs = float(argv[1])
+    stages = []
+    for spec in argv[2:]:
+        parts = spec.split(":")
+        if parts[0] not in DESIGNS or len(parts) < 2:
+            print("unknown stage '%s', expected lowpass:<fc>[:q] or notch:<f0>[:q]" % spec)
+            return 2
+        design, q = DESIGNS[parts[0]]
+        f = float(parts[1])
+        if len(parts) > 2:
+            q = float(parts[2])
+        if not 0 < f < fs / 2:
+            print("stage '%s' is not below the Nyquist frequency %.1f Hz" % (spec, fs / 2))
+            return 2
+        stages.append(quantize(*design(f, q, fs)))
+
+    if len(stages) > MAX_STAGES:
+        print("at most %d stages" % MAX_STAGES)
+        return 2
+
+    print("/* %s at %g Hz */" % (" ".join(argv[2:]), fs))
+    print("{%d, %d, {" % (len(stages), POST_SHIFT))
+    for s in stages:
+        print("  %s," % ", ".join("%d" % v for v in s))
+    print("}}")
+    print()
+    print("%10s %10s %14s" % ("f Hz", "gain dB", "delay ms"))
+    for f in [0.0, fs / 100, fs / 50, fs / 20, fs / 10, fs / 5, fs / 4, fs / 2.5]:
+        g = abs(response(stages, f, fs))
+        if g < 1e-5:
+            # The phase jumps at a notch, the delay is meaningless there
+            print("%10.2f %10.2f %14s" % (f, 20 * math.log10(max(g, 1e-12)), "-"))
+        else:
+            print("%10.2f %10.2f %14.1f" % (f, 20 * math.log10(g), 1000 * group_delay(stages, f, fs)))
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,123 @@
+/***
+ * Host tool: controller step benchmark
+ *
+ * Times Controller_PIController() over a synthetic session that sweeps the
+ * reference and the measured velocity across both directions and past the
+ * last breakpoint of the gain schedule, with and without the schedule and
+ * the feedforward, and reports the cost of one step and the overhead of the
+ * schedule over fixed gains. The schedule lookup has no data-dependent
+ * branch, so its cost doesn't depend on the speed.
+ *
+ * Host numbers only bound the cost on the target; there the per-step cycles
+ * are the ones of Monitor_GetCycles() in the telemetry stream.
+ *
+ * Build (from EmbeddedMF2103/):
+ *   gcc -O2 -IInclude Tools/controller_bench.c Source/controller.c -o controller_bench
+ * Usage:
+ *   ./controller_bench [cpu_mhz]
+ ***/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "application.h"
+#include "controller.h"
+
+#define STEPS 4096
+#define ITERATIONS 500
+#define REPEATS 7          // Best of, against frequency scaling and other load
+
+static const MotorModel_t nominal = {MOTOR_GAIN, MOTOR_TAU, MOTOR_FRICTION};
+static const Controller_Schedule_t gain_schedule = {{GAIN_SCHEDULE_ROW, GAIN_SCHEDULE_ROW}, GAIN_SCHEDULE_SHIFT};
+
+static int32_t ref[STEPS], meas[STEPS];
+static uint32_t ms[STEPS];
+
+static double Now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void SynthSession(void) {
+  uint32_t seed = 1;
+
+  for (uint32_t i = 0; i < STEPS; i++) {
+    // Triangle from -3000 to +3000 RPM, the measurement lags with noise
+    int32_t phase = (int32_t)(i % 1024);
+    ref[i] = (phase < 512 ? phase : 1024 - phase) * 12 - 3000;
+    seed = seed * 1664525u + 1013904223u;
+    meas[i] = ref[i] - 40 + (int32_t)(seed >> 25);
+    ms[i] = (i + 1) * PERIOD_CTRL;
+  }
+}
+
+static double Time(const Controller_Schedule_t *schedule, uint8_t ff) {
+  volatile int32_t sink = 0;
+
+  Controller_SetFeedforward(ff ? &nominal : NULL, ff);
+  Controller_SetSchedule(schedule);
+
+  double best = 0.0;
+  for (int r = 0; r < REPEATS; r++) {
+    double t0 = Now();
+    for (int it = 0; it < ITERATIONS; it++) {
+      Controller_Reset();
+      for (uint32_t i = 0; i < STEPS; i++)
+        sink += Controller_PIController(&ref[i], &meas[i], &ms[i]);
+    }
+    double dt = Now() - t0;
+    if (r == 0 || dt < best)
+      best = dt;
+  }
+
+  (void)sink;
+  return best * 1e9 / ((double)STEPS * ITERATIONS);
+}
+
+int main(int argc, char **argv) {
+  static const uint8_t ff_all = CONTROLLER_FF_VELOCITY | CONTROLLER_FF_FRICTION | CONTROLLER_FF_ACCEL;
+  double mhz = argc > 1 ? atof(argv[1]) : 0.0;
+
+  SynthSession();
+
+  // Warm up the caches and the clock
+  Time(NULL, 0);
+
+  struct {
+    const char *name;
+    const Controller_Schedule_t *schedule;
+    uint8_t ff;
+    double ns;
+  } runs[] = {
+    {"PI", NULL, 0, 0.0},
+    {"PI + schedule", &gain_schedule, 0, 0.0},
+    {"PI + full ff", NULL, ff_all, 0.0},
+    {"PI + full ff + schedule", &gain_schedule, ff_all, 0.0},
+  };
+
+  printf("%-26s %10s", "configuration", "ns/step");
+  if (mhz > 0.0)
+    printf(" %14s", "cycles/step");
+  printf("\n");
+
+  for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+    runs[i].ns = Time(runs[i].schedule, runs[i].ff);
+    printf("%-26s %10.2f", runs[i].name, runs[i].ns);
+    if (mhz > 0.0)
+      printf(" %14.1f", runs[i].ns * mhz / 1000.0);
+    printf("\n");
+  }
+
+  double overhead = ((runs[1].ns - runs[0].ns) + (runs[3].ns - runs[2].ns)) / 2.0;
+  printf("\nschedule overhead: %.2f ns/step", overhead);
+  if (mhz > 0.0)
+    printf(", %.1f cycles/step at %.0f MHz", overhead * mhz / 1000.0, mhz);
+  printf("\n");
+
+  Controller_SetSchedule(NULL);
+  Controller_SetFeedforward(NULL, 0);
+  return 0;
+}
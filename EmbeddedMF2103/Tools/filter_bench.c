@@ -0,0 +1,265 @@
+/***
+ * Host tool: velocity filter benchmark
+ *
+ * Feeds the velocity filters of Peripheral_Encoder_CalculateVelocity() with
+ * the quantized encoder velocity of a simulated motor, sampled every 10 ms
+ * like the client, and compares the first-order low-pass with the biquad
+ * presets of peripherals.h (Source/biquad.c, reference implementation of
+ * arm_biquad_cascade_df1_q31()):
+ *
+ *   error   RMS of filtered minus true velocity in RPM, the true velocity
+ *           being the one of the motor without the ripple
+ *   ripple  the same RMS in the last second before each flip, where only the
+ *           25 Hz ripple, the quantization and the filter bias remain
+ *   lag     mean delay of the 50% crossing after a flip in milliseconds
+ *   exact   largest deviation of the Q31 cascade from the same cascade in
+ *           double precision, in RPM, including the rounding to 1 RPM
+ *   ns      time per sample on the host with one sample per call, as on
+ *           the target; with cpu_mhz also in host cycles at that clock
+ *   target  mean DWT cycles of Biquad_Process on the target, one sample per
+ *           call with the interrupts masked, from the "[biquad]" lines the
+ *           bare-metal application prints with FILTER_BENCH 1 (application.h)
+ *           in a saved console log; min and max follow the table
+ *
+ * Build (from EmbeddedMF2103/):
+ *   gcc -O2 -IInclude Tools/filter_bench.c Source/biquad.c -lm -o filter_bench
+ * Usage:
+ *   ./filter_bench [ripple_rpm] [cpu_mhz] [--target console.log]
+ ***/
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "biquad.h"
+#include "peripherals.h"
+
+#define PERIOD_SAMPLE 10
+#define PERIOD_REF 4000
+#define SESSION_MS 40000
+#define SAMPLES (SESSION_MS / PERIOD_SAMPLE)
+#define TAU_MS 80.0
+#define RIPPLE_HZ 25.0
+#define ITERATIONS 200
+
+static const Biquad_Coeffs_t lowpass = VELOCITY_LOWPASS_COEFFS;
+static const Biquad_Coeffs_t notch = VELOCITY_NOTCH_COEFFS;
+
+static int32_t raw[SAMPLES];   // Encoder counts per sample
+static double truth[SAMPLES];  // Velocity without the ripple at the sample in RPM
+static int32_t out[SAMPLES];
+
+/* DWT cycles of one preset measured on the target */
+typedef struct {
+  int found;
+  unsigned stages;
+  int cmsis;
+  unsigned long min, mean, max, mhz;
+} Target_t;
+
+/* Read the "[biquad] filter=<name> ..." lines of a console log */
+static int ReadTarget(const char *path, const char *name, Target_t *t) {
+  FILE *f = fopen(path, "r");
+  char line[256], key[32];
+
+  if (!f)
+    return -1;
+  while (fgets(line, sizeof(line), f)) {
+    const char *p = strstr(line, "[biquad] filter=");
+    Target_t r = {1, 0, 0, 0, 0, 0, 0};
+    if (p && sscanf(p, "[biquad] filter=%31s stages=%u cmsis=%d min=%lu mean=%lu max=%lu mhz=%lu", key,
+                    &r.stages, &r.cmsis, &r.min, &r.mean, &r.max, &r.mhz) == 7 &&
+        strcmp(key, name) == 0)
+      *t = r; // The last run of the log counts
+  }
+  fclose(f);
+  return 0;
+}
+
+static double Now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* First-order motor flipping between +-2000 RPM, with a mechanical ripple */
+static void Simulate(double ripple) {
+  double v = 0.0, pos = 0.0;
+  int32_t count_prev = 0;
+
+  for (uint32_t ms = 0; ms < SESSION_MS; ms++) {
+    double target = (ms / PERIOD_REF) & 1 ? -2000.0 : 2000.0;
+    v += (target - v) / TAU_MS;
+    double w = v + ripple * sin(2.0 * M_PI * RIPPLE_HZ * ms * 1e-3);
+    pos += w * RESOLUTION / 60000.0;
+
+    if ((ms + 1) % PERIOD_SAMPLE == 0) {
+      int32_t count = (int32_t)floor(pos);
+      raw[ms / PERIOD_SAMPLE] = count - count_prev;
+      truth[ms / PERIOD_SAMPLE] = v;
+      count_prev = count;
+    }
+  }
+}
+
+/* The two paths of Peripheral_Encoder_CalculateVelocity() */
+static int32_t FirstOrder(int32_t counts, int32_t *rpm_filt) {
+  int64_t num = (int64_t)counts * 60000;
+  int64_t den = (int64_t)RESOLUTION * PERIOD_SAMPLE;
+  int32_t rpm = (int32_t)(num / den);
+
+  *rpm_filt = (int32_t)(((int64_t)VELOCITY_ALPHA * rpm +
+                         (int64_t)(1000 - VELOCITY_ALPHA) * *rpm_filt) / 1000);
+  return *rpm_filt;
+}
+
+static int32_t Cascade(int32_t counts, Biquad_t *f) {
+  int64_t num = (int64_t)counts * 60000;
+  int64_t den = (int64_t)RESOLUTION * PERIOD_SAMPLE;
+  int32_t x = (int32_t)(num * (1 << VELOCITY_Q) / den), y;
+
+  Biquad_Process(f, &x, &y, 1);
+  return (int32_t)(((int64_t)y + (1 << (VELOCITY_Q - 1))) >> VELOCITY_Q);
+}
+
+static void Run(const Biquad_Coeffs_t *coeffs) {
+  Biquad_t f;
+  int32_t rpm_filt = 0;
+
+  if (coeffs)
+    Biquad_Init(&f, coeffs);
+  for (uint32_t n = 0; n < SAMPLES; n++)
+    out[n] = coeffs ? Cascade(raw[n], &f) : FirstOrder(raw[n], &rpm_filt);
+}
+
+/* The cascade in double precision, on the unquantized input of Cascade() */
+static double Exact(const Biquad_Coeffs_t *coeffs) {
+  const double scale = ldexp(1.0, 31 - coeffs->post_shift);
+  double s[4 * BIQUAD_MAX_STAGES] = {0};
+  double worst = 0.0;
+
+  for (uint32_t n = 0; n < SAMPLES; n++) {
+    double x = raw[n] * 60000.0 / (RESOLUTION * PERIOD_SAMPLE);
+    for (uint32_t k = 0; k < coeffs->stages; k++) {
+      const int32_t *c = &coeffs->coeffs[5 * k];
+      double *st = &s[4 * k];
+      double y = (c[0] * x + c[1] * st[0] + c[2] * st[1] + c[3] * st[2] + c[4] * st[3]) / scale;
+      st[1] = st[0];
+      st[0] = x;
+      st[3] = st[2];
+      st[2] = y;
+      x = y;
+    }
+    if (fabs(x - out[n]) > worst)
+      worst = fabs(x - out[n]);
+  }
+  return worst;
+}
+
+int main(int argc, char **argv) {
+  const char *log = NULL;
+  int pos = 0;
+  double ripple = 30.0, mhz = 0.0;
+  for (int a = 1; a < argc; a++) {
+    if (!strcmp(argv[a], "--target") && a + 1 < argc)
+      log = argv[++a];
+    else if (pos++ == 0)
+      ripple = atof(argv[a]);
+    else
+      mhz = atof(argv[a]);
+  }
+  const struct {
+    const char *name;
+    const Biquad_Coeffs_t *coeffs;
+    const char *preset;   // Name in the target log
+  } filters[] = {
+    {"first-order alpha 0.1", NULL, NULL},
+    {"biquad low-pass 4 Hz", &lowpass, "lowpass"},
+    {"biquad + notch 25 Hz", &notch, "notch"},
+  };
+  Target_t target[3] = {{0}};
+
+  if (log) {
+    for (size_t i = 0; i < 3; i++) {
+      if (filters[i].preset && ReadTarget(log, filters[i].preset, &target[i]) != 0) {
+        perror(log);
+        return 1;
+      }
+    }
+  }
+
+  Simulate(ripple);
+  printf("sampling %d ms, %.0f RPM ripple at %.0f Hz, %d CPR\n\n", PERIOD_SAMPLE, ripple, RIPPLE_HZ, RESOLUTION);
+  printf("%-24s %8s %8s %8s %8s %8s", "filter", "error", "ripple", "lag ms", "exact", "ns");
+  if (mhz > 0.0)
+    printf(" %8s", "cycles");
+  if (log)
+    printf(" %8s", "target");
+  printf("\n");
+
+  for (size_t i = 0; i < sizeof(filters) / sizeof(filters[0]); i++) {
+    double err = 0.0, rip = 0.0, lag = 0.0;
+    uint32_t n_rip = 0, flips = 0;
+
+    Run(filters[i].coeffs);
+    for (uint32_t n = 0; n < SAMPLES; n++) {
+      double e = out[n] - truth[n];
+      uint32_t ms = (n + 1) * PERIOD_SAMPLE;
+      err += e * e;
+      if (ms % PERIOD_REF > PERIOD_REF - 1000) {
+        rip += e * e;
+        n_rip++;
+      }
+    }
+
+    // 50% crossing of the filtered velocity after the true one
+    for (uint32_t flip = PERIOD_REF; flip < SESSION_MS; flip += PERIOD_REF) {
+      double sign = (flip / PERIOD_REF) & 1 ? -1.0 : 1.0;
+      int32_t t_true = -1, t_filt = -1;
+      for (uint32_t n = flip / PERIOD_SAMPLE; n < (flip + PERIOD_REF) / PERIOD_SAMPLE; n++) {
+        if (t_true < 0 && sign * truth[n] >= 0.0)
+          t_true = (int32_t)n;
+        if (t_filt < 0 && sign * out[n] >= 0.0)
+          t_filt = (int32_t)n;
+      }
+      if (t_true >= 0 && t_filt >= 0) {
+        lag += (t_filt - t_true) * PERIOD_SAMPLE;
+        flips++;
+      }
+    }
+
+    double exact = filters[i].coeffs ? Exact(filters[i].coeffs) : 0.0;
+
+    double t0 = Now();
+    for (int it = 0; it < ITERATIONS; it++)
+      Run(filters[i].coeffs);
+    double ns = (Now() - t0) * 1e9 / ((double)SAMPLES * ITERATIONS);
+
+    printf("%-24s %8.2f %8.2f %8.1f %8.3f %8.2f", filters[i].name, sqrt(err / SAMPLES),
+           sqrt(rip / n_rip), flips ? lag / flips : 0.0, exact, ns);
+    if (mhz > 0.0)
+      printf(" %8.1f", ns * mhz / 1000.0);
+    if (log && target[i].found)
+      printf(" %8lu", target[i].mean);
+    else if (log)
+      printf(" %8s", "-");
+    printf("\n");
+  }
+
+  if (log) {
+    printf("\n");
+    for (size_t i = 0; i < 3; i++) {
+      const Target_t *t = &target[i];
+      if (!t->found)
+        continue;
+      printf("target %-17s %u stage(s), %s, %lu..%lu cycles, %.2f us at %lu MHz\n", filters[i].preset,
+             t->stages, t->cmsis ? "CMSIS-DSP" : "reference", t->min, t->max,
+             t->mhz ? (double)t->mean / (double)t->mhz : 0.0, t->mhz);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+"""
+Print the Bode data of the server's frequency-response analyzer.
+
+Listens for FraReport_t datagrams on UDP port 5004 (FRA_PORT) while the
+server, built with FRA (application.h), runs control_mode 3
+(Tools/param_tool.py) and prints the loop gain L = C P at each frequency
+as it is measured, then the crossover frequency and the stability margins. With an output file the points are also written
+as CSV (freq_hz, gain_db, phase_deg, amplitude_rpm), one file per sweep.
+
+Usage: python3 Tools/fra_capture.py [output.csv] [--port 5004]
+"""
+
+import math
+import socket
+import struct
+import sys
+
+FRA_MAGIC = 0x5246
+REPORT_POINT, REPORT_RESULT, REPORT_FAILED = 0, 1, 2
+REPORT = struct.Struct("<HBB4i")
+
+
+def db(milli):
+    return 20.0 * math.log10(milli / 1000.0) if milli > 0 else float("-inf")
+
+
+def main(argv):
+    out_path = None
+    port = 5004
+    args = list(argv[1:])
+    while args:
+        a = args.pop(0)
+        if a == "--port" and args:
+            port = int(args.pop(0))
+        else:
+            out_path = a
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("", port))
+    print("listening on udp/%d" % port)
+
+    f = None
+    try:
+        while True:
+            data, addr = sock.recvfrom(64)
+            if len(data) != REPORT.size:
+                continue
+            magic, rtype, index, *value = REPORT.unpack(data)
+            if magic != FRA_MAGIC:
+                continue
+
+            if rtype == REPORT_POINT:
+                if index == 0:
+                    print("%s: new sweep" % addr[0])
+                    print("%10s %10s %10s %10s" % ("freq Hz", "gain dB", "phase deg", "ampl RPM"))
+                    if out_path:
+                        if f:
+                            f.close()
+                        f = open(out_path, "w")
+                        f.write("freq_hz,gain_db,phase_deg,amplitude_rpm\n")
+                row = (value[0] / 1000.0, db(value[1]), value[2] / 10.0, value[3])
+                print("%10.2f %10.2f %10.1f %10d" % row)
+                if f:
+                    f.write("%.3f,%.2f,%.1f,%d\n" % row)
+                    f.flush()
+            elif rtype == REPORT_RESULT:
+                print("%d points" % index)
+                if value[0]:
+                    print("  crossover %.2f Hz, phase margin %.1f deg" % (value[0] / 1000.0, value[1] / 10.0))
+                else:
+                    print("  no gain crossover in the sweep")
+                if value[2]:
+                    print("  phase crossover %.2f Hz, gain margin %.1f dB" % (value[2] / 1000.0, db(value[3])))
+                else:
+                    print("  no phase crossover in the sweep")
+            elif rtype == REPORT_FAILED:
+                print("sweep aborted on the velocity limit after %d points" % index)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if f:
+            f.close()
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+"""
+Per-module flash/RAM budget from an armlink map file.
+
+Reads the "Image component sizes" table and the execution regions of
+Listings/Projects.map and prints, for every object and library member,
+the flash cost (Code + RO Data + RW Data init values) and the RAM cost
+(RW Data + ZI Data), sorted by RAM use.
+
+Usage: python3 Tools/map_budget.py [Listings/Projects.map] [--top N]
+"""
+
+import re
+import sys
+
+FLASH_SIZE = 1024 * 1024        # STM32L476RG internal flash
+SRAM1_SIZE = 96 * 1024
+SRAM2_SIZE = 32 * 1024
+
+ROW = re.compile(r"^\s*(\d+)\s+(\d+)\s+(\d+)\s+(\d+)\s+(\d+)\s+(\d+)\s+(\S.*?)\s*$")
+REGION = re.compile(r"Execution Region (\S+) \(Exec base: (0x[0-9a-fA-F]+).*?Size: (0x[0-9a-fA-F]+)")
+RAM_SECTION = re.compile(
+    r"^\s*(0x[0-9a-fA-F]+)\s+(?:0x[0-9a-fA-F]+|-)\s+(0x[0-9a-fA-F]+)\s+(Data|Zero)\s+RW\s+\d+\s+\*?\s*(\S+)\s+(\S+)\s*$")
+
+
+def parse(path):
+    modules = []
+    regions = []
+    ram_sections = []
+    in_sizes = False
+
+    with open(path, errors="replace") as f:
+        for line in f:
+            if "Image component sizes" in line:
+                in_sizes = True
+                continue
+            if in_sizes and "Grand Totals" in line:
+                in_sizes = False
+                continue
+
+            m = REGION.search(line)
+            if m:
+                regions.append((m.group(1), int(m.group(2), 16), int(m.group(3), 16)))
+                continue
+
+            m = RAM_SECTION.match(line)
+            if m:
+                ram_sections.append((int(m.group(2), 16), m.group(4), m.group(5)))
+                continue
+
+            if in_sizes:
+                m = ROW.match(line)
+                if m and not m.group(7).startswith("(") and "Totals" not in m.group(7):
+                    code, _, ro, rw, zi, _ = (int(x) for x in m.groups()[:6])
+                    modules.append((m.group(7), code, ro, rw, zi))
+
+    return modules, regions, ram_sections
+
+
+def main(argv):
+    path = "Listings/Projects.map"
+    top = 10
+    args = list(argv[1:])
+    while args:
+        a = args.pop(0)
+        if a == "--top" and args:
+            top = int(args.pop(0))
+        else:
+            path = a
+
+    modules, regions, ram_sections = parse(path)
+    if not modules:
+        print("no 'Image component sizes' table found in %s" % path)
+        return 1
+
+    # Library names repeat their members, keep only object files
+    modules = [m for m in modules if m[0].endswith(".o")]
+    modules.sort(key=lambda m: (m[3] + m[4], m[1] + m[2] + m[3]), reverse=True)
+
+    print("%-32s %8s %8s" % ("Module", "Flash", "RAM"))
+    print("-" * 50)
+    flash_total = ram_total = 0
+    for name, code, ro, rw, zi in modules:
+        flash = code + ro + rw
+        ram = rw + zi
+        flash_total += flash
+        ram_total += ram
+        print("%-32s %8d %8d" % (name, flash, ram))
+    print("-" * 50)
+    print("%-32s %8d %8d" % ("Total", flash_total, ram_total))
+    print()
+
+    sram1 = sram2 = 0
+    for name, base, size in regions:
+        if 0x20000000 <= base < 0x20000000 + SRAM1_SIZE:
+            sram1 += size
+        elif 0x10000000 <= base < 0x10000000 + SRAM2_SIZE:
+            sram2 += size
+    print("Flash: %7d / %7d bytes (%.1f%%)" % (flash_total, FLASH_SIZE, 100.0 * flash_total / FLASH_SIZE))
+    print("SRAM1: %7d / %7d bytes (%.1f%%)" % (sram1, SRAM1_SIZE, 100.0 * sram1 / SRAM1_SIZE))
+    print("SRAM2: %7d / %7d bytes (%.1f%%)" % (sram2, SRAM2_SIZE, 100.0 * sram2 / SRAM2_SIZE))
+
+    if ram_sections and top > 0:
+        print()
+        print("Largest RAM sections:")
+        for size, section, obj in sorted(ram_sections, reverse=True)[:top]:
+            print("  %7d  %-28s %s" % (size, section, obj))
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+"""
+Read or write the runtime parameters of a board over UDP port 5003.
+
+Sends one ParamMessage_t request (network_protocol.h) and prints the reply.
+The server owns kp, ki, control_max, control_min, control_mode (0 velocity
+square wave, 1 position loop, 2 identification experiment, 3 swept-sine
+loop measurement streamed to Tools/fra_capture.py, with FRA) and position
+(target in encoder counts, writing it starts a move, taken when the
+position mode is entered), and reports the read-only motor model
+model_gain (RPM at full control), model_tau (ms) and model_friction
+(control units), which an identification experiment replaces when it
+succeeds, as does the online adaptation when the server is built with
+ADAPT; the client owns filter_alpha, period and filter_mode (0 first-order
+low-pass, 1 biquad low-pass, 2 biquad low-pass and notch, 3 tracking
+observer); writing a parameter to the wrong board is rejected with status
+"unsupported". Written values take effect at the start of the next control
+cycle, the connection is left untouched.
+
+The identification experiment fits the model on the velocity the client
+sends, so set filter_alpha=1000 on the client while it runs; the server falls
+back to control_mode 0 when the experiment ends, as after a sweep.
+
+Example, move 5 revolutions from the start position:
+       python3 Tools/param_tool.py 192.168.0.10 set control_mode=1 position=10240
+Identify the motor, then read the model once control_mode is back to 0:
+       python3 Tools/param_tool.py <client_ip> set filter_alpha=1000
+       python3 Tools/param_tool.py 192.168.0.10 set control_mode=2
+       python3 Tools/param_tool.py 192.168.0.10 get
+Measure the loop gain and the stability margins of the current gains:
+       python3 Tools/fra_capture.py bode.csv &
+       python3 Tools/param_tool.py 192.168.0.10 set control_mode=3
+
+Usage: python3 Tools/param_tool.py <board_ip> get
+       python3 Tools/param_tool.py <board_ip> set name=value [name=value ...]
+"""
+
+import random
+import socket
+import struct
+import sys
+
+PARAM_PORT = 5003
+PARAM_MAGIC = 0x5250
+MSG_READ, MSG_WRITE, MSG_REPLY = 0, 1, 2
+NAMES = ["kp", "ki", "control_max", "control_min", "filter_alpha", "period", "filter_mode",
+         "control_mode", "position", "model_gain", "model_tau", "model_friction"]
+STATUS = ["ok", "unsupported", "range", "busy", "invalid"]
+MESSAGE = struct.Struct("<HBBII%di" % len(NAMES))
+
+
+def request(ip, msg_type, values, timeout=1.0):
+    mask = 0
+    fields = [0] * len(NAMES)
+    for name, value in values.items():
+        i = NAMES.index(name)
+        mask |= 1 << i
+        fields[i] = value
+
+    sequence = random.getrandbits(32)
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(timeout)
+    sock.sendto(MESSAGE.pack(PARAM_MAGIC, msg_type, 0, sequence, mask, *fields), (ip, PARAM_PORT))
+
+    # The board polls every 100 ms, skip replies to older requests
+    while True:
+        data, _ = sock.recvfrom(MESSAGE.size)
+        if len(data) != MESSAGE.size:
+            continue
+        magic, rtype, status, rseq, rmask, *rvalues = MESSAGE.unpack(data)
+        if magic == PARAM_MAGIC and rtype == MSG_REPLY and rseq == sequence:
+            return status, rmask, rvalues
+
+
+def main(argv):
+    if len(argv) < 3 or argv[2] not in ("get", "set"):
+        print(__doc__.strip())
+        return 2
+
+    values = {}
+    for arg in argv[3:]:
+        name, _, value = arg.partition("=")
+        if name not in NAMES or not value:
+            print("unknown parameter '%s', expected one of: %s" % (arg, ", ".join(NAMES)))
+            return 2
+        values[name] = int(value, 0)
+
+    try:
+        status, mask, fields = request(argv[1], MSG_WRITE if argv[2] == "set" else MSG_READ, values)
+    except socket.timeout:
+        print("no reply from %s:%d" % (argv[1], PARAM_PORT))
+        return 1
+
+    print("status: %s" % (STATUS[status] if status < len(STATUS) else status))
+    for i, name in enumerate(NAMES):
+        if mask & (1 << i):
+            print("  %-13s %d" % (name, fields[i]))
+
+    return 0 if status == 0 else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
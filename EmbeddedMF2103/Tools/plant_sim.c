@@ -0,0 +1,1083 @@
+/***
+ * Host tool: closed-loop plant simulator
+ *
+ * Runs the firmware controller (Source/controller.c), trajectory generator
+ * (Source/trajectory.c), Smith predictor (Source/predictor.c), relay
+ * autotuner (Source/autotune.c), gain schedule, velocity observer
+ * (Source/observer.c), disturbance observer, position cascade
+ * (Source/position.c), system identification (Source/sysid.c),
+ * frequency-response analyzer (Source/fra.c), online model adaptation
+ * (Source/adapt.c), friction and cogging compensation (Source/cogging.c) and
+ * half-bridge linearization (Source/actuator.c) against a first-order model
+ * of the motor with Coulomb friction, the PWM of Peripheral_PWM_ActuateMotor()
+ * with its optional dithering, a 2048 CPR encoder and the velocity filter
+ * of Peripheral_Encoder_CalculateVelocity(). The target flips between
+ * +2000 and -2000 RPM every PERIOD_REF ms, like the application.
+ *
+ * Modes:
+ *   ff      bare-metal loop (PERIOD_CTRL), compares the feedforward terms
+ *   delay   networked loop (client sampling every 10 ms, control computed on
+ *           the server), sweeps the injected round-trip delay with and
+ *           without the Smith predictor and reports the delay margin; the
+ *           predictor measures the round trip from the echoed send time
+ *   autotune relay experiment at the given sampling period, then compares
+ *           the default gains with the tuned ones
+ *   schedule compares the fixed gains with the GAIN_SCHEDULE_ROW schedule of
+ *           application.h at the given sampling period
+ *   observer compares the velocity filter with the tracking observer of the
+ *           given bandwidth at increasing gains, and reports the RMS error
+ *           of the velocity estimate overall (lag) and before each flip
+ *           (noise)
+ *   load    applies a constant load torque from LOAD_ON to LOAD_OFF ms into
+ *           each plateau and compares the PI controller with full
+ *           feedforward alone and with the load compensation of the
+ *           disturbance observer at increasing bandwidths, on the velocity
+ *           observer of the given bandwidth (0 for the filter)
+ *   position position loop of application.h around the velocity PI with
+ *           full feedforward, moving between 0 and POSITION_MOVE counts
+ *           every PERIOD_REF ms, at increasing position loop dividers
+ *   sysid   identification experiments (PRBS and chirp, first and second
+ *           order ARX) on the unfiltered velocity, comparing the identified
+ *           model with the simulated motor
+ *   fra     swept-sine measurement of the loop gain of the default PI at
+ *           the given sampling period, compared point by point with the
+ *           exact loop gain of the sampled linear loop (motor, encoder
+ *           averaging over the period, low-pass filter, PI), and the
+ *           stability margins
+ *   adapt   full feedforward on the nominal model against a motor that
+ *           differs from it, without and with the online adaptation of
+ *           the model at the given sampling period, and the last adapted
+ *           model
+ *   cogging adds a cogging torque of the given amplitude and COG_CYCLES
+ *           periods per revolution, calibrates the compensation table,
+ *           aligns it again after a simulated reboot at another rotor angle,
+ *           then compares it with the friction feedforward at the given
+ *           sampling period
+ *   deadband adds a half-bridge deadband of the given duty cycle, flips the
+ *           target between +/- the given speed and compares the PI alone
+ *           and with full feedforward, without and with the linearization,
+ *           exact and off by 1% of duty either way
+ *   dither  flips the target between +/- the given speed with full
+ *           feedforward on the velocity observer of the given bandwidth
+ *           and compares the 11-bit PWM with increasing dithered
+ *           fractional bits, up to the given number; with the filter the
+ *           encoder resolution hides the PWM steps at low speed
+ *
+ * Each run reports:
+ *   settle  mean time after a flip until the true velocity stays within 2%
+ *           of the target, n/a if no flip settled
+ *   IAE     integral of |target - velocity| in RPM*s, per flip
+ *   track   integral of |reference - velocity| in RPM*s, per flip
+ *   osc     largest peak-to-peak velocity in the last 500 ms before a flip,
+ *           in % of the target; above 10% the loop is counted as unstable
+ *   dip     largest velocity error after a load step in RPM (load mode)
+ *   recover mean time after a load step until the true velocity stays
+ *           within 2% of the target, n/a if none did (load mode)
+ *   move    mean time after a move until the position stays within
+ *           POSITION_BAND counts of the target, n/a if none did
+ *           (position mode)
+ *   over    largest overshoot past the target in counts (position mode)
+ *   error   mean absolute position error at the end of the moves in counts
+ *           (position mode)
+ *
+ * The link is a pure delay split evenly between both directions, plus a
+ * random uplink jitter that keeps the packet order (TCP); the client's reply
+ * timeout is not modelled. The client echoes the send time of the last
+ * control it received (ClientData_t.echo) like app-client.c.
+ *
+ * Build (from EmbeddedMF2103/):
+ *   gcc -O2 -IInclude Tools/plant_sim.c Source/controller.c Source/trajectory.c \
+ *       Source/predictor.c Source/autotune.c Source/observer.c Source/position.c \
+ *       Source/rls.c Source/sysid.c Source/fra.c Source/adapt.c Source/cogging.c \
+ *       Source/actuator.c -lm -o plant_sim
+ * Usage:
+ *   ./plant_sim ff [step|trapezoid|scurve] [gain_rpm] [tau_ms] [friction_pct]
+ *   ./plant_sim delay [step|trapezoid|scurve] [jitter_ms] [gain_rpm] [tau_ms] [friction_pct]
+ *   ./plant_sim autotune [step|trapezoid|scurve] [period_ms] [gain_rpm] [tau_ms] [friction_pct]
+ *   ./plant_sim schedule [step|trapezoid|scurve] [period_ms] [gain_rpm] [tau_ms] [friction_pct]
+ *   ./plant_sim observer [step|trapezoid|scurve] [period_ms] [bandwidth_rad_s] [gain_rpm] [tau_ms] [friction_pct]
+ *   ./plant_sim load [step|trapezoid|scurve] [period_ms] [bandwidth_rad_s] [load_pct] [gain_rpm] [tau_ms] [friction_pct]
+ *   ./plant_sim position [step|trapezoid|scurve] [period_ms] [kp_rpm_per_rev] [gain_rpm] [tau_ms] [friction_pct]
+ *   ./plant_sim sysid [step|trapezoid|scurve] [period_ms] [gain_rpm] [tau_ms] [friction_pct]
+ *   ./plant_sim fra [step|trapezoid|scurve] [period_ms] [gain_rpm] [tau_ms] [friction_pct]
+ *   ./plant_sim adapt [step|trapezoid|scurve] [period_ms] [gain_rpm] [tau_ms] [friction_pct]
+ *   ./plant_sim cogging [step|trapezoid|scurve] [period_ms] [cogging_pct] [gain_rpm] [tau_ms] [friction_pct]
+ *   ./plant_sim deadband [step|trapezoid|scurve] [period_ms] [deadband_pct] [speed_rpm] [gain_rpm] [tau_ms] [friction_pct]
+ *   ./plant_sim dither [step|trapezoid|scurve] [period_ms] [bandwidth_rad_s] [bits] [speed_rpm] [gain_rpm] [tau_ms] [friction_pct]
+ *
+ * The plant arguments set the simulated motor; the controller always uses
+ * the nominal model of application.h, so they show sensitivity to model error.
+ ***/
+
+#include <complex.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "actuator.h"
+#include "adapt.h"
+#include "application.h"
+#include "autotune.h"
+#include "cogging.h"
+#include "controller.h"
+#include "fra.h"
+#include "observer.h"
+#include "peripherals.h"
+#include "position.h"
+#include "predictor.h"
+#include "sysid.h"
+#include "trajectory.h"
+
+#define PWM_ARR 2047         // TIM3 auto-reload
+#define PWM_PERIODS_MS 20    // TIM3 updates per millisecond (19.5 kHz)
+#define PERIOD_SAMPLE 10     // Client sampling period, as in app-client.c
+#define SESSION_MS 40000     // Ten flips
+#define SETTLE_BAND 0.02
+#define OSC_WINDOW 500       // Window before each flip checked for oscillation
+#define OSC_LIMIT 0.10
+#define CLOCK_OFFSET 123456u // Server clock minus client clock
+#define PREDICTOR_BASE_DELAY 2 // Loop delay before the first measured round trip, as in app-server.c
+#define MAX_PENDING 256
+#define AUTOTUNE_LEAD_MS 5000 // Settling at the setpoint before the relay starts
+#define LOAD_ON 1500         // Load steps into each plateau
+#define LOAD_OFF 3000
+#define POSITION_BAND 20     // Position settling band in counts (3.5 degrees)
+#define COG_CYCLES 6         // Cogging periods per revolution
+#define COG_REBOOT 700.0     // Rotor angle at the encoder zero after the simulated reboot, in counts
+
+// Nominal model used by the feedforward and the predictor, as in the application
+static const MotorModel_t nominal = {MOTOR_GAIN, MOTOR_TAU, MOTOR_FRICTION};
+static const Controller_Schedule_t gain_schedule = {{GAIN_SCHEDULE_ROW, GAIN_SCHEDULE_ROW}, GAIN_SCHEDULE_SHIFT};
+
+typedef struct {
+  double gain;     // RPM at full duty
+  double tau_ms;
+  double friction; // Fraction of full duty
+} Plant_t;
+
+typedef struct {
+  Trajectory_Profile_t profile;
+  uint32_t period;       // Sampling period in milliseconds
+  uint8_t ff;            // CONTROLLER_FF_x terms
+  uint8_t networked;     // Control computed on the server
+  uint8_t smith;         // Smith predictor on the server
+  uint32_t delay_ms;     // Injected round-trip delay
+  uint32_t jitter_ms;    // Maximum extra uplink delay
+  const Controller_Schedule_t *schedule; // Gain schedule, NULL for fixed gains
+  uint32_t dob;          // Disturbance observer bandwidth, 0 disabled
+  uint8_t adapt;         // Online model adaptation (bare-metal loop)
+} Sim_t;
+
+typedef struct {
+  double settle_ms;      // Negative if no flip settled
+  double iae;
+  double track;
+  double osc;
+  uint32_t unsettled;
+  double est_err;        // RMS of estimated minus true velocity
+  double est_noise;      // Same, in the oscillation windows
+  double load_dip;
+  double load_recover;   // Negative if no load step recovered
+  uint32_t unrecovered;
+} Result_t;
+
+typedef struct {
+  double v;              // True velocity in RPM
+  double pos;            // Encoder position in counts
+  int32_t count_prev;
+  int32_t rpm_filt;
+} Motor_t;
+
+typedef struct {
+  uint32_t at;           // Delivery time on the client clock
+  int32_t value;
+  uint32_t ts;           // Sample time (uplink) or server send time (downlink)
+  uint32_t echo;         // ClientData_t.echo (uplink)
+} Event_t;
+
+static Event_t uplink[MAX_PENDING], downlink[MAX_PENDING];
+static uint32_t n_up, n_down;
+static uint32_t observer_bw; // Velocity observer bandwidth, 0 for the filter
+static double load;          // Load torque in fraction of full duty, 0 for none
+static uint8_t unfiltered;   // Velocity without the low-pass filter
+static MotorModel_t adapted; // Last adapted model, and how many were applied
+static uint32_t n_adapted;
+static double cogging;       // Cogging torque amplitude in fraction of full duty
+static double cog_origin;    // Rotor angle at the encoder zero in counts
+static uint8_t compensate;   // Friction and cogging table in the actuator path (bare-metal loop)
+static double deadband;      // Duty cycle the half-bridge loses, in fraction of full duty
+static int32_t amplitude = 2000; // Target of the flips in RPM
+static uint32_t dither_bits; // Fractional duty bits of the PWM, 0 for 11 bits
+static uint32_t dither_acc;  // Fraction carried over between PWM periods
+
+static void Post(Event_t *queue, uint32_t *n, Event_t e) {
+  if (*n < MAX_PENDING)
+    queue[(*n)++] = e;
+}
+
+/* Remove the first event due at ms, 0 if none */
+static int Take(Event_t *queue, uint32_t *n, uint32_t ms, Event_t *e) {
+  for (uint32_t i = 0; i < *n; i++) {
+    if (queue[i].at <= ms) {
+      *e = queue[i];
+      memmove(&queue[i], &queue[i + 1], (*n - i - 1) * sizeof(*queue));
+      (*n)--;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Encoder reading and velocity filter or observer, as in peripherals.c */
+static int32_t Motor_Sense(Motor_t *m, uint32_t period, uint32_t ms) {
+  int32_t count = (int32_t)floor(m->pos);
+
+  if (observer_bw) {
+    if (ms)
+      Observer_Update(count - m->count_prev, period);
+    else
+      Observer_Init(observer_bw, 0);
+    m->count_prev = count;
+    m->rpm_filt = ms ? Observer_GetVelocity() : 0;
+    return m->rpm_filt;
+  }
+
+  int32_t rpm = (int32_t)((int64_t)(count - m->count_prev) * 60000 /
+                          ((int64_t)RESOLUTION * (ms ? period : 1)));
+  m->count_prev = count;
+  m->rpm_filt = ms ? (unfiltered ? rpm : (1 * rpm + 9 * m->rpm_filt) / 10) : 0;
+  return m->rpm_filt;
+}
+
+/* Advance the motor by 1 ms against a load torque in fraction of full duty */
+static void Motor_Advance(Motor_t *m, const Plant_t *plant, int32_t control, double torque) {
+  // Linearization and PWM quantization, as in Peripheral_PWM_ActuateMotor()
+  control = Actuator_Linearize(control);
+  double u = (double)(((int64_t)control * PWM_ARR) >> 30) / PWM_ARR;
+
+  // Sigma-delta over the PWM periods of the millisecond, as the DMA pattern of Peripheral_PWM_ActuateMotor()
+  if (dither_bits && control) {
+    uint32_t mask = (1u << dither_bits) - 1u;
+    uint32_t fine = (uint32_t)(((uint64_t)llabs(control) * PWM_ARR) >> (30 - dither_bits));
+    uint32_t sum = 0;
+    for (int i = 0; i < PWM_PERIODS_MS; i++) {
+      dither_acc += fine & mask;
+      sum += (fine >> dither_bits) + (dither_acc >> dither_bits);
+      dither_acc &= mask;
+    }
+    u = copysign((double)sum / (PWM_PERIODS_MS * PWM_ARR), control);
+  }
+
+  // The half-bridge drops a fixed part of the duty cycle
+  u = copysign(fmax(fabs(u) - deadband, 0.0), u);
+
+  // Cogging over the rotor angle adds to the load
+  torque += cogging * sin(2.0 * M_PI * COG_CYCLES * (m->pos + cog_origin) / RESOLUTION);
+
+  // Coulomb friction opposes motion, or holds the motor while it is weaker
+  double drive = plant->gain * (u - torque);
+  double fric = plant->gain * plant->friction;
+  if (m->v > 0.5)
+    drive -= fric;
+  else if (m->v < -0.5)
+    drive += fric;
+  else
+    drive = fabs(drive) <= fric ? 0.0 : drive - copysign(fric, drive);
+
+  m->v += (drive - m->v) / plant->tau_ms;
+  m->pos += m->v * RESOLUTION / 60000.0;
+}
+
+static Result_t Run(const Plant_t *plant, const Sim_t *sim) {
+  Motor_t m = {0};
+  double osc = 0.0, v_min = 0.0, v_max = 0.0;
+  int32_t target = amplitude, control = 0;
+  uint32_t flips = 0, settled_at = 0, flip_ms = 0, in_band = 0, seed = 1, last_up = 0;
+  uint32_t reply_sent = 0, reply_at = 0; // Last control received by the client
+  uint32_t n_est = 0, n_noise = 0, steps = 0, load_at = 0, load_settled_at = 0, load_in_band = 0;
+  Result_t r = {0};
+
+  n_up = n_down = 0;
+  Controller_Reset();
+  Controller_SetFeedforward(sim->ff ? &nominal : NULL, sim->ff);
+  Controller_SetSchedule(sim->schedule);
+  Controller_SetDisturbanceObserver(sim->dob ? &nominal : NULL, sim->dob);
+  Predictor_Init(sim->smith ? &nominal : NULL, PREDICTOR_BASE_DELAY);
+  if (sim->adapt) {
+    Adapt_Config_t ac = {ADAPT_ORDER, ADAPT_DECIMATION, ADAPT_LAMBDA, VELOCITY_ALPHA, ADAPT_WARMUP, ADAPT_PUBLISH, nominal};
+    Adapt_Init(&ac);
+    n_adapted = 0;
+  }
+  Trajectory_Init(0);
+  Trajectory_Configure(sim->profile, TRAJ_ACCEL, TRAJ_JERK);
+  Trajectory_Start(target, 0);
+
+  for (uint32_t ms = 0; ms < SESSION_MS; ms++) {
+    // Load steps on and off in each plateau, from the second one on
+    uint32_t phase = ms % PERIOD_REF;
+    if (load_at && (phase == 0 || phase == LOAD_ON || phase == LOAD_OFF)) {
+      // Close the previous load transient
+      if (load_in_band)
+        r.load_recover += load_settled_at - load_at;
+      else
+        r.unrecovered++;
+      steps++;
+      load_at = 0;
+    }
+    if (load && ms >= PERIOD_REF && (phase == LOAD_ON || phase == LOAD_OFF)) {
+      load_at = ms;
+      load_in_band = 0;
+    }
+
+    if (ms > 0 && ms % PERIOD_REF == 0) {
+      // Close the previous transition
+      if (in_band)
+        r.settle_ms += settled_at - flip_ms;
+      else
+        r.unsettled++;
+      flips++;
+
+      target = -target;
+      flip_ms = ms;
+      in_band = 0;
+      Trajectory_Start(target, ms);
+    }
+
+    if (ms % sim->period == 0) {
+      int32_t rpm_filt = Motor_Sense(&m, sim->period, ms);
+      double e = rpm_filt - m.v;
+      r.est_err += e * e;
+      n_est++;
+      if ((ms + 1) % PERIOD_REF > PERIOD_REF - OSC_WINDOW) {
+        r.est_noise += e * e;
+        n_noise++;
+      }
+
+      if (sim->networked) {
+        seed = seed * 1664525u + 1013904223u;
+        uint32_t jitter = sim->jitter_ms ? (seed >> 16) % (sim->jitter_ms + 1) : 0;
+        uint32_t at = ms + sim->delay_ms / 2 + jitter;
+        if (at < last_up)
+          at = last_up;
+        last_up = at;
+        uint32_t echo = reply_sent ? reply_sent + (ms - reply_at) : 0;
+        Post(uplink, &n_up, (Event_t){at, rpm_filt, ms, echo});
+      } else {
+        int32_t ref = Trajectory_Evaluate(ms);
+        int32_t vel = rpm_filt;
+        if (sim->adapt && Adapt_TakeModel(&adapted) == 0) {
+          Controller_SetFeedforward(&adapted, sim->ff);
+          n_adapted++;
+        }
+        if (compensate)
+          Controller_SetFeedforwardInput(Cogging_Compensate((int64_t)floor(m.pos), ref, sim->period));
+        control = Controller_PIController(&ref, &vel, &ms);
+        if (sim->adapt) {
+          Adapt_Push(vel, control, ms, VELOCITY_ALPHA);
+          Adapt_Run(ADAPT_BUDGET);
+        }
+      }
+    }
+
+    // Server: one control step per received sample, as in app_comm
+    Event_t e;
+    while (Take(uplink, &n_up, ms, &e)) {
+      uint32_t now = ms + CLOCK_OFFSET;
+      int32_t ref = Trajectory_Evaluate(ms);
+      int32_t vel = Predictor_Update(e.value, e.echo, now);
+      int32_t u = Controller_PIController(&ref, &vel, &e.ts);
+      Predictor_Apply(u, now);
+      Post(downlink, &n_down, (Event_t){ms + (sim->delay_ms - sim->delay_ms / 2), u, now, 0});
+    }
+    while (Take(downlink, &n_down, ms, &e)) {
+      control = e.value;
+      reply_sent = e.ts;
+      reply_at = ms;
+    }
+
+    Motor_Advance(&m, plant, control, phase >= LOAD_ON && phase < LOAD_OFF ? load : 0.0);
+
+    // Metrics on the true velocity
+    double v = m.v;
+    double ref_now = Trajectory_Evaluate(ms);
+    double err = fabs(target - v);
+    r.iae += err * 1e-3;
+    r.track += fabs(ref_now - v) * 1e-3;
+    if (load_at) {
+      if (err > r.load_dip)
+        r.load_dip = err;
+      if (err <= SETTLE_BAND * abs(target)) {
+        if (!load_in_band)
+          load_settled_at = ms;
+        load_in_band = 1;
+      } else {
+        load_in_band = 0;
+      }
+    }
+    if (err <= SETTLE_BAND * abs(target)) {
+      if (!in_band)
+        settled_at = ms;
+      in_band = 1;
+    } else {
+      in_band = 0;
+    }
+    if ((ms + 1) % PERIOD_REF == PERIOD_REF - OSC_WINDOW) {
+      v_min = v_max = v;
+    } else if ((ms + 1) % PERIOD_REF > PERIOD_REF - OSC_WINDOW) {
+      v_min = fmin(v_min, v);
+      v_max = fmax(v_max, v);
+      if (v_max - v_min > osc)
+        osc = v_max - v_min;
+    }
+  }
+
+  r.settle_ms = flips > r.unsettled ? r.settle_ms / (flips - r.unsettled) : -1.0;
+  r.iae /= flips + 1;
+  r.track /= flips + 1;
+  r.osc = 100.0 * osc / amplitude;
+  r.est_err = sqrt(r.est_err / (n_est ? n_est : 1));
+  r.est_noise = sqrt(r.est_noise / (n_noise ? n_noise : 1));
+  r.load_recover = steps > r.unrecovered ? r.load_recover / (steps - r.unrecovered) : -1.0;
+  return r;
+}
+
+// A mean time in a 10-wide column, n/a if nothing settled to average
+static void PrintMs(double ms) {
+  if (ms < 0.0)
+    printf(" %10s", "n/a");
+  else
+    printf(" %10.1f", ms);
+}
+
+static void PrintResult(const char *name, const Result_t *r) {
+  printf("%-28s", name);
+  PrintMs(r->settle_ms);
+  printf(" %12.2f %12.2f %8.1f", r->iae, r->track, r->osc);
+  if (r->unsettled)
+    printf("  (%u flips never settled)", r->unsettled);
+  printf("\n");
+}
+
+static void CompareFeedforward(const Plant_t *plant, Trajectory_Profile_t profile) {
+  static const struct {
+    const char *name;
+    uint8_t terms;
+  } configs[] = {
+    {"PI only", 0},
+    {"PI + velocity ff", CONTROLLER_FF_VELOCITY},
+    {"PI + velocity/friction ff", CONTROLLER_FF_VELOCITY | CONTROLLER_FF_FRICTION},
+    {"PI + full ff", CONTROLLER_FF_VELOCITY | CONTROLLER_FF_FRICTION | CONTROLLER_FF_ACCEL},
+  };
+
+  printf("%-28s %10s %12s %12s %8s\n", "configuration", "settle ms", "IAE RPM*s", "track RPM*s", "osc %");
+  for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+    Sim_t sim = {profile, PERIOD_CTRL, configs[i].terms, 0, 0, 0, 0, NULL, 0, 0};
+    Result_t r = Run(plant, &sim);
+    PrintResult(configs[i].name, &r);
+  }
+}
+
+static void SweepDelay(const Plant_t *plant, Trajectory_Profile_t profile, uint32_t jitter) {
+  uint32_t margin[2] = {0, 0};
+  uint8_t lost[2] = {0, 0};
+  char name[32];
+
+  printf("%-28s %10s %12s %12s %8s\n", "round trip", "settle ms", "IAE RPM*s", "track RPM*s", "osc %");
+  for (uint32_t delay = 0; delay <= 1000; delay += 50) {
+    for (uint8_t smith = 0; smith < 2; smith++) {
+      Sim_t sim = {profile, PERIOD_SAMPLE, FEEDFORWARD, 1, smith, delay, jitter, NULL, 0, 0};
+      Result_t r = Run(plant, &sim);
+
+      snprintf(name, sizeof(name), "%3u ms %s", delay, smith ? "Smith" : "PI");
+      PrintResult(name, &r);
+
+      // Delay margin: largest delay before the first unstable run
+      if (r.osc > 100.0 * OSC_LIMIT)
+        lost[smith] = 1;
+      else if (!lost[smith])
+        margin[smith] = delay;
+    }
+  }
+
+  printf("\ndelay margin (osc <= %.0f%%): PI %u ms, Smith predictor %u ms\n",
+         100.0 * OSC_LIMIT, margin[0], margin[1]);
+}
+
+static void RunAutotune(const Plant_t *plant, Trajectory_Profile_t profile, uint32_t period) {
+  Autotune_Config_t cfg = {
+    .setpoint = 1000,
+    .amplitude = MOTOR_CONTROL_SCALE / 4,
+    .hysteresis = 20,
+    .bias = 0,
+    .limit = 3000,
+    .timeout_ms = 30000,
+  };
+  Autotune_Result_t res;
+  Motor_t m = {0};
+  int32_t control = 0;
+  uint32_t ms;
+
+  // Bring the motor to the setpoint with the default gains, as the
+  // application does, and start the relay around the settled control
+  Controller_Reset();
+  Controller_SetFeedforward(NULL, 0);
+  for (ms = 0; ms < AUTOTUNE_LEAD_MS; ms++) {
+    if (ms % period == 0) {
+      int32_t vel = Motor_Sense(&m, period, ms);
+      control = Controller_PIController(&cfg.setpoint, &vel, &ms);
+    }
+    Motor_Advance(&m, plant, control, 0.0);
+  }
+
+  cfg.bias = control;
+  Autotune_Start(&cfg, ms);
+  for (; Autotune_GetState() == AUTOTUNE_RUNNING; ms++) {
+    if (ms % period == 0)
+      control = Autotune_Step(Motor_Sense(&m, period, ms), ms);
+    Motor_Advance(&m, plant, control, 0.0);
+  }
+  ms -= AUTOTUNE_LEAD_MS;
+
+  if (Autotune_GetResult(&res) != 0) {
+    printf("relay experiment failed after %u ms\n", ms);
+    return;
+  }
+
+  printf("relay experiment at %u ms sampling: %u ms\n", period, ms);
+  printf("  Tu=%lu ms a=%ld RPM Ku=%ld bias=%.1f%% -> kp=%ld ki=%ld\n\n",
+         (unsigned long)res.period_ms, (long)res.amplitude, (long)res.ku,
+         100.0 * res.bias / MOTOR_CONTROL_SCALE, (long)res.gains.kp, (long)res.gains.ki);
+
+  printf("%-28s %10s %12s %12s %8s\n", "gains", "settle ms", "IAE RPM*s", "track RPM*s", "osc %");
+  for (int tuned = 0; tuned < 2; tuned++) {
+    Sim_t sim = {profile, period, FEEDFORWARD, 0, 0, 0, 0, NULL, 0, 0};
+    Controller_SetGains(tuned ? &res.gains : NULL);
+    Result_t r = Run(plant, &sim);
+    PrintResult(tuned ? "autotuned" : "default", &r);
+  }
+  Controller_SetGains(NULL);
+  Controller_Reset();
+}
+
+static void CompareSchedule(const Plant_t *plant, Trajectory_Profile_t profile, uint32_t period) {
+  printf("%-28s %10s %12s %12s %8s\n", "gains", "settle ms", "IAE RPM*s", "track RPM*s", "osc %");
+  for (int scheduled = 0; scheduled < 2; scheduled++) {
+    Sim_t sim = {profile, period, FEEDFORWARD, 0, 0, 0, 0, scheduled ? &gain_schedule : NULL, 0, 0};
+    Result_t r = Run(plant, &sim);
+    PrintResult(scheduled ? "scheduled" : "fixed", &r);
+  }
+  Controller_SetSchedule(NULL);
+}
+
+static void CompareObserver(const Plant_t *plant, Trajectory_Profile_t profile, uint32_t period,
+                            uint32_t bandwidth) {
+  Controller_Params_t defaults;
+  char name[32];
+
+  Controller_GetParams(&defaults);
+  printf("%-28s %10s %12s %12s %8s %9s %9s\n", "gains", "settle ms", "IAE RPM*s", "track RPM*s", "osc %",
+         "est RPM", "noise RPM");
+  for (int32_t scale = 1; scale <= 32; scale *= 2) {
+    Controller_Gains_t gains = {defaults.gains.kp * scale, defaults.gains.ki * scale};
+
+    for (int observer = 0; observer < 2; observer++) {
+      Sim_t sim = {profile, period, FEEDFORWARD, 0, 0, 0, 0, NULL, 0, 0};
+      Controller_SetGains(&gains);
+      observer_bw = observer ? bandwidth : 0;
+      Result_t r = Run(plant, &sim);
+
+      snprintf(name, sizeof(name), "x%d %s", scale, observer ? "observer" : "filter");
+      printf("%-28s", name);
+      PrintMs(r.settle_ms);
+      printf(" %12.2f %12.2f %8.1f %9.1f %9.1f", r.iae, r.track, r.osc, r.est_err, r.est_noise);
+      if (r.unsettled)
+        printf("  (%u flips never settled)", r.unsettled);
+      printf("\n");
+    }
+  }
+  observer_bw = 0;
+  Controller_SetGains(NULL);
+  Controller_Reset();
+}
+
+static void CompareLoad(const Plant_t *plant, Trajectory_Profile_t profile, uint32_t period,
+                        uint32_t bandwidth) {
+  static const uint32_t bandwidths[] = {0, 5, 10, 20, 40, 80};
+  char name[32];
+
+  observer_bw = bandwidth;
+  printf("%-28s %12s %8s %9s %10s\n", "controller", "IAE RPM*s", "osc %", "dip RPM", "recover ms");
+  for (size_t i = 0; i < sizeof(bandwidths) / sizeof(bandwidths[0]); i++) {
+    Sim_t sim = {profile, period, CONTROLLER_FF_VELOCITY | CONTROLLER_FF_FRICTION | CONTROLLER_FF_ACCEL, 0, 0, 0, 0, NULL,
+                 bandwidths[i], 0};
+    Result_t r = Run(plant, &sim);
+
+    if (bandwidths[i])
+      snprintf(name, sizeof(name), "compensation %u rad/s", bandwidths[i]);
+    else
+      snprintf(name, sizeof(name), "PI only");
+    printf("%-28s %12.2f %8.1f %9.1f", name, r.iae, r.osc, r.load_dip);
+    PrintMs(r.load_recover);
+    if (r.unrecovered)
+      printf("  (%u load steps never recovered)", r.unrecovered);
+    printf("\n");
+  }
+  Controller_SetDisturbanceObserver(NULL, 0);
+  observer_bw = 0;
+}
+
+/* Full feedforward on the nominal model, then on the model adapted online */
+static void CompareAdapt(const Plant_t *plant, Trajectory_Profile_t profile, uint32_t period) {
+  printf("%-28s %10s %12s %12s %8s\n", "model", "settle ms", "IAE RPM*s", "track RPM*s", "osc %");
+  for (int adapt = 0; adapt < 2; adapt++) {
+    Sim_t sim = {profile, period, CONTROLLER_FF_VELOCITY | CONTROLLER_FF_FRICTION | CONTROLLER_FF_ACCEL, 0, 0, 0, 0,
+                 NULL, 0, (uint8_t)adapt};
+    Result_t r = Run(plant, &sim);
+    PrintResult(adapt ? "adapted" : "nominal", &r);
+  }
+  printf("\n%u models applied, last: gain=%ld RPM tau=%lu ms friction=%.1f%%\n", n_adapted, (long)adapted.gain,
+         (unsigned long)adapted.tau_ms, 100.0 * adapted.friction / MOTOR_CONTROL_SCALE);
+  Controller_SetFeedforward(NULL, 0);
+}
+
+/* Calibration or alignment sweep at COGGING_PERIOD, as in application.c */
+static int32_t Calibrate(const Plant_t *plant, Cogging_Mode_t mode, Cogging_Result_t *res) {
+  const uint32_t period = COGGING_PERIOD;
+  Cogging_Config_t c = {mode, COGGING_SPEED, mode == COGGING_ALIGN ? 1 : COGGING_REVOLUTIONS, COGGING_SETTLE,
+                        COGGING_BANDWIDTH, COGGING_TIMEOUT, nominal};
+  Motor_t m = {0};
+  int32_t control = 0;
+
+  if (Cogging_Start(&c, 0, 0) != 0)
+    return -1;
+
+  for (uint32_t ms = 0; Cogging_GetState() == COGGING_RUNNING; ms++) {
+    if (ms % period == 0) {
+      Motor_Sense(&m, period, ms);
+      control = Cogging_Step((int64_t)floor(m.pos), ms);
+    }
+    Motor_Advance(&m, plant, control, 0.0);
+  }
+  return Cogging_GetResult(res);
+}
+
+/* Calibrate the table, reboot at another angle and align it, then compare
+   the compensation with the friction feedforward */
+static void CompareCogging(const Plant_t *plant, Trajectory_Profile_t profile, uint32_t period) {
+  static const struct {
+    const char *name;
+    uint8_t terms;
+    uint8_t table;
+  } configs[] = {
+    {"PI only", 0, 0},
+    {"PI + friction ff", CONTROLLER_FF_FRICTION, 0},
+    {"PI + table", 0, 1},
+    {"PI + velocity/accel ff", CONTROLLER_FF_VELOCITY | CONTROLLER_FF_ACCEL, 0},
+    {"PI + full ff", CONTROLLER_FF_VELOCITY | CONTROLLER_FF_FRICTION | CONTROLLER_FF_ACCEL, 0},
+    {"PI + velocity/accel ff + table", CONTROLLER_FF_VELOCITY | CONTROLLER_FF_ACCEL, 1},
+  };
+  Cogging_Table_t table;
+  Cogging_Result_t res;
+
+  cog_origin = 0.0;
+  if (Calibrate(plant, COGGING_CALIBRATE, &res) != 0 || Cogging_Save(&table) != 0) {
+    printf("calibration failed\n");
+    return;
+  }
+  printf("calibrated: %u samples, friction %.2f%% / %.2f%%, ripple %.2f%%\n", res.samples,
+         100.0 * res.friction[0] / MOTOR_CONTROL_SCALE, 100.0 * res.friction[1] / MOTOR_CONTROL_SCALE,
+         100.0 * res.ripple / MOTOR_CONTROL_SCALE);
+
+  // The encoder restarts from 0 at another rotor angle
+  cog_origin = COG_REBOOT;
+  if (Cogging_Load(&table) != 0 || Calibrate(plant, COGGING_ALIGN, &res) != 0) {
+    printf("alignment failed\n");
+    return;
+  }
+  printf("aligned after reboot at %.0f counts: shift %u counts\n\n", COG_REBOOT, res.shift);
+  Cogging_Enable(COGGING_BLEND);
+
+  printf("%-32s %10s %12s %12s %8s\n", "configuration", "settle ms", "IAE RPM*s", "track RPM*s", "osc %");
+  for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+    Sim_t sim = {profile, period, configs[i].terms, 0, 0, 0, 0, NULL, 0, 0};
+    compensate = configs[i].table;
+    Result_t r = Run(plant, &sim);
+    PrintResult(configs[i].name, &r);
+  }
+  compensate = 0;
+  Controller_SetFeedforward(NULL, 0);
+}
+
+/* Inverse of a plain deadband, as PWM_LINEARIZATION of peripherals.h */
+static void DeadbandTable(double width, int32_t *table) {
+  for (int32_t k = 0; k < ACTUATOR_POINTS; k++) {
+    double d = width + (double)k / (ACTUATOR_POINTS - 1);
+    table[k] = (int32_t)lround(fmin(fmax(d, 0.0), 1.0) * ACTUATOR_FULL);
+  }
+}
+
+/* The PI alone and with full feedforward on a half-bridge with a deadband,
+   without and with its linearization */
+static void CompareDeadband(const Plant_t *plant, Trajectory_Profile_t profile, uint32_t period) {
+  static const struct {
+    const char *name;
+    uint8_t terms;
+  } controllers[] = {
+    {"PI only", 0},
+    {"PI + full ff", CONTROLLER_FF_VELOCITY | CONTROLLER_FF_FRICTION | CONTROLLER_FF_ACCEL},
+  };
+  static const struct {
+    const char *name;
+    int8_t deadband;
+    int8_t table;    // Deadband of the table relative to the plant in % duty, -100 for none
+  } configs[] = {
+    {"no deadband", 0, -100},
+    {"deadband", 1, -100},
+    {"deadband + table", 1, 0},
+    {"deadband + table -1%", 1, -1},
+    {"deadband + table +1%", 1, 1},
+  };
+  const double width = deadband;
+  int32_t table[ACTUATOR_POINTS];
+
+  for (size_t c = 0; c < sizeof(controllers) / sizeof(controllers[0]); c++) {
+    printf("%s%-28s %10s %12s %12s %8s\n", c ? "\n" : "", controllers[c].name, "settle ms", "IAE RPM*s",
+           "track RPM*s", "osc %");
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+      Sim_t sim = {profile, period, controllers[c].terms, 0, 0, 0, 0, NULL, 0, 0};
+      deadband = configs[i].deadband ? width : 0.0;
+      DeadbandTable(width + configs[i].table / 100.0, table);
+      Actuator_SetLinearization(configs[i].table > -100 ? table : NULL);
+      Result_t r = Run(plant, &sim);
+      PrintResult(configs[i].name, &r);
+    }
+  }
+  deadband = width;
+  Actuator_SetLinearization(NULL);
+  Controller_SetFeedforward(NULL, 0);
+}
+
+/* Full feedforward with the 11-bit PWM and increasing dithered bits */
+static void CompareDither(const Plant_t *plant, Trajectory_Profile_t profile, uint32_t period, uint32_t bandwidth,
+                          uint32_t bits) {
+  char name[32];
+
+  observer_bw = bandwidth;
+
+  printf("%-28s %10s %12s %12s %8s\n", "PWM", "settle ms", "IAE RPM*s", "track RPM*s", "osc %");
+  for (uint32_t b = 0; b <= bits; b += 2) {
+    Sim_t sim = {profile, period, CONTROLLER_FF_VELOCITY | CONTROLLER_FF_FRICTION | CONTROLLER_FF_ACCEL, 0, 0, 0, 0,
+                 NULL, 0, 0};
+    dither_bits = b;
+    dither_acc = 0;
+    snprintf(name, sizeof(name), b ? "%u bits, %u dithered" : "%u bits", 11 + b, b);
+    Result_t r = Run(plant, &sim);
+    PrintResult(name, &r);
+  }
+  dither_bits = 0;
+  observer_bw = 0;
+  Controller_SetFeedforward(NULL, 0);
+}
+
+/* Position moves between 0 and POSITION_MOVE, the position loop running
+   every divider velocity samples as in application.c */
+static void ComparePosition(const Plant_t *plant, uint32_t period, int32_t kp) {
+  static const uint32_t dividers[] = {1, 2, 4, 8};
+  char name[32];
+
+  printf("%-28s %10s %10s %10s\n", "position loop", "move ms", "over", "error");
+  for (size_t i = 0; i < sizeof(dividers) / sizeof(dividers[0]); i++) {
+    Position_Params_t p = {kp, POSITION_KI, POSITION_MAX_SPEED, dividers[i]};
+    Motor_t m = {0};
+    int32_t control = 0;
+    int64_t goal = 0;
+    uint32_t moves = 0, unsettled = 0, settled_at = 0, move_ms = 0, in_band = 1;
+    double settle = 0.0, over = 0.0, error = 0.0;
+
+    Controller_Reset();
+    Controller_SetFeedforward(&nominal, CONTROLLER_FF_VELOCITY | CONTROLLER_FF_FRICTION | CONTROLLER_FF_ACCEL);
+    Position_Init(0, &p);
+
+    for (uint32_t ms = 0; ms < SESSION_MS; ms++) {
+      if (ms > 0 && ms % PERIOD_REF == 0) {
+        // Close the previous move
+        double pos = floor(m.pos);
+        if (moves) {
+          if (in_band)
+            settle += settled_at - move_ms;
+          else
+            unsettled++;
+          error += fabs(pos - (double)goal);
+        }
+        moves++;
+
+        goal = goal ? 0 : POSITION_MOVE;
+        move_ms = ms;
+        in_band = 0;
+        Position_Move(goal);
+      }
+
+      if (ms % period == 0) {
+        int32_t vel = Motor_Sense(&m, period, ms);
+        int32_t ref = Position_Update((int64_t)floor(m.pos), ms);
+        control = Controller_PIController(&ref, &vel, &ms);
+      }
+      Motor_Advance(&m, plant, control, 0.0);
+
+      // Metrics on the true position, overshoot past the target in the
+      // direction of the move
+      double e = m.pos - (double)goal;
+      if (moves && (goal ? e : -e) > over)
+        over = goal ? e : -e;
+      if (fabs(e) <= POSITION_BAND) {
+        if (!in_band)
+          settled_at = ms;
+        in_band = 1;
+      } else {
+        in_band = 0;
+      }
+    }
+
+    snprintf(name, sizeof(name), "every %u samples (%u ms)", dividers[i], dividers[i] * period);
+    printf("%-28s", name);
+    PrintMs(moves > unsettled + 1 ? settle / (moves - 1 - unsettled) : -1.0);
+    printf(" %10.1f %10.1f", over, moves > 1 ? error / (moves - 1) : 0.0);
+    if (unsettled)
+      printf("  (%u moves never settled)", unsettled);
+    printf("\n");
+  }
+  Controller_SetFeedforward(NULL, 0);
+}
+
+/* Identification experiments as in application.c, on the unfiltered velocity */
+static void RunSysid(const Plant_t *plant, uint32_t period) {
+  static const struct {
+    const char *name;
+    Sysid_Signal_t signal;
+    uint8_t order;
+  } runs[] = {
+    {"PRBS, first order", SYSID_PRBS, 1},
+    {"PRBS, second order", SYSID_PRBS, 2},
+    {"chirp, first order", SYSID_CHIRP, 1},
+    {"chirp, second order", SYSID_CHIRP, 2},
+  };
+
+  printf("%-28s %9s %9s %10s %9s %9s %9s\n", "experiment", "gain RPM", "tau ms", "friction %", "a1", "b1",
+         "resid RPM");
+  printf("%-28s %9.0f %9.0f %10.1f\n", "simulated motor", plant->gain, plant->tau_ms, plant->friction * 100.0);
+  unfiltered = 1;
+  for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+    Sysid_Config_t cfg = {runs[i].signal, runs[i].order, SYSID_BIAS, SYSID_AMPLITUDE, SYSID_BIT,
+                          SYSID_F_START, SYSID_F_STOP, SYSID_SETTLE, SYSID_DURATION,
+                          SYSID_VELOCITY_SCALE - 1};
+    Sysid_Result_t res;
+    Motor_t m = {0};
+    int32_t control = 0;
+    uint32_t ms;
+
+    Sysid_Start(&cfg, 0);
+    for (ms = 0; Sysid_GetState() == SYSID_RUNNING; ms++) {
+      if (ms % period == 0)
+        control = Sysid_Step(Motor_Sense(&m, period, ms), ms);
+      Motor_Advance(&m, plant, control, 0.0);
+    }
+
+    if (Sysid_GetResult(&res) != 0) {
+      printf("%-28s failed after %u ms\n", runs[i].name, ms);
+      continue;
+    }
+    printf("%-28s %9ld %9lu %10.1f %9.4f %9.4f %9ld\n", runs[i].name, (long)res.model.gain,
+           (unsigned long)res.model.tau_ms, 100.0 * res.model.friction / MOTOR_CONTROL_SCALE,
+           res.a[0] / 16777216.0, res.b[0] / 16777216.0, (long)res.residual);
+  }
+  unfiltered = 0;
+}
+
+/* Exact loop gain of the sampled loop at f Hz: per-ms motor held for a
+   period, velocity averaged over the period, low-pass filter and PI */
+static double complex LoopGain(const Plant_t *plant, uint32_t period, double f) {
+  Controller_Params_t p;
+  Controller_GetParams(&p);
+
+  const double T = period;
+  const double a = 1.0 - 1.0 / plant->tau_ms;
+  const double b = plant->gain / plant->tau_ms / MOTOR_CONTROL_SCALE;
+  const double A = pow(a, T);
+  const double S = a * (1.0 - A) / (1.0 - a);  // sum of a^m, m = 1..T
+  const double complex z = cexp(I * 2.0 * M_PI * f * T * 1e-3);
+
+  double complex motor = (S * b * (1.0 - A) / (1.0 - a) / (z - A) + b * (T - S) / (1.0 - a)) / (T * z);
+  double complex filter = 0.1 / (1.0 - 0.9 / z);
+  double complex pi = p.gains.kp + p.gains.ki * T * 1e-3 / (1.0 - 1.0 / z);
+  return pi * motor * filter;
+}
+
+/* Frequency-response analyzer as in application.c, around FRA_SETPOINT */
+static void RunFra(const Plant_t *plant, uint32_t period) {
+  static const uint32_t freqs[] = FRA_FREQUENCIES;
+  Fra_Config_t cfg = {FRA_SETPOINT, FRA_AMPLITUDE, freqs, sizeof(freqs) / sizeof(freqs[0]), FRA_SETTLE,
+                      FRA_SETTLE_CYCLES, FRA_CYCLES, 3 * FRA_SETPOINT};
+  Fra_Result_t res;
+  Motor_t m = {0};
+  int32_t control = 0;
+  uint32_t ms;
+
+  Controller_Reset();
+  Controller_SetFeedforward(NULL, 0);
+  Fra_Start(&cfg, 0);
+  for (ms = 0; Fra_GetState() == FRA_RUNNING; ms++) {
+    if (ms % period == 0) {
+      int32_t vel = Motor_Sense(&m, period, ms);
+      int32_t ref = Fra_Step(vel, ms);
+      control = Controller_PIController(&ref, &vel, &ms);
+    }
+    Motor_Advance(&m, plant, control, 0.0);
+  }
+
+  if (Fra_GetResult(&res) != 0) {
+    printf("sweep failed after %u ms\n", ms);
+    return;
+  }
+
+  printf("%10s %10s %10s %10s %10s %10s\n", "freq Hz", "gain dB", "phase deg", "exact dB", "exact deg",
+         "ampl RPM");
+  for (uint32_t i = 0; i < res.points; i++) {
+    Fra_Point_t pt;
+    Fra_GetPoint(i, &pt);
+    double complex l = LoopGain(plant, period, pt.freq_mhz * 1e-3);
+    double phase = carg(l) * 180.0 / M_PI;
+    while (phase - pt.phase * 0.1 > 180.0)
+      phase -= 360.0;
+    while (phase - pt.phase * 0.1 < -180.0)
+      phase += 360.0;
+    printf("%10.2f %10.2f %10.1f %10.2f %10.1f %10ld\n", pt.freq_mhz * 1e-3, 20.0 * log10(pt.gain * 1e-3),
+           pt.phase * 0.1, 20.0 * log10(cabs(l)), phase, (long)pt.amplitude);
+  }
+
+  printf("\nsweep of %u ms at %u ms sampling\n", ms, period);
+  if (res.crossover_mhz)
+    printf("crossover %.2f Hz, phase margin %.1f deg\n", res.crossover_mhz * 1e-3, res.phase_margin * 0.1);
+  else
+    printf("no gain crossover in the sweep\n");
+  if (res.phase_crossover_mhz)
+    printf("phase crossover %.2f Hz, gain margin %.1f dB\n", res.phase_crossover_mhz * 1e-3,
+           20.0 * log10(res.gain_margin * 1e-3));
+  else
+    printf("no phase crossover in the sweep\n");
+}
+
+int main(int argc, char **argv) {
+  Trajectory_Profile_t profile = TRAJ_PROFILE;
+  Plant_t plant = {MOTOR_GAIN, MOTOR_TAU, (double)MOTOR_FRICTION / MOTOR_CONTROL_SCALE};
+  int delay_mode = argc > 1 && !strcmp(argv[1], "delay");
+  int autotune_mode = argc > 1 && !strcmp(argv[1], "autotune");
+  int schedule_mode = argc > 1 && !strcmp(argv[1], "schedule");
+  int observer_mode = argc > 1 && !strcmp(argv[1], "observer");
+  int load_mode = argc > 1 && !strcmp(argv[1], "load");
+  int position_mode = argc > 1 && !strcmp(argv[1], "position");
+  int sysid_mode = argc > 1 && !strcmp(argv[1], "sysid");
+  int fra_mode = argc > 1 && !strcmp(argv[1], "fra");
+  int adapt_mode = argc > 1 && !strcmp(argv[1], "adapt");
+  int cogging_mode = argc > 1 && !strcmp(argv[1], "cogging");
+  int deadband_mode = argc > 1 && !strcmp(argv[1], "deadband");
+  int dither_mode = argc > 1 && !strcmp(argv[1], "dither");
+  int32_t kp = POSITION_KP;
+  uint32_t bandwidth = 300; // VELOCITY_OBSERVER_BW of peripherals.h
+  uint32_t jitter = 0, period = PERIOD_CTRL, bits = 6;
+  int arg = 2;
+
+  if (argc > arg) {
+    if (!strcmp(argv[arg], "step"))
+      profile = TRAJECTORY_STEP;
+    else if (!strcmp(argv[arg], "trapezoid"))
+      profile = TRAJECTORY_TRAPEZOID;
+    else if (!strcmp(argv[arg], "scurve"))
+      profile = TRAJECTORY_SCURVE;
+  }
+  arg++;
+  if (delay_mode && argc > arg)
+    jitter = (uint32_t)atoi(argv[arg++]);
+  if ((autotune_mode || schedule_mode || observer_mode || load_mode || position_mode || sysid_mode ||
+       fra_mode || adapt_mode || cogging_mode || deadband_mode || dither_mode) &&
+      argc > arg)
+    period = (uint32_t)atoi(argv[arg++]);
+  if ((observer_mode || load_mode || dither_mode) && argc > arg)
+    bandwidth = (uint32_t)atoi(argv[arg++]);
+  if (position_mode && argc > arg)
+    kp = atoi(argv[arg++]);
+  if (load_mode)
+    load = argc > arg ? atof(argv[arg++]) / 100.0 : 0.2;
+  if (cogging_mode)
+    cogging = argc > arg ? atof(argv[arg++]) / 100.0 : 0.03;
+  if (deadband_mode) {
+    deadband = argc > arg ? atof(argv[arg++]) / 100.0 : 0.04;
+    amplitude = argc > arg ? atoi(argv[arg++]) : 200;
+  }
+  if (dither_mode) {
+    bits = argc > arg ? (uint32_t)atoi(argv[arg++]) : 6;
+    amplitude = argc > arg ? atoi(argv[arg++]) : 20;
+  }
+  if (argc > arg)
+    plant.gain = atof(argv[arg++]);
+  if (argc > arg)
+    plant.tau_ms = atof(argv[arg++]);
+  if (argc > arg)
+    plant.friction = atof(argv[arg++]) / 100.0;
+
+  printf("plant: gain=%.0f RPM tau=%.0f ms friction=%.1f%%, model: gain=%ld RPM tau=%lu ms\n",
+         plant.gain, plant.tau_ms, plant.friction * 100.0, (long)nominal.gain,
+         (unsigned long)nominal.tau_ms);
+
+  if (autotune_mode) {
+    RunAutotune(&plant, profile, period ? period : PERIOD_CTRL);
+  } else if (schedule_mode) {
+    CompareSchedule(&plant, profile, period ? period : PERIOD_CTRL);
+  } else if (sysid_mode) {
+    printf("identification at %u ms sampling, bias %.0f%%, amplitude %.0f%%\n", period ? period : PERIOD_CTRL,
+           100.0 * SYSID_BIAS / MOTOR_CONTROL_SCALE, 100.0 * SYSID_AMPLITUDE / MOTOR_CONTROL_SCALE);
+    RunSysid(&plant, period ? period : PERIOD_CTRL);
+  } else if (cogging_mode) {
+    printf("cogging of %.1f%% duty, %d periods per revolution, calibration at %d RPM every %d ms, "
+           "control every %u ms\n", cogging * 100.0, COG_CYCLES, COGGING_SPEED, COGGING_PERIOD,
+           period ? period : PERIOD_CTRL);
+    CompareCogging(&plant, profile, period ? period : PERIOD_CTRL);
+  } else if (deadband_mode) {
+    printf("half-bridge deadband of %.1f%% duty, target +/-%d RPM, control every %u ms\n", deadband * 100.0,
+           amplitude, period ? period : PERIOD_CTRL);
+    CompareDeadband(&plant, profile, period ? period : PERIOD_CTRL);
+  } else if (dither_mode) {
+    printf("PWM at %d kHz, target +/-%d RPM, full feedforward, velocity observer %u rad/s, control every %u ms\n",
+           PWM_PERIODS_MS, amplitude, bandwidth, period ? period : PERIOD_CTRL);
+    CompareDither(&plant, profile, period ? period : PERIOD_CTRL, bandwidth, bits);
+  } else if (adapt_mode) {
+    printf("full feedforward, motor model adapted online at %u ms sampling\n", period ? period : PERIOD_CTRL);
+    CompareAdapt(&plant, profile, period ? period : PERIOD_CTRL);
+  } else if (fra_mode) {
+    printf("swept sine of %d RPM around %d RPM on the reference, default PI and velocity filter\n", FRA_AMPLITUDE,
+           FRA_SETPOINT);
+    RunFra(&plant, period ? period : PERIOD_CTRL);
+  } else if (position_mode) {
+    printf("position moves of %d counts, kp=%d RPM/rev, velocity reference up to %d RPM\n", POSITION_MOVE, kp,
+           POSITION_MAX_SPEED);
+    ComparePosition(&plant, period ? period : PERIOD_CTRL, kp);
+  } else if (load_mode) {
+    printf("load steps of %.0f%% duty at %u and %u ms into each plateau, full feedforward, ", load * 100.0,
+           LOAD_ON, LOAD_OFF);
+    if (bandwidth)
+      printf("velocity observer %u rad/s\n", bandwidth);
+    else
+      printf("velocity filter\n");
+    CompareLoad(&plant, profile, period ? period : PERIOD_CTRL, bandwidth);
+  } else if (observer_mode) {
+    CompareObserver(&plant, profile, period ? period : PERIOD_CTRL, bandwidth);
+  } else if (delay_mode) {
+    printf("networked loop, sampling %u ms, uplink jitter up to %u ms\n", PERIOD_SAMPLE, jitter);
+    SweepDelay(&plant, profile, jitter);
+  } else {
+    CompareFeedforward(&plant, profile);
+  }
+
+  return 0;
+}
@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+"""
+Compute the half-bridge linearization PWM_LINEARIZATION (Include/peripherals.h).
+
+Reads the "[pwm] duty=<control> rpm=<rpm>" lines the bare-metal application
+prints with PWM_STAIRCASE 1 (application.h), from a saved console log. Both
+directions are averaged at each duty cycle. A line fitted through the upper
+half of the staircase gives the motor gain; the torque of each step is its
+velocity over the gain plus the Coulomb friction of the motor model, which
+the controller supplies itself. The table is the inverse: the duty cycle
+producing each 1/16 of the full torque, interpolated between the steps and
+extended with a unit slope below the lowest moving step (down to the edge
+of the deadband) and above the highest one.
+
+Prints the C initializer with the deadband, the gain and the largest
+deviation of the steps from the fitted line.
+
+Usage: python3 Tools/pwm_linearize.py <console.log> [--friction <pct>]
+       --friction  Coulomb friction of the motor in % duty cycle (MOTOR_FRICTION, default 5)
+"""
+
+import re
+import sys
+
+FULL = 1 << 30
+POINTS = 17
+STEP_LINE = re.compile(r"\[pwm\] duty=(-?\d+) rpm=(-?\d+)")
+
+
+def read_steps(path):
+    sums = {}
+    with open(path) as f:
+        for line in f:
+            m = STEP_LINE.search(line)
+            if not m:
+                continue
+            duty, rpm = int(m.group(1)), int(m.group(2))
+            # A step the motor didn't follow in its direction didn't move it
+            rpm = max(rpm if duty > 0 else -rpm, 0)
+            s = sums.setdefault(abs(duty), [0, 0])
+            s[0] += rpm
+            s[1] += 1
+    return sorted((d / FULL, s[0] / s[1]) for d, s in sums.items() if d > 0)
+
+
+def fit_line(steps):
+    """Least-squares rpm = gain * (duty - offset) over the upper half."""
+    top = max(r for _, r in steps)
+    upper = [(d, r) for d, r in steps if r >= top / 2]
+    n = len(upper)
+    md = sum(d for d, _ in upper) / n
+    mr = sum(r for _, r in upper) / n
+    sdd = sum((d - md) ** 2 for d, _ in upper)
+    if n < 2 or sdd == 0:
+        raise ValueError("not enough moving steps to fit the gain")
+    gain = sum((d - md) * (r - mr) for d, r in upper) / sdd
+    return gain, md - mr / gain
+
+
+def main(argv):
+    if len(argv) < 2:
+        print(__doc__.strip())
+        return 2
+
+    friction = 5.0
+    if "--friction" in argv:
+        friction = float(argv[argv.index("--friction") + 1])
+    f = friction / 100.0
+
+    steps = read_steps(argv[1])
+    moving = [(d, r) for d, r in steps if r > 0]
+    if len(moving) < 3:
+        print("fewer than 3 moving steps in %s, is PWM_STAIRCASE enabled?" % argv[1])
+        return 2
+    try:
+        gain, offset = fit_line(moving)
+    except ValueError as e:
+        print(e)
+        return 2
+
+    # Torque of each moving step, kept increasing against noise
+    curve = []
+    for d, r in moving:
+        t = r / gain + f
+        if not curve or t > curve[-1][0]:
+            curve.append((t, d))
+    t_low, d_low = curve[0]
+    t_high, d_high = curve[-1]
+    edge = max(d_low - t_low, 0.0)
+
+    table = []
+    for k in range(POINTS):
+        t = k / (POINTS - 1)
+        if t <= t_low:
+            d = edge + (d_low - edge) * t / t_low
+        elif t >= t_high:
+            d = d_high + (t - t_high)
+        else:
+            i = next(i for i in range(1, len(curve)) if curve[i][0] >= t)
+            (t0, d0), (t1, d1) = curve[i - 1], curve[i]
+            d = d0 + (d1 - d0) * (t - t0) / (t1 - t0)
+        table.append(min(max(int(round(d * FULL)), 0), FULL))
+    for k in range(1, POINTS):
+        table[k] = max(table[k], table[k - 1])
+
+    worst = max(abs(r - gain * (d - offset)) for d, r in moving if d >= offset)
+    print("/* %d steps: deadband %.2f%%, gain %.0f RPM, friction %.2f%%, largest "
+          "deviation from the line %.0f RPM */" % (len(steps), 100 * edge, gain, friction, worst))
+    print("#define PWM_LINEARIZATION {%s, \\" % ", ".join("%d" % v for v in table[:6]))
+    print("  %s, \\" % ", ".join("%d" % v for v in table[6:12]))
+    print("  %s}" % ", ".join("%d" % v for v in table[12:]))
+    if table[-1] == FULL and d_high + (1.0 - t_high) > 1.0:
+        print("/* The full torque is out of reach, the top of the table saturates at 100%. */")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+"""
+Capture the flight recorder traces the client sends when it freezes.
+
+Listens for RecorderHeader_t frames on UDP port 5005 (RECORDER_PORT) and
+writes each capture to recorder_<n>.csv in the format of Recorder_Dump()
+(timestamp, reference, velocity, control, encoder, latency, flags), which
+Tools/telemetry_bench.c reads. The client freezes the recorder on a skipped
+cycle, an overrun or a missing server reply, RECORDER_POST samples later.
+Missing samples of a capture are reported, the file keeps the rest.
+
+Usage: python3 Tools/recorder_capture.py [output_dir] [--port 5005]
+"""
+
+import os
+import socket
+import struct
+import sys
+
+RECORDER_MAGIC = 0x4352
+RECORDER_FLAG_TRIGGER = 0x0001
+HEADER = struct.Struct("<HHHHI")
+SAMPLE = struct.Struct("<IiiiIhH")
+
+
+def write_capture(out_dir, capture, total, samples):
+    path = os.path.join(out_dir, "recorder_%d.csv" % capture)
+    with open(path, "w") as f:
+        f.write("timestamp,reference,velocity,control,encoder,latency,flags\n")
+        for i in sorted(samples):
+            ts, ref, vel, ctl, lat, enc, flags = samples[i]
+            f.write("%d,%d,%d,%d,%d,%d,%d\n" % (ts, ref, vel, ctl, enc, lat, flags))
+    trigger = [samples[i][0] for i in samples if samples[i][6] & RECORDER_FLAG_TRIGGER]
+    print("capture %d -> %s: %d/%d samples%s" % (
+        capture, path, len(samples), total,
+        ", trigger at %d ms" % trigger[0] if trigger else ""))
+
+
+def main(argv):
+    out_dir = "."
+    port = 5005
+    args = list(argv[1:])
+    while args:
+        a = args.pop(0)
+        if a == "--port" and args:
+            port = int(args.pop(0))
+        else:
+            out_dir = a
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("", port))
+    print("listening on udp/%d" % port)
+
+    capture = None
+    total = 0
+    samples = {}
+
+    try:
+        while True:
+            data, addr = sock.recvfrom(2048)
+            if len(data) < HEADER.size:
+                continue
+            magic, count, cap, tot, index = HEADER.unpack_from(data)
+            if magic != RECORDER_MAGIC or len(data) < HEADER.size + count * SAMPLE.size:
+                continue
+
+            if cap != capture:
+                if samples:
+                    write_capture(out_dir, capture, total, samples)
+                capture, total, samples = cap, tot, {}
+                print("%s: capture %d, %d samples" % (addr[0], cap, tot))
+
+            for k in range(count):
+                samples[index + k] = SAMPLE.unpack_from(data, HEADER.size + k * SAMPLE.size)
+            if len(samples) == total:
+                write_capture(out_dir, capture, total, samples)
+                samples = {}
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if samples:
+            write_capture(out_dir, capture, total, samples)
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
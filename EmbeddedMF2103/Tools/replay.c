@@ -0,0 +1,138 @@
+/***
+ * Host tool: session replay
+ *
+ * Memory-maps a session log captured by Tools/session_capture.py and feeds
+ * every recorded ClientData_t through the firmware Controller_PIController,
+ * starting from Controller_Reset() and the configuration of the file header
+ * (gains and limits in use, feedforward, disturbance observer and schedule)
+ * like the server does on a new connection, with the recorded feedforward
+ * input of each step. Each output is compared bit for
+ * bit with the recorded ServerData_t, and the replay is repeated to report
+ * the controller throughput.
+ *
+ * A configuration change during the session (a parameter write, an adapted
+ * or identified model) is not in the log: the replay stops at the first
+ * step of another configuration and only checks the steps before it.
+ *
+ * Build (from EmbeddedMF2103/):
+ *   gcc -O2 -IInclude Tools/replay.c Source/controller.c -o replay
+ * Usage:
+ *   ./replay session_0.bin [passes]
+ ***/
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "controller.h"
+#include "network_protocol.h"
+
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t record_size;
+  uint32_t config_size;
+  Controller_Config_t config;
+} SessionFileHeader_t;
+
+static double Now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s session.bin [passes]\n", argv[0]);
+    return 2;
+  }
+  int passes = argc > 2 ? atoi(argv[2]) : 100;
+  if (passes < 1)
+    passes = 1;
+
+  int fd = open(argv[1], O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    perror(argv[1]);
+    return 1;
+  }
+  if ((size_t)st.st_size < sizeof(SessionFileHeader_t)) {
+    fprintf(stderr, "%s: too short\n", argv[1]);
+    return 1;
+  }
+
+  const uint8_t *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+
+  const SessionFileHeader_t *hdr = (const SessionFileHeader_t *)map;
+  if (memcmp(hdr->magic, "MFSL", 4) != 0 || hdr->version != 5 || hdr->record_size != sizeof(SessionRecord_t) ||
+      hdr->config_size != sizeof(Controller_Config_t)) {
+    fprintf(stderr, "%s: not a version 5 session log\n", argv[1]);
+    return 1;
+  }
+
+  const SessionRecord_t *rec = (const SessionRecord_t *)(map + sizeof(*hdr));
+  size_t n = ((size_t)st.st_size - sizeof(*hdr)) / sizeof(SessionRecord_t);
+  size_t total = n;
+
+  // Only the steps of the logged configuration can be reproduced
+  for (size_t i = 0; i < total; i++) {
+    if (rec[i].config != hdr->config.generation) {
+      printf("configuration changed at record %zu (t=%u ms), replaying the %zu records before it\n",
+             i, rec[i].rx.timestamp, i);
+      n = i;
+      break;
+    }
+  }
+
+  // Verification pass
+  size_t mismatches = 0;
+  Controller_Reset();
+  if (Controller_SetConfig(&hdr->config) != 0) {
+    fprintf(stderr, "%s: invalid controller configuration\n", argv[1]);
+    return 1;
+  }
+  for (size_t i = 0; i < n; i++) {
+    Controller_SetFeedforwardInput(rec[i].feedforward);
+    int32_t u = Controller_PIController(&rec[i].reference, &rec[i].rx.velocity,
+                                        &rec[i].rx.timestamp);
+    if (u != rec[i].tx.control) {
+      if (mismatches < 10)
+        printf("mismatch at %zu (t=%u ms): replay %d, recorded %d\n", i,
+               rec[i].rx.timestamp, u, rec[i].tx.control);
+      mismatches++;
+    }
+  }
+
+  // Timing passes
+  volatile int32_t sink = 0;
+  double t0 = Now();
+  for (int p = 0; p < passes; p++) {
+    Controller_Reset();
+    Controller_SetConfig(&hdr->config);
+    for (size_t i = 0; i < n; i++) {
+      Controller_SetFeedforwardInput(rec[i].feedforward);
+      sink += Controller_PIController(&rec[i].reference, &rec[i].rx.velocity,
+                                      &rec[i].rx.timestamp);
+    }
+  }
+  double dt = Now() - t0;
+
+  printf("%zu of %zu records, %zu mismatches -> %s\n", n, total, mismatches,
+         mismatches ? "NOT bit-exact" : "bit-exact");
+  if (n > 0)
+    printf("%.1f Msamples/s over %d passes\n", (double)n * passes / dt / 1e6, passes);
+
+  munmap((void *)map, (size_t)st.st_size);
+  close(fd);
+  return mismatches ? 1 : 0;
+}
@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+"""
+Capture the server session log stream into replayable log files.
+
+Listens for SessionLogHeader_t frames on UDP port 5002 (SESSION_LOG_PORT)
+and appends their SessionRecord_t records to session_<n>.bin. A frame with
+sequence 0 starts a new file with the controller configuration it carries.
+Gaps in the sequence are reported, the file is still written so a replay
+shows where the controller state diverges.
+
+File layout (little-endian), read by Tools/replay.c:
+    char     magic[4] = "MFSL"
+    uint32_t version  = 5
+    uint32_t record_size = 40
+    uint32_t config_size = 128
+    Controller_Config_t config
+    SessionRecord_t records[]
+
+Usage: python3 Tools/session_capture.py [output_dir] [--port 5002]
+"""
+
+import os
+import socket
+import struct
+import sys
+
+SESSION_LOG_MAGIC = 0x4C53
+HEADER = struct.Struct("<HHII")
+RECORD_SIZE = 40
+CONFIG_SIZE = 128
+FILE_HEADER = struct.pack("<4sIII", b"MFSL", 5, RECORD_SIZE, CONFIG_SIZE)
+
+
+def main(argv):
+    out_dir = "."
+    port = 5002
+    args = list(argv[1:])
+    while args:
+        a = args.pop(0)
+        if a == "--port" and args:
+            port = int(args.pop(0))
+        else:
+            out_dir = a
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("", port))
+    print("listening on udp/%d" % port)
+
+    f = None
+    index = 0
+    expected = None
+    records = 0
+    dropped_prev = 0
+
+    try:
+        while True:
+            data, addr = sock.recvfrom(2048)
+            if len(data) < HEADER.size:
+                continue
+            magic, count, sequence, dropped = HEADER.unpack_from(data)
+            if magic != SESSION_LOG_MAGIC or len(data) < HEADER.size + count * RECORD_SIZE:
+                continue
+
+            if sequence == 0:
+                if count != 0 or len(data) < HEADER.size + CONFIG_SIZE:
+                    continue  # Not a configuration frame
+                if f:
+                    f.close()
+                    print("  %d records" % records)
+                path = os.path.join(out_dir, "session_%d.bin" % index)
+                index += 1
+                f = open(path, "wb")
+                f.write(FILE_HEADER)
+                f.write(data[HEADER.size:HEADER.size + CONFIG_SIZE])
+                records = 0
+                print("%s: new session -> %s" % (addr[0], path))
+            elif f is None:
+                continue  # Joined in the middle of a session
+            elif sequence != expected:
+                print("  lost frames %d..%d" % (expected, sequence - 1))
+
+            f.write(data[HEADER.size:HEADER.size + count * RECORD_SIZE])
+            f.flush()
+            records += count
+            expected = sequence + 1
+            if dropped != dropped_prev:
+                print("  server dropped %d records" % (dropped - dropped_prev))
+                dropped_prev = dropped
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if f:
+            f.close()
+            print("  %d records" % records)
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,286 @@
+/***
+ * Host tool: telemetry codec benchmark
+ *
+ * Encodes a recorded session with the firmware telemetry codec, reports the
+ * compression ratio against TELEMETRY_FORMAT_RAW frames, then decodes it with
+ * the firmware reference decoder and with a batch decoder meant for the
+ * collecting host, checks both against the input and reports decode speed.
+ *
+ * The session is a CSV dump of the flight recorder (Recorder_Dump() or
+ * Tools/recorder_capture.py):
+ *   timestamp,reference,velocity,control,encoder,latency,flags
+ * Without a file, a synthetic 50 000-sample square-wave session is used.
+ *
+ * Build (from EmbeddedMF2103/):
+ *   gcc -O3 -march=native -IInclude Tools/telemetry_bench.c Source/telemetry_codec.c -o telemetry_bench
+ * Usage:
+ *   ./telemetry_bench [session.csv] [cpu_mhz]
+ ***/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+#include "telemetry_codec.h"
+
+#define ITERATIONS 200
+
+typedef struct {
+  uint32_t offset; // Start of the payload in the stream
+  uint32_t len;    // Payload length in bytes
+  uint32_t count;  // Samples in the frame
+} Frame_t;
+
+static double Now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static uint32_t LoadSession(const char *path, uint32_t mhz, TelemetrySample_t **out) {
+  FILE *f = fopen(path, "r");
+  char line[256];
+  uint32_t n = 0, cap = 4096;
+  TelemetrySample_t *s = malloc(cap * sizeof(*s));
+
+  if (!f || !s) {
+    perror(path);
+    exit(1);
+  }
+
+  while (fgets(line, sizeof(line), f)) {
+    unsigned long ts, lat;
+    long ref, vel, ctrl;
+    int enc;
+
+    if (sscanf(line, "%lu,%ld,%ld,%ld,%d,%lu", &ts, &ref, &vel, &ctrl, &enc, &lat) != 6)
+      continue; // Header or garbage
+    if (n == cap) {
+      cap *= 2;
+      s = realloc(s, cap * sizeof(*s));
+    }
+    lat /= mhz;
+    s[n].timestamp = (uint32_t)ts;
+    s[n].velocity = (int32_t)vel;
+    s[n].control = (int32_t)ctrl;
+    s[n].encoder = (int16_t)enc;
+    s[n].latency_us = (uint16_t)(lat > 0xFFFF ? 0xFFFF : lat);
+    n++;
+  }
+  fclose(f);
+
+  *out = s;
+  return n;
+}
+
+static uint32_t SynthSession(TelemetrySample_t **out) {
+  const uint32_t n = 50000;
+  TelemetrySample_t *s = malloc(n * sizeof(*s));
+  double vel = 0.0;
+  uint32_t seed = 1;
+
+  for (uint32_t i = 0; i < n; i++) {
+    double ref = ((i / 400) & 1) ? -2000.0 : 2000.0;
+    seed = seed * 1664525u + 1013904223u;
+    vel += 0.05 * (ref - vel) + (double)((int32_t)(seed >> 24) - 128) * 0.05;
+    s[i].timestamp = i * 10u;
+    s[i].velocity = (int32_t)vel;
+    s[i].control = (int32_t)(300000.0 * (ref - vel) + 200000.0 * vel);
+    s[i].encoder = (int16_t)(vel * 2048.0 * 10.0 / 60000.0);
+    s[i].latency_us = (uint16_t)(180 + (seed & 0x1F));
+  }
+
+  *out = s;
+  return n;
+}
+
+#if defined(__SSSE3__)
+/* Shuffle of the varints ending in the first 12 bytes of a 16-byte load,
+   for each pattern of their continuation bits: up to 4 varints of up to 4
+   bytes, one per 32-bit lane */
+typedef struct {
+  uint8_t shuffle[16];
+  uint8_t count;   // Varints decoded
+  uint8_t bytes;   // Bytes consumed
+} Shuffle_t;
+
+static Shuffle_t shuffles[1 << 12];
+
+static void InitBatch(void) {
+  for (uint32_t mask = 0; mask < (1u << 12); mask++) {
+    Shuffle_t *s = &shuffles[mask];
+    uint32_t start = 0;
+
+    memset(s->shuffle, 0x80, sizeof(s->shuffle)); // Zero the unused bytes
+    s->count = s->bytes = 0;
+    for (uint32_t b = 0; b < 12 && s->count < 4; b++) {
+      if (mask & (1u << b))
+        continue; // Continuation byte
+      if (b - start >= 4)
+        break;    // Longer varint, left to the byte loop
+      for (uint32_t k = start; k <= b; k++)
+        s->shuffle[4 * s->count + (k - start)] = (uint8_t)k;
+      s->count++;
+      start = b + 1;
+    }
+    s->bytes = (uint8_t)start;
+  }
+}
+#else
+static void InitBatch(void) {}
+#endif
+
+/* Batch decoder: a varint pass into a flat array, one branch-free zig-zag
+   pass the compiler vectorizes, then delta accumulation. With SSSE3 the
+   varint pass takes up to 4 varints per 16-byte load (masked VByte): the
+   continuation bits index a shuffle that spreads the varints over the
+   32-bit lanes, where their 7-bit groups are joined. A varint longer than
+   4 bytes and those in the last 15 bytes go through the byte loop. */
+static uint32_t DecodeBatch(const uint8_t *in, uint32_t len, uint32_t count,
+                            TelemetrySample_t *out) {
+  uint32_t v[TELEMETRY_BATCH * 5 + 3]; // A shuffle stores 4 lanes
+  const uint8_t *p = in, *end = in + len;
+  uint32_t fields = count * 5;
+  uint32_t i = 0;
+#if defined(__SSSE3__)
+  const __m128i low7 = _mm_set1_epi16(0x007F);
+  const __m128i high7 = _mm_set1_epi16(0x3F80);
+  const __m128i join = _mm_set1_epi32(0x40000001); // Low + 2^14 high half per lane
+#endif
+
+  while (i < fields) {
+#if defined(__SSSE3__)
+    if (end - p >= 16) {
+      __m128i x = _mm_loadu_si128((const __m128i *)p);
+      const Shuffle_t *s = &shuffles[_mm_movemask_epi8(x) & 0xFFF];
+
+      if (s->count > 0) {
+        // Bytes b0..b3 of a varint in a lane: b0 + 2^7 b1 per half, then
+        // the halves joined
+        __m128i b = _mm_shuffle_epi8(x, _mm_loadu_si128((const __m128i *)s->shuffle));
+        __m128i h = _mm_or_si128(_mm_and_si128(b, low7), _mm_and_si128(_mm_srli_epi16(b, 1), high7));
+        _mm_storeu_si128((__m128i *)&v[i], _mm_madd_epi16(h, join));
+        i += s->count;
+        p += s->bytes;
+        continue;
+      }
+    }
+#endif
+    if (p >= end)
+      return 0;
+    uint32_t b = *p++;
+    uint32_t r = b & 0x7F;
+    for (uint32_t shift = 7; b >= 0x80; shift += 7) {
+      if (p >= end || shift > 28)
+        return 0;
+      b = *p++;
+      r |= (b & 0x7F) << shift;
+    }
+    v[i++] = r;
+  }
+
+  for (uint32_t i = 0; i < fields; i++)
+    v[i] = (v[i] >> 1) ^ (0u - (v[i] & 1u));
+
+  uint32_t ts = 0, vel = 0, ctrl = 0;
+  for (uint32_t n = 0; n < count; n++) {
+    const uint32_t *f = &v[n * 5];
+    ts += f[0];
+    vel += f[1];
+    ctrl += f[2];
+    out[n].timestamp = ts;
+    out[n].velocity = (int32_t)vel;
+    out[n].control = (int32_t)ctrl;
+    out[n].encoder = (int16_t)f[3];
+    out[n].latency_us = (uint16_t)f[4];
+  }
+
+  return (uint32_t)(p - in);
+}
+
+static int Same(const TelemetrySample_t *a, const TelemetrySample_t *b, uint32_t n) {
+  for (uint32_t i = 0; i < n; i++) {
+    if (a[i].timestamp != b[i].timestamp || a[i].velocity != b[i].velocity ||
+        a[i].control != b[i].control || a[i].encoder != b[i].encoder ||
+        a[i].latency_us != b[i].latency_us)
+      return 0;
+  }
+  return 1;
+}
+
+int main(int argc, char **argv) {
+  TelemetrySample_t *in;
+  uint32_t mhz = argc > 2 ? (uint32_t)atoi(argv[2]) : 40;
+  uint32_t n = argc > 1 ? LoadSession(argv[1], mhz ? mhz : 40, &in) : SynthSession(&in);
+
+  if (n == 0) {
+    fprintf(stderr, "no samples\n");
+    return 1;
+  }
+
+  // Encode into frames exactly like Telemetry_BuildFrame()
+  const uint32_t payload = TELEMETRY_BATCH * sizeof(TelemetrySample_t);
+  uint32_t nframes_max = n; // At least one sample per frame
+  Frame_t *frames = malloc(nframes_max * sizeof(*frames));
+  uint8_t *stream = malloc((size_t)nframes_max * payload);
+  uint32_t nframes = 0, pos = 0, done = 0;
+
+  while (done < n) {
+    uint32_t count = n - done < TELEMETRY_BATCH ? n - done : TELEMETRY_BATCH;
+    uint32_t len = TelemetryCodec_Encode(&in[done], count, stream + pos, payload, &count);
+    frames[nframes++] = (Frame_t){pos, len, count};
+    pos += len;
+    done += count;
+  }
+
+  uint64_t raw_bytes = (uint64_t)((n + TELEMETRY_BATCH - 1) / TELEMETRY_BATCH) * sizeof(TelemetryHeader_t) +
+                       (uint64_t)n * sizeof(TelemetrySample_t);
+  uint64_t delta_bytes = (uint64_t)nframes * sizeof(TelemetryHeader_t) + pos;
+
+  printf("samples:            %u in %u frames\n", n, nframes);
+  printf("raw payload:        %.2f bytes/sample\n", (double)n * sizeof(TelemetrySample_t) / n);
+  printf("delta payload:      %.2f bytes/sample\n", (double)pos / n);
+  printf("compression ratio:  %.2fx payload, %.2fx on the wire\n",
+         (double)n * sizeof(TelemetrySample_t) / pos, (double)raw_bytes / delta_bytes);
+
+  TelemetrySample_t *out = malloc(n * sizeof(*out));
+  InitBatch();
+  const char *names[2] = {"reference decoder", "batch decoder"};
+
+  for (int d = 0; d < 2; d++) {
+    double t0 = Now();
+    for (int it = 0; it < ITERATIONS; it++) {
+      uint32_t k = 0;
+      for (uint32_t fr = 0; fr < nframes; fr++) {
+        const Frame_t *f = &frames[fr];
+        uint32_t used = d == 0
+            ? TelemetryCodec_Decode(stream + f->offset, f->len, f->count, &out[k])
+            : DecodeBatch(stream + f->offset, f->len, f->count, &out[k]);
+        if (used != f->len) {
+          fprintf(stderr, "%s: frame %u corrupt\n", names[d], fr);
+          return 1;
+        }
+        k += f->count;
+      }
+    }
+    double dt = Now() - t0;
+
+    if (!Same(in, out, n)) {
+      fprintf(stderr, "%s: output differs from input\n", names[d]);
+      return 1;
+    }
+    printf("%-19s %8.1f MB/s compressed, %8.1f Msamples/s\n", names[d],
+           (double)pos * ITERATIONS / dt / 1e6, (double)n * ITERATIONS / dt / 1e6);
+  }
+
+  free(out);
+  free(stream);
+  free(frames);
+  free(in);
+  return 0;
+}